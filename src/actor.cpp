@@ -0,0 +1,245 @@
+#include "actor.hpp"
+
+#include <vector>
+
+#include <boost/context/protected_fixedsize_stack.hpp>
+
+#include "lisp.hpp"
+#include "utils.hpp"
+#include "runtime.hpp"
+#include "scheduler.hpp"
+#include "hash_table.hpp"
+#include "vector.hpp"
+#include "typed_array.hpp"
+
+
+namespace lisp {
+    namespace {
+        /**
+           @brief The environment of an actor.
+        */
+        struct actor_frame
+        {
+            actor_frame(runtime& rt, const environment* caller)
+                : env(rt.global_env(), true),
+                  bindings(env.capture_bindings(caller, copy_message))
+                {
+                }
+
+            environment env;
+            // Declared after env, so they are released first.
+            std::vector<symbol_ptr_t> bindings;
+        };
+
+        template <typename T>
+        object_ptr_t copy_typed_array(const object_ptr_t& message)
+        {
+            const typed_array<T>& array = static_cast<const typed_array<T>&>(*message);
+
+            return object_ptr_t(new typed_array<T>(
+                                    typename typed_array<T>::elements_t(
+                                        array.data(), array.data() + array.size())));
+        }
+    }
+
+    object_ptr_t copy_message(const object_ptr_t& message)
+    {
+        const object* obj = message.get();
+
+        if(message->is_cons_cell()) {
+            list_builder copy;
+            object_ptr_t rest = message;
+
+            while(rest->is_cons_cell()) {
+                const cons_cell& cell = static_cast<const cons_cell&>(*rest);
+
+                copy.push_back(copy_message(cell.car()));
+                rest = cell.cdr();
+            }
+
+            if(rest != nil())
+                copy.set_rest(copy_message(rest));
+
+            return copy.list();
+        }
+        else if(const number* num = dynamic_cast<const number*>(obj))
+            return object_ptr_t(new number(*num));
+        else if(const string* str = dynamic_cast<const string*>(obj))
+            return object_ptr_t(new string(str->value()));
+        else if(const symbol_ref* ref = dynamic_cast<const symbol_ref*>(obj))
+            return object_ptr_t(new symbol_ref(ref->name()));
+        else if(const quote* quoted = dynamic_cast<const quote*>(obj))
+            return object_ptr_t(new quote(copy_message(quoted->quoted())));
+        else if(const vector* vec = dynamic_cast<const vector*>(obj)) {
+            vector::elements_t elements;
+
+            elements.reserve(vec->size());
+
+            for(std::size_t i = 0; i < vec->size(); ++i)
+                elements.push_back(copy_message((*vec)[i]));
+
+            return object_ptr_t(new vector(elements));
+        }
+        else if(dynamic_cast<const f64_array*>(obj))
+            return copy_typed_array<double>(message);
+        else if(dynamic_cast<const i64_array*>(obj))
+            return copy_typed_array<long long>(message);
+        else if(const hash_table* table = dynamic_cast<const hash_table*>(obj)) {
+            hash_table_ptr_t copy(new hash_table(table->test(), table->count()));
+
+            for(std::size_t i = 0; i < table->capacity(); ++i) {
+                if(table->key_at(i))
+                    copy->put(copy_message(table->key_at(i)),
+                              copy_message(table->value_at(i)));
+            }
+
+            return copy;
+        }
+
+        return message;
+    }
+
+    actor::actor(scheduler* sched, body_t body)
+        : m_scheduler(sched),
+          m_body(body),
+          m_mailbox(mailbox_capacity),
+          m_calls(),
+          m_worker(0),
+          m_parked(false),
+          m_notified(false),
+          m_done(false)
+    {
+    }
+
+    actor::~actor()
+    {
+    }
+
+    actor_ptr_t actor::spawn(environment* env, body_t body)
+    {
+        runtime& rt = runtime::current();
+        actor_ptr_t a(new actor(&rt.scheduler(), body));
+        boost::shared_ptr<actor_frame> frame(new actor_frame(rt, env));
+        actor* self = a.get();
+
+        a->m_fiber = boost::context::fiber(
+            std::allocator_arg, boost::context::protected_fixedsize_stack(stack_size),
+            [self, frame](boost::context::fiber&& caller) mutable {
+                self->m_caller = std::move(caller);
+
+                // The frame's symbols are released on the actor's
+                // thread, before the actor is done.
+                {
+                    boost::shared_ptr<actor_frame> own;
+
+                    own.swap(frame);
+                    self->run(&own->env);
+                }
+
+                self->finish();
+
+                return std::move(self->m_caller);
+            });
+
+        a->m_scheduler->start(a);
+
+        return a;
+    }
+
+    actor_ptr_t actor::self()
+    {
+        // The scheduler makes the running actor the current waiter.
+        if(actor* running = dynamic_cast<actor*>(&waiter::current()))
+            return running->shared_from_this();
+
+        thread_local actor_ptr_t own;
+
+        if(!own)
+            own.reset(new actor(0, body_t()));
+
+        return own;
+    }
+
+    void actor::send(const object_ptr_t& message)
+    {
+        m_mailbox.push(copy_message(message));
+    }
+
+    object_ptr_t actor::receive()
+    {
+        return m_mailbox.pop();
+    }
+
+    bool actor::is_done() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        return m_done;
+    }
+
+    object_ptr_t actor::await()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        m_joiners.wait(lock, [this]() { return m_done; });
+
+        if(m_error)
+            std::rethrow_exception(m_error);
+
+        return copy_message(m_result);
+    }
+
+    std::string actor::str() const
+    {
+        if(is_done())
+            return "#<actor done>";
+
+        return m_scheduler ? "#<actor running>" : "#<actor thread>";
+    }
+
+    void actor::block(std::unique_lock<std::mutex>& lock)
+    {
+        m_scheduler->prepare_park(*this);
+
+        lock.unlock();
+
+        try {
+            m_caller = std::move(m_caller).resume();
+        }
+        catch(...) {
+            lock.lock();
+            throw;
+        }
+
+        lock.lock();
+    }
+
+    void actor::wake()
+    {
+        m_scheduler->wake(*this);
+    }
+
+    void actor::run(environment* env)
+    {
+        try {
+            m_result = m_body(env);
+        }
+        catch(const boost::context::detail::forced_unwind&) {
+            // The scheduler is stopped.
+            throw;
+        }
+        catch(...) {
+            m_error = std::current_exception();
+        }
+
+        m_body = body_t();
+    }
+
+    void actor::finish()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_done = true;
+        m_joiners.wake_all();
+    }
+}
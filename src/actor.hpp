@@ -0,0 +1,154 @@
+#ifndef LISP_ACTOR_HPP
+#define LISP_ACTOR_HPP
+
+#include <exception>
+#include <functional>
+#include <mutex>
+
+#include <boost/context/fiber.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include "object.hpp"
+#include "channel.hpp"
+#include "profiler.hpp"
+
+
+namespace lisp {
+    class scheduler;
+
+    class actor;
+    typedef boost::shared_ptr<actor> actor_ptr_t;
+
+    /**
+       @brief Copies a message for another actor.
+
+       Lists, vectors, typed arrays, hash tables, strings, numbers
+       and symbols are copied deeply, so sender and receiver don't
+       share them. Functions, futures and actors are shared, they
+       are never changed or are synchronized. Messages must not be
+       circular.
+    */
+    object_ptr_t copy_message(const object_ptr_t& message);
+
+    /**
+       @brief An isolated lisp process, see (spawn EXPR), with a
+       bounded mailbox.
+
+       An actor runs on a fiber of its own, scheduled by the
+       runtime's scheduler. Its environment is a fork of the global
+       environment (see environment::environment()) holding copies
+       of the spawning code's local variables (see copy_message()).
+       Actors only exchange copies through their mailboxes, but
+       global variables and definitions are shared.
+
+       A thread that isn't running an actor has an actor of its
+       own as well (see self()), without a fiber: messages sent to
+       it are received by that thread.
+    */
+    class actor : public object,
+                  public waiter,
+                  public boost::enable_shared_from_this<actor>
+    {
+    public:
+        typedef std::function<object_ptr_t(environment* env)> body_t;
+
+        // Messages a mailbox holds before send blocks.
+        enum { mailbox_capacity = 1024 };
+
+        // The stack of an actor's fiber, as large as a thread's.
+        // It is mapped on spawn, pages are only committed when the
+        // fiber touches them.
+        enum { stack_size = 8 * 1024 * 1024 };
+
+        ~actor();
+
+        /**
+           @brief Starts @a body as a new actor on the scheduler of
+           the current runtime.
+
+           @param env The environment whose local variables are
+           copied for @a body.
+        */
+        static actor_ptr_t spawn(environment* env, body_t body);
+
+        /**
+           @brief Returns the running actor or the one of the calling
+           thread.
+        */
+        static actor_ptr_t self();
+
+        /**
+           @brief Puts a copy of @a message into the mailbox, blocks
+           while the mailbox is full.
+        */
+        void send(const object_ptr_t& message);
+
+        /**
+           @brief Returns the oldest message of the mailbox, blocks
+           while it is empty. Must be called by the actor itself.
+        */
+        object_ptr_t receive();
+
+        bool is_done() const;
+
+        /**
+           @brief Waits until the actor finished and returns a copy
+           of its value or rethrows the error it signaled.
+
+           An actor that is waited for by itself or an actor without
+           fiber never finishes.
+        */
+        object_ptr_t await();
+
+        std::string str() const;
+
+        void block(std::unique_lock<std::mutex>& lock);
+
+        void wake();
+
+    private:
+        friend class scheduler;
+
+        /**
+           @param sched The scheduler running the actor, a null
+           pointer for the actor of a thread.
+        */
+        actor(scheduler* sched, body_t body);
+
+        /**
+           @brief Evaluates the body and keeps its value or error.
+        */
+        void run(environment* env);
+
+        /**
+           @brief Marks the actor done and wakes the threads and
+           actors waiting for it.
+        */
+        void finish();
+
+        scheduler* const m_scheduler;
+        body_t m_body;
+        channel m_mailbox;
+
+        // The actor's fiber while it is suspended and the
+        // scheduler's fiber while the actor runs.
+        boost::context::fiber m_fiber;
+        boost::context::fiber m_caller;
+        // The shadow call stack of the fiber.
+        profiler::call_stack m_calls;
+
+        // Guarded by the mutex of the scheduler's thread.
+        std::size_t m_worker;
+        bool m_parked;
+        bool m_notified;
+
+        mutable std::mutex m_mutex;
+        bool m_done;
+        // Written by run(), read once m_done is set.
+        object_ptr_t m_result;
+        std::exception_ptr m_error;
+        wait_list m_joiners;
+    };
+}
+
+#endif  // LISP_ACTOR_HPP
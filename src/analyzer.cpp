@@ -0,0 +1,992 @@
+
+#include "analyzer.hpp"
+
+#include <atomic>
+
+#include <boost/foreach.hpp>
+
+#include "types.hpp"
+#include "function.hpp"
+#include "forms.hpp"
+#include "utils.hpp"
+#include "lisp_error.hpp"
+#include "eval_stats.hpp"
+#include "runtime.hpp"
+#include "epoch.hpp"
+
+
+namespace lisp {
+    namespace {
+        typedef std::vector<node_ptr_t> node_list_t;
+        typedef std::vector<object_ptr_t> form_list_t;
+
+        template <typename T>
+        bool is_a(const object_ptr_t& obj)
+        {
+            return dynamic_cast<T*>(obj.get()) != 0;
+        }
+
+        /**
+           @brief Atoms that always evaluate to the same object
+           (numbers, strings, nil, t and quoted objects).
+        */
+        class constant_node : public node
+        {
+        public:
+            constant_node(object_ptr_t value)
+                : m_value(value)
+                {
+                }
+
+            object_ptr_t eval(environment*)
+                {
+                    return m_value;
+                }
+
+        private:
+            object_ptr_t m_value;
+        };
+
+        /**
+           @brief Objects of unknown type which are evaluated through
+           environment::eval().
+        */
+        class object_node : public node
+        {
+        public:
+            object_node(object_ptr_t obj)
+                : m_object(obj)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    return env->eval(m_object);
+                }
+
+        private:
+            object_ptr_t m_object;
+        };
+
+        class variable_node : public node
+        {
+        public:
+            variable_node(const std::string& name)
+                : m_name(name)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    return env->get_symbol(m_name)->value();
+                }
+
+        private:
+            std::string m_name;
+        };
+
+        class progn_node : public node
+        {
+        public:
+            progn_node(const node_list_t& body)
+                : m_body(body)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    object_ptr_t last_result = nil();
+
+                    BOOST_FOREACH(const node_ptr_t& current, m_body) {
+                        last_result = current->eval(env);
+                    }
+
+                    return last_result;
+                }
+
+            object_ptr_t eval_tail(environment* env, tail_call& tail)
+                {
+                    if(m_body.empty())
+                        return nil();
+
+                    node_list_t::const_iterator last = m_body.end() - 1;
+
+                    for(node_list_t::const_iterator iter = m_body.begin();
+                        iter != last; ++iter)
+                        (*iter)->eval(env);
+
+                    return (*last)->eval_tail(env, tail);
+                }
+
+        private:
+            node_list_t m_body;
+        };
+
+        class if_node : public node
+        {
+        public:
+            if_node(node_ptr_t test, node_ptr_t then, node_ptr_t otherwise)
+                : m_test(test),
+                  m_then(then),
+                  m_else(otherwise)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    if(m_test->eval(env) != nil())
+                        return m_then->eval(env);
+                    else
+                        return m_else->eval(env);
+                }
+
+            object_ptr_t eval_tail(environment* env, tail_call& tail)
+                {
+                    if(m_test->eval(env) != nil())
+                        return m_then->eval_tail(env, tail);
+                    else
+                        return m_else->eval_tail(env, tail);
+                }
+
+        private:
+            node_ptr_t m_test;
+            node_ptr_t m_then;
+            node_ptr_t m_else;
+        };
+
+        class or_node : public node
+        {
+        public:
+            or_node(const node_list_t& args)
+                : m_args(args)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    BOOST_FOREACH(const node_ptr_t& current, m_args) {
+                        object_ptr_t evaled = current->eval(env);
+
+                        if(evaled != nil())
+                            return evaled;
+                    }
+
+                    return nil();
+                }
+
+            object_ptr_t eval_tail(environment* env, tail_call& tail)
+                {
+                    if(m_args.empty())
+                        return nil();
+
+                    node_list_t::const_iterator last = m_args.end() - 1;
+
+                    for(node_list_t::const_iterator iter = m_args.begin();
+                        iter != last; ++iter) {
+                        object_ptr_t evaled = (*iter)->eval(env);
+
+                        if(evaled != nil())
+                            return evaled;
+                    }
+
+                    return (*last)->eval_tail(env, tail);
+                }
+
+        private:
+            node_list_t m_args;
+        };
+
+        class and_node : public node
+        {
+        public:
+            and_node(const node_list_t& args)
+                : m_args(args)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    object_ptr_t last = nil();
+
+                    BOOST_FOREACH(const node_ptr_t& current, m_args) {
+                        last = current->eval(env);
+
+                        if(last == nil())
+                            return last;
+                    }
+
+                    return last;
+                }
+
+            object_ptr_t eval_tail(environment* env, tail_call& tail)
+                {
+                    if(m_args.empty())
+                        return nil();
+
+                    node_list_t::const_iterator last = m_args.end() - 1;
+
+                    for(node_list_t::const_iterator iter = m_args.begin();
+                        iter != last; ++iter) {
+                        if((*iter)->eval(env) == nil())
+                            return nil();
+                    }
+
+                    return (*last)->eval_tail(env, tail);
+                }
+
+        private:
+            node_list_t m_args;
+        };
+
+        class setq_node : public node
+        {
+        public:
+            setq_node(const std::string& name, node_ptr_t value)
+                : m_name(name),
+                  m_value(value)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    symbol_ptr_t sym = env->get_writable_symbol(m_name);
+
+                    sym->set_value(m_value->eval(env));
+
+                    return sym;
+                }
+
+        private:
+            std::string m_name;
+            node_ptr_t m_value;
+        };
+
+        /**
+           @brief A handler clause of condition-case.
+        */
+        struct condition_handler
+        {
+            condition_handler(object_ptr_t condition_, node_ptr_t body_)
+                : condition(condition_),
+                  body(body_)
+                {
+                }
+
+            object_ptr_t condition;
+            node_ptr_t body;
+        };
+
+        typedef std::vector<condition_handler> handler_list_t;
+
+        /**
+           The body runs inside a plain C++ try block, so a
+           condition-case whose body doesn't signal costs nothing
+           beyond evaluating the body.
+        */
+        class condition_case_node : public node
+        {
+        public:
+            condition_case_node(const std::string& var, node_ptr_t body,
+                                const handler_list_t& handlers)
+                : m_var(var),
+                  m_body(body),
+                  m_handlers(handlers)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    try {
+                        return m_body->eval(env);
+                    }
+                    catch(const lisp_error& err) {
+                        return handle(env, err);
+                    }
+                    catch(const arith_error& err) {
+                        return handle(env, as_lisp_error(err));
+                    }
+                }
+
+        private:
+            /**
+               @brief Runs the handler matching @a err, rethrows the
+               current exception if there is none.
+            */
+            object_ptr_t handle(environment* env, const lisp_error& err)
+                {
+                    BOOST_FOREACH(const condition_handler& handler, m_handlers) {
+                        if(!err.matches(handler.condition))
+                            continue;
+
+                        environment handler_env(env);
+                        symbol_ptr_t sym;
+
+                        if(!m_var.empty()) {
+                            sym = handler_env.create_symbol(m_var);
+                            sym->set_value(err.value());
+                        }
+
+                        return handler.body->eval(&handler_env);
+                    }
+
+                    throw;
+                }
+
+            std::string m_var;
+            node_ptr_t m_body;
+            handler_list_t m_handlers;
+        };
+
+        class unwind_protect_node : public node
+        {
+        public:
+            unwind_protect_node(node_ptr_t body, node_ptr_t unwind)
+                : m_body(body),
+                  m_unwind(unwind)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    object_ptr_t result;
+
+                    try {
+                        result = m_body->eval(env);
+                    }
+                    catch(...) {
+                        m_unwind->eval(env);
+                        throw;
+                    }
+
+                    m_unwind->eval(env);
+                    return result;
+                }
+
+        private:
+            node_ptr_t m_body;
+            node_ptr_t m_unwind;
+        };
+
+        /**
+           @brief (future EXPR) with EXPR analyzed once, the pool's
+           threads share the analysis.
+        */
+        class future_node : public node
+        {
+        public:
+            future_node(node_ptr_t body)
+                : m_body(body)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    const node_ptr_t body = m_body;
+
+                    return future::start(env, [body](environment* future_env) {
+                            return body->eval(future_env);
+                        });
+                }
+
+        private:
+            node_ptr_t m_body;
+        };
+
+        /**
+           @brief (time EXPR) and (benchmark N EXPR) with EXPR
+           analyzed once.
+        */
+        class timing_node : public node
+        {
+        public:
+            /**
+               @param count The node evaluating N or a null pointer
+               for (time EXPR).
+            */
+            timing_node(node_ptr_t count, node_ptr_t body)
+                : m_count(count),
+                  m_body(body)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    if(!m_count)
+                        return measure_evaluation("time", 1, [this, env]() {
+                                return m_body->eval(env);
+                            });
+
+                    return measure_evaluation("benchmark",
+                                              benchmark_form::iterations(env, m_count->eval(env)),
+                                              [this, env]() {
+                                                  return m_body->eval(env);
+                                              });
+                }
+
+        private:
+            node_ptr_t m_count;
+            node_ptr_t m_body;
+        };
+
+        /**
+           @brief (spawn EXPR) with EXPR analyzed once.
+        */
+        class spawn_node : public node
+        {
+        public:
+            spawn_node(node_ptr_t body)
+                : m_body(body)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    const node_ptr_t body = m_body;
+
+                    return actor::spawn(env, [body](environment* actor_env) {
+                            return body->eval(actor_env);
+                        });
+                }
+
+        private:
+            node_ptr_t m_body;
+        };
+
+        class lambda_node : public node
+        {
+        public:
+            lambda_node(const function::arg_sym_list_t& arg_symbols,
+                        cons_cell_ptr_t body, node_ptr_t analyzed_body)
+                : m_arg_symbols(arg_symbols),
+                  m_body(body),
+                  m_analyzed_body(analyzed_body)
+                {
+                }
+
+            object_ptr_t eval(environment*)
+                {
+                    return object_ptr_t(new function(m_arg_symbols, m_body,
+                                                     m_analyzed_body));
+                }
+
+        private:
+            function::arg_sym_list_t m_arg_symbols;
+            cons_cell_ptr_t m_body;
+            node_ptr_t m_analyzed_body;
+        };
+
+        const std::string lambda_name("lambda");
+
+        /**
+           @brief Calls @a func with the analyzed arguments if it
+           takes evaluated arguments, otherwise passes it the call
+           form like cons_cell::eval() does.
+
+           @param name The name of @a func for eval_stats::trace_t.
+        */
+        object_ptr_t call(environment* env, object_ptr_t func,
+                          const node_list_t& args, const cons_cell_ptr_t& form,
+                          const std::string& name)
+        {
+            if(!func->is_applicable()) {
+                eval_stats::traced_call traced(name);
+
+                return env->funcall(func, form);
+            }
+
+            arg_buffer vargs;
+
+            BOOST_FOREACH(const node_ptr_t& current, args) {
+                vargs.push_back(current->eval(env));
+            }
+
+            eval_stats::traced_call traced(name);
+
+            return func->apply(env, vargs);
+        }
+
+        /**
+           @brief Like call(), but leaves calls of lisp functions
+           to the caller (see node::eval_tail()).
+        */
+        object_ptr_t tail_call_or_call(environment* env, object_ptr_t func,
+                                       const node_list_t& args,
+                                       const cons_cell_ptr_t& form,
+                                       const std::string& name,
+                                       tail_call& tail)
+        {
+            if(!is_a<function>(func))
+                return call(env, func, args, form, name);
+
+            tail.args.clear();
+
+            BOOST_FOREACH(const node_ptr_t& current, args) {
+                tail.args.push_back(current->eval(env));
+            }
+
+            tail.callee = func;
+
+            return object_ptr_t();
+        }
+
+        /**
+           @brief Call of the function stored in a symbol's function
+           cell.
+
+           The function found is cached together with the
+           definition_version() and the function scope it was looked
+           up from (see environment::function_scope()), so further
+           calls from the same scope skip the lookup as long as no
+           function cell changes. Forks, which may define their own
+           functions, don't share cached functions with each other or
+           with the global environment.
+
+           Threads of a shared runtime run the same nodes (see
+           pmapcar), so the cache is an atomically replaced entry.
+           Replaced entries are retired (see runtime::retired()),
+           because other threads may still be reading them.
+        */
+        class symbol_call_node : public node
+        {
+        public:
+            symbol_call_node(const std::string& name, const node_list_t& args,
+                             cons_cell_ptr_t form)
+                : m_name(name),
+                  m_args(args),
+                  m_form(form),
+                  m_cache(0)
+                {
+                }
+
+            ~symbol_call_node()
+                {
+                    delete m_cache.load(std::memory_order_relaxed);
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    return call(env, lookup(env), m_args, m_form, m_name);
+                }
+
+            object_ptr_t eval_tail(environment* env, tail_call& tail)
+                {
+                    return tail_call_or_call(env, lookup(env), m_args, m_form, m_name, tail);
+                }
+
+        private:
+            /**
+               @brief A cached function. Its version is refreshed as
+               long as lookups find the same function.
+            */
+            struct cache_entry
+            {
+                cache_entry(const object_ptr_t& function, const environment* scope,
+                            unsigned long version)
+                    : function(function),
+                      scope(scope),
+                      version(version)
+                    {
+                    }
+
+                const object_ptr_t function;
+                const environment* const scope;
+                std::atomic<unsigned long> version;
+            };
+
+            object_ptr_t lookup(environment* env)
+                {
+                    unsigned long version = definition_version();
+                    const environment* scope = env->function_scope();
+
+                    {
+                        epoch::read_guard guard;
+                        const cache_entry* entry = m_cache.load();
+
+                        if(entry && entry->scope == scope &&
+                           entry->version.load(std::memory_order_relaxed) == version)
+                            return entry->function;
+                    }
+
+                    object_ptr_t function = env->get_function(m_name);
+
+                    if(!function)
+                        signal(env->get_symbol("invalid-function"), m_name);
+
+                    // Entries aren't refreshed anymore, so they expire
+                    // with the version.
+                    if(runtime::current().has_local_functions())
+                        return function;
+
+                    {
+                        epoch::read_guard guard;
+                        cache_entry* entry = m_cache.load();
+
+                        if(entry && entry->scope == scope && entry->function == function) {
+                            entry->version.store(version, std::memory_order_relaxed);
+
+                            return function;
+                        }
+                    }
+
+                    cache_entry* replaced = m_cache.exchange(new cache_entry(function, scope, version));
+
+                    if(replaced)
+                        runtime::current().retired().retire([replaced]() { delete replaced; });
+
+                    return function;
+                }
+
+            std::string m_name;
+            node_list_t m_args;
+            cons_cell_ptr_t m_form;
+
+            std::atomic<cache_entry*> m_cache;
+        };
+
+        /**
+           @brief Call of a lambda expression,
+           e.g. ((lambda (x) x) 1).
+        */
+        class lambda_call_node : public node
+        {
+        public:
+            lambda_call_node(node_ptr_t lambda, const node_list_t& args,
+                             cons_cell_ptr_t form)
+                : m_lambda(lambda),
+                  m_args(args),
+                  m_form(form)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    return call(env, m_lambda->eval(env), m_args, m_form, lambda_name);
+                }
+
+            object_ptr_t eval_tail(environment* env, tail_call& tail)
+                {
+                    return tail_call_or_call(env, m_lambda->eval(env), m_args, m_form,
+                                             lambda_name, tail);
+                }
+
+        private:
+            node_ptr_t m_lambda;
+            node_list_t m_args;
+            cons_cell_ptr_t m_form;
+        };
+
+        /**
+           @brief Fallback for forms the analyzer doesn't understand.
+           Evaluates them exactly like cons_cell::eval() does.
+        */
+        class form_call_node : public node
+        {
+        public:
+            form_call_node(cons_cell_ptr_t form)
+                : m_form(form)
+                {
+                }
+
+            object_ptr_t eval(environment* env)
+                {
+                    return env->funcall(m_form->car(), m_form);
+                }
+
+        private:
+            cons_cell_ptr_t m_form;
+        };
+
+
+        /**
+           @brief Returns the object in the function cell of the named
+           symbol without creating the symbol.
+        */
+        object_ptr_t function_of(environment* env, const std::string& name)
+        {
+            return env->get_function(name);
+        }
+
+        /**
+           @brief Stores the elements of @a list in @a elements.
+
+           @return false if @a list isn't a proper list.
+        */
+        bool collect(object_ptr_t list, form_list_t& elements)
+        {
+            while(list->is_cons_cell()) {
+                cons_cell_ptr_t cell = boost::dynamic_pointer_cast<cons_cell>(list);
+
+                elements.push_back(cell->car());
+                list = cell->cdr();
+            }
+
+            return list == nil();
+        }
+
+        node_list_t analyze_all(environment* env, form_list_t::const_iterator begin,
+                                form_list_t::const_iterator end)
+        {
+            node_list_t nodes;
+
+            for(; begin != end; ++begin)
+                nodes.push_back(analyze(env, *begin));
+
+            return nodes;
+        }
+
+        /**
+           @brief Analyzes (lambda ARGS . BODY).
+
+           @return A null pointer if the form is malformed.
+        */
+        node_ptr_t analyze_lambda(environment* env, const cons_cell_ptr_t& form)
+        {
+            if(!form->cdr()->is_cons_cell())
+                return node_ptr_t();
+
+            cons_cell_ptr_t cdr = boost::dynamic_pointer_cast<cons_cell>(form->cdr());
+
+            form_list_t arg_list;
+
+            if(!collect(cdr->car(), arg_list))
+                return node_ptr_t();
+
+            function::arg_sym_list_t function_arg_list;
+
+            BOOST_FOREACH(const object_ptr_t& current, arg_list) {
+                if(!current->is_symbol_ref())
+                    return node_ptr_t();
+
+                function_arg_list.push_back(
+                    boost::dynamic_pointer_cast<symbol_ref>(current)->name());
+            }
+
+            cons_cell_ptr_t body = boost::dynamic_pointer_cast<cons_cell>(cdr->cdr());
+
+            return node_ptr_t(new lambda_node(function_arg_list, body,
+                                              analyze_body(env, body)));
+        }
+
+        /**
+           @brief Analyzes (condition-case VAR BODYFORM HANDLERS...).
+
+           @return A null pointer if the form is malformed.
+        */
+        node_ptr_t analyze_condition_case(environment* env, const form_list_t& args)
+        {
+            if(args.size() < 2 || (!args[0]->is_symbol_ref() && args[0] != nil()))
+                return node_ptr_t();
+
+            std::string var;
+
+            if(args[0]->is_symbol_ref())
+                var = boost::dynamic_pointer_cast<symbol_ref>(args[0])->name();
+
+            handler_list_t handlers;
+
+            for(form_list_t::const_iterator it = args.begin() + 2; it != args.end(); ++it) {
+                form_list_t clause;
+
+                if(!(*it)->is_cons_cell() || !collect(*it, clause))
+                    return node_ptr_t();
+
+                handlers.push_back(
+                    condition_handler(clause[0],
+                                      node_ptr_t(new progn_node(
+                                                     analyze_all(env, clause.begin() + 1,
+                                                                 clause.end())))));
+            }
+
+            return node_ptr_t(new condition_case_node(var, analyze(env, args[1]),
+                                                      handlers));
+        }
+
+        /**
+           @brief Analyzes a special form.
+
+           @return A null pointer if @a func isn't a special form
+           known to the analyzer or the form is malformed. The form
+           is evaluated through its function cell then, which signals
+           the error.
+        */
+        node_ptr_t analyze_special_form(environment* env, const object_ptr_t& func,
+                                        const cons_cell_ptr_t& form,
+                                        const form_list_t& args)
+        {
+            if(is_a<if_form>(func)) {
+                if(args.empty())
+                    return node_ptr_t();
+
+                node_ptr_t then;
+
+                if(args.size() > 1)
+                    then = analyze(env, args[1]);
+                else
+                    then = node_ptr_t(new constant_node(nil()));
+
+                node_list_t otherwise;
+
+                if(args.size() > 2)
+                    otherwise = analyze_all(env, args.begin() + 2, args.end());
+
+                return node_ptr_t(new if_node(analyze(env, args[0]), then,
+                                              node_ptr_t(new progn_node(otherwise))));
+            }
+            else if(is_a<or_form>(func))
+                return node_ptr_t(new or_node(analyze_all(env, args.begin(),
+                                                          args.end())));
+            else if(is_a<and_form>(func))
+                return node_ptr_t(new and_node(analyze_all(env, args.begin(),
+                                                           args.end())));
+            else if(is_a<setq_form>(func)) {
+                if(args.size() < 2 || !args[0]->is_symbol_ref())
+                    return node_ptr_t();
+
+                return node_ptr_t(
+                    new setq_node(boost::dynamic_pointer_cast<symbol_ref>(args[0])->name(),
+                                  analyze(env, args[1])));
+            }
+            else if(is_a<lambda_form>(func))
+                return analyze_lambda(env, form);
+            else if(is_a<condition_case_form>(func))
+                return analyze_condition_case(env, args);
+            else if(is_a<unwind_protect_form>(func)) {
+                if(args.empty())
+                    return node_ptr_t();
+
+                return node_ptr_t(
+                    new unwind_protect_node(analyze(env, args[0]),
+                                            node_ptr_t(new progn_node(
+                                                           analyze_all(env, args.begin() + 1,
+                                                                       args.end())))));
+            }
+            else if(is_a<future_form>(func)) {
+                if(args.size() != 1)
+                    return node_ptr_t();
+
+                return node_ptr_t(new future_node(analyze(env, args[0])));
+            }
+            else if(is_a<spawn_form>(func)) {
+                if(args.size() != 1)
+                    return node_ptr_t();
+
+                return node_ptr_t(new spawn_node(analyze(env, args[0])));
+            }
+            else if(is_a<time_form>(func)) {
+                if(args.size() != 1)
+                    return node_ptr_t();
+
+                return node_ptr_t(new timing_node(node_ptr_t(), analyze(env, args[0])));
+            }
+            else if(is_a<benchmark_form>(func)) {
+                if(args.size() != 2)
+                    return node_ptr_t();
+
+                return node_ptr_t(new timing_node(analyze(env, args[0]),
+                                                  analyze(env, args[1])));
+            }
+
+            return node_ptr_t();
+        }
+
+        node_ptr_t analyze_form(environment* env, const cons_cell_ptr_t& form)
+        {
+            // Work on a copy of the form, so that the analysis attached
+            // to a top-level form doesn't refer to the form itself.
+            cons_cell_ptr_t call_form(new cons_cell(form->car(), form->cdr()));
+            node_ptr_t fallback(new form_call_node(call_form));
+
+            form_list_t args;
+
+            if(!collect(form->cdr(), args))
+                return fallback;
+
+            object_ptr_t head = form->car();
+
+            if(head->is_symbol_ref()) {
+                const std::string& name =
+                    boost::dynamic_pointer_cast<symbol_ref>(head)->name();
+                object_ptr_t func = function_of(env, name);
+
+                if(func) {
+                    node_ptr_t special = analyze_special_form(env, func, form, args);
+
+                    if(special)
+                        return special;
+
+                    // Forms like defun get the unevaluated call form anyway.
+                    if(!func->is_applicable())
+                        return fallback;
+                }
+
+                return node_ptr_t(new symbol_call_node(name,
+                                                       analyze_all(env, args.begin(),
+                                                                   args.end()),
+                                                       call_form));
+            }
+            else if(head->is_cons_cell()) {
+                cons_cell_ptr_t head_cell = boost::dynamic_pointer_cast<cons_cell>(head);
+
+                if(head_cell->car()->is_symbol_ref() &&
+                   is_a<lambda_form>(function_of(env,
+                                                 boost::dynamic_pointer_cast<symbol_ref>(
+                                                     head_cell->car())->name()))) {
+                    node_ptr_t lambda = analyze_lambda(env, head_cell);
+
+                    if(lambda)
+                        return node_ptr_t(new lambda_call_node(lambda,
+                                                               analyze_all(env, args.begin(),
+                                                                           args.end()),
+                                                               call_form));
+                }
+            }
+
+            return fallback;
+        }
+    }  // Anonymous namespace
+
+    node_ptr_t analyze(environment* env, object_ptr_t form)
+    {
+        if(form->is_cons_cell())
+            return analyze_form(env, boost::dynamic_pointer_cast<cons_cell>(form));
+        else if(form->is_symbol_ref()) {
+            symbol_ref_ptr_t ref = boost::dynamic_pointer_cast<symbol_ref>(form);
+
+            if(ref->is_keyword())
+                return node_ptr_t(new constant_node(form));
+
+            return node_ptr_t(new variable_node(ref->name()));
+        }
+        else if(is_a<quote>(form))
+            return node_ptr_t(new constant_node(
+                                  boost::dynamic_pointer_cast<quote>(form)->quoted()));
+        else if(form->is_number() || is_a<string>(form) ||
+                form == nil() || form == t())
+            return node_ptr_t(new constant_node(form));
+
+        return node_ptr_t(new object_node(form));
+    }
+
+    node_ptr_t analyze_body(environment* env, cons_cell_ptr_t body)
+    {
+        node_list_t nodes;
+
+        while(body) {
+            nodes.push_back(analyze(env, body->car()));
+            body = list_next(body, "body: listp");
+        }
+
+        return node_ptr_t(new progn_node(nodes));
+    }
+
+    object_ptr_t analyze_toplevel(environment* env, object_ptr_t form)
+    {
+        if(form->is_cons_cell()) {
+            cons_cell_ptr_t cell = boost::dynamic_pointer_cast<cons_cell>(form);
+
+            cell->set_analyzed(analyze(env, form));
+        }
+
+        return form;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef LISP_ANALYZER_HPP
+#define LISP_ANALYZER_HPP
+
+#include "lisp.hpp"
+
+
+namespace lisp {
+    /**
+       @brief A call of a lisp function in tail position that is
+       still to be done by the caller.
+
+       @see node::eval_tail().
+    */
+    struct tail_call
+    {
+        // The lisp function to call.
+        object_ptr_t callee;
+
+        // The evaluated arguments.
+        arg_buffer args;
+    };
+
+    /**
+       @brief A form that was analyzed once and can be evaluated
+       repeatedly without inspecting the cons tree again.
+
+       Special forms are recognized during the analysis, so
+       evaluating a node doesn't look up `if', `and', ... through
+       the function cells.
+    */
+    class node
+    {
+    public:
+        virtual ~node()
+            {
+            }
+
+        /**
+           @brief Evaluates the analyzed form in the given environment.
+        */
+        virtual object_ptr_t eval(environment* env) = 0;
+
+        /**
+           @brief Evaluates the node in tail position of a function
+           body.
+
+           A call of a lisp function isn't done but stored in
+           @a tail, a null pointer is returned in that case. The
+           calling function runs it without growing the C++ stack.
+        */
+        virtual object_ptr_t eval_tail(environment* env, tail_call&)
+            {
+                return eval(env);
+            }
+    };
+
+    /**
+       @brief Converts a compiled form into a tree of nodes.
+
+       Forms whose head isn't known to be a special form are
+       analyzed into call nodes. Those decide at runtime whether the
+       called object takes evaluated arguments (see
+       object::is_applicable()) or receives the call form.
+
+       @param env The environment whose function cells identify the
+       special forms.
+       @param form The compiled form.
+    */
+    node_ptr_t analyze(environment* env, object_ptr_t form);
+
+    /**
+       @brief Analyzes a list of forms which are evaluated in order
+       and returns the value of the last one (or nil if @a body is
+       empty).
+    */
+    node_ptr_t analyze_body(environment* env, cons_cell_ptr_t body);
+
+    /**
+       @brief Analyzes a top-level form and attaches the result to
+       it, so that environment::eval() uses the analyzed form.
+
+       @return The given form.
+    */
+    object_ptr_t analyze_toplevel(environment* env, object_ptr_t form);
+}
+
+#endif  // LISP_ANALYZER_HPP
@@ -0,0 +1,176 @@
+#include "atom.hpp"
+
+#include <cassert>
+
+#include "equality.hpp"
+
+
+namespace lisp {
+    namespace {
+        // The pointer takes the lower 48 bits of a word, the pins
+        // the upper 16.
+        const int pin_shift = 48;
+        const std::uint64_t one_pin = std::uint64_t(1) << pin_shift;
+        const std::uint64_t pointer_mask = one_pin - 1;
+    }
+
+    atom::atom(const object_ptr_t& value)
+        : m_current(pack(new box(value))),
+          m_retries(0)
+    {
+    }
+
+    atom::~atom()
+    {
+        delete box_of(m_current.load(std::memory_order_relaxed));
+    }
+
+    object_ptr_t atom::deref() const
+    {
+        box* current = acquire();
+        object_ptr_t value = current->value;
+
+        release(current);
+
+        return value;
+    }
+
+    void atom::reset(const object_ptr_t& value)
+    {
+        retire(m_current.exchange(pack(new box(value)), std::memory_order_acq_rel));
+    }
+
+    object_ptr_t atom::swap(const update_t& update)
+    {
+        box* replacement = 0;
+
+        for(;;) {
+            box* current = acquire();
+
+            object_ptr_t value;
+
+            try {
+                value = update(current->value);
+            }
+            catch(...) {
+                release(current);
+                delete replacement;
+                throw;
+            }
+
+            if(replacement)
+                replacement->value = value;
+            else
+                replacement = new box(value);
+
+            // Once installed the replacement belongs to the atom.
+            bool done = exchange(current, replacement);
+
+            release(current);
+
+            if(done)
+                return value;
+
+            m_retries.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool atom::compare_and_set(const object_ptr_t& expected, const object_ptr_t& desired)
+    {
+        box* replacement = new box(desired);
+
+        for(;;) {
+            box* current = acquire();
+
+            if(!eql(current->value, expected)) {
+                release(current);
+                delete replacement;
+
+                return false;
+            }
+
+            bool done = exchange(current, replacement);
+
+            release(current);
+
+            if(done)
+                return true;
+
+            m_retries.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    std::string atom::str() const
+    {
+        return "#<atom " + deref()->str() + ">";
+    }
+
+    atom::word_t atom::pack(box* b)
+    {
+        word_t w = reinterpret_cast<std::uintptr_t>(b);
+
+        assert((w & ~pointer_mask) == 0);
+
+        return w;
+    }
+
+    atom::box* atom::box_of(word_t w)
+    {
+        return reinterpret_cast<box*>(static_cast<std::uintptr_t>(w & pointer_mask));
+    }
+
+    atom::box* atom::acquire() const
+    {
+        word_t current = m_current.load(std::memory_order_relaxed);
+
+        while(!m_current.compare_exchange_weak(current, current + one_pin,
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed))
+            ;
+
+        return box_of(current);
+    }
+
+    void atom::release(box* b) const
+    {
+        word_t current = m_current.load(std::memory_order_relaxed);
+
+        // A pinned box can't be deleted, so finding it still
+        // installed means the pin is still counted in the word.
+        while(box_of(current) == b) {
+            if(m_current.compare_exchange_weak(current, current - one_pin,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed))
+                return;
+        }
+
+        // The pin was handed over to the box by retire().
+        if(b->released.fetch_add(1, std::memory_order_acq_rel) == -1)
+            delete b;
+    }
+
+    bool atom::exchange(box* current, box* replacement)
+    {
+        word_t w = m_current.load(std::memory_order_relaxed);
+
+        while(box_of(w) == current) {
+            if(m_current.compare_exchange_weak(w, pack(replacement),
+                                               std::memory_order_acq_rel,
+                                               std::memory_order_relaxed)) {
+                retire(w);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void atom::retire(word_t replaced)
+    {
+        box* b = box_of(replaced);
+        const long pins = static_cast<long>(replaced >> pin_shift);
+
+        if(b->released.fetch_sub(pins, std::memory_order_acq_rel) == pins)
+            delete b;
+    }
+}
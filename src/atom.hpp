@@ -0,0 +1,114 @@
+#ifndef LISP_ATOM_HPP
+#define LISP_ATOM_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+#include "object.hpp"
+
+
+namespace lisp {
+    /**
+       @brief A reference to a value that threads replace atomically,
+       see (make-atom VALUE).
+
+       The value lives in a box the atom points to. Every update
+       installs a new box with a compare-and-swap of that pointer,
+       so updates never block each other; a swap() that lost the
+       race to another update is retried with the new value.
+
+       Readers pin the box while they copy the value out: the
+       pointer word holds the number of pinning readers in its upper
+       16 bits, and a replaced box is deleted by whoever releases
+       the last pin (split reference counting). Neither reading nor
+       updating takes a lock.
+
+       The values themselves aren't copied, they should be treated
+       as immutable once stored.
+    */
+    class atom : public object
+    {
+    public:
+        typedef std::function<object_ptr_t(const object_ptr_t& value)> update_t;
+
+        explicit atom(const object_ptr_t& value);
+        ~atom();
+
+        object_ptr_t deref() const;
+
+        void reset(const object_ptr_t& value);
+
+        /**
+           @brief Replaces the value by @a update applied to it.
+           @a update is called again if another thread changed the
+           value meanwhile.
+
+           @return The new value.
+        */
+        object_ptr_t swap(const update_t& update);
+
+        /**
+           @brief Replaces the value by @a desired if it is eql() to
+           @a expected.
+        */
+        bool compare_and_set(const object_ptr_t& expected, const object_ptr_t& desired);
+
+        /**
+           @brief The number of updates that had to be retried
+           because another thread got in between.
+        */
+        std::size_t retries() const
+            {
+                return m_retries.load(std::memory_order_relaxed);
+            }
+
+        std::string str() const;
+
+    private:
+        struct box
+        {
+            explicit box(const object_ptr_t& value)
+                : value(value),
+                  released(0)
+                {
+                }
+
+            object_ptr_t value;
+            // Pins released after the box was replaced, minus the
+            // pins it had then.
+            std::atomic<long> released;
+        };
+
+        typedef std::uint64_t word_t;
+
+        static word_t pack(box* b);
+        static box* box_of(word_t w);
+
+        /**
+           @brief Pins the current box.
+        */
+        box* acquire() const;
+
+        void release(box* b) const;
+
+        /**
+           @brief Installs @a replacement if @a current is still the
+           current box.
+        */
+        bool exchange(box* current, box* replacement);
+
+        /**
+           @brief Hands the pins of a replaced box over to its
+           readers.
+        */
+        static void retire(word_t replaced);
+
+        mutable std::atomic<word_t> m_current;
+        std::atomic<std::size_t> m_retries;
+    };
+
+    typedef boost::shared_ptr<atom> atom_ptr_t;
+}
+
+#endif  // LISP_ATOM_HPP
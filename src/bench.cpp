@@ -0,0 +1,660 @@
+/*
+  Usage: ./lisp-bench [<benchmark> ...]
+
+  Runs the named benchmarks or all of them if none is given and
+  prints the time per iteration.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <mutex>
+
+#include "lisp.hpp"
+#include "interpreter.hpp"
+#include "analyzer.hpp"
+#include "hash_table.hpp"
+#include "typed_array.hpp"
+#include "runtime.hpp"
+#include "actor.hpp"
+#include "atom.hpp"
+#include "profiler.hpp"
+
+
+namespace {
+    typedef std::vector<lisp::object_ptr_t> form_list_t;
+
+    /*
+      Compiles all top-level forms of `script'.
+    */
+    form_list_t compile(std::string script)
+    {
+        std::string::iterator iter = script.begin();
+        lisp::tokenizer<std::string::iterator> tok(iter, script.end());
+
+        form_list_t forms;
+
+        while(tok.next_token())
+            forms.push_back(lisp::interpreter::compile_expr(lisp::global_env(), tok));
+
+        return forms;
+    }
+
+    /*
+      Analyzes and evaluates all forms of `script' in the global
+      environment.
+    */
+    void load(const std::string& script)
+    {
+        form_list_t forms = compile(script);
+
+        for(size_t i = 0; i < forms.size(); ++i)
+            lisp::global_env()->eval(lisp::analyze_toplevel(lisp::global_env(),
+                                                            forms[i]));
+    }
+
+    /*
+      Runs `body' `iterations' times after a warm-up run and prints
+      the time per iteration.
+    */
+    template <typename F>
+    void measure(const std::string& name, long iterations, F body)
+    {
+        body();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for(long i = 0; i < iterations; ++i)
+            body();
+
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << name << ": "
+                  << elapsed.count() / iterations << " ns/iteration" << std::endl;
+    }
+
+    /*
+      Calls of lambda expressions whose printed form grows, through
+      the unanalyzed funcall path. The time per call should not
+      depend on the size.
+    */
+    void bench_call_overhead()
+    {
+        const int sizes[] = { 1, 10, 100, 1000 };
+
+        for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            std::string script = "((lambda (x) '(";
+
+            for(int j = 0; j < sizes[i]; ++j)
+                script += lisp::to_string(j) + " ";
+
+            script += ")) 1)";
+
+            lisp::object_ptr_t form = compile(script)[0];
+
+            measure("call-overhead/" + lisp::to_string(sizes[i]), 20000,
+                    [&form]() { lisp::global_env()->eval(form); });
+        }
+    }
+
+    /*
+      Cost of condition-case: a plain call, the same call guarded by
+      a handler that never runs and a call whose error is caught.
+    */
+    void bench_conditions()
+    {
+        load("(defun bench-plain () 'ok)"
+             "(defun bench-guarded () (condition-case nil (bench-plain) (error 'caught)))"
+             "(defun bench-caught () (condition-case nil (signal 'bench-error nil)"
+             "                         (bench-error 'caught)))");
+
+        const char* names[] = { "bench-plain", "bench-guarded", "bench-caught" };
+
+        for(size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+            lisp::object_ptr_t form = lisp::analyze_toplevel(
+                lisp::global_env(), compile(std::string("(") + names[i] + ")")[0]);
+
+            measure(std::string("conditions/") + names[i], 100000,
+                    [&form]() { lisp::global_env()->eval(form); });
+        }
+    }
+
+    /*
+      N-ary arithmetic on fixnums and on mixed number types.
+    */
+    void bench_arith()
+    {
+        const char* forms[] = {
+            "(+ 1 2 3 4 5 6 7 8)",
+            "(* 1 2 3 4 5 6 7 8)",
+            "(+ 1 1/2 1/3 1/4 0.5 6 7 8)"
+        };
+
+        for(size_t i = 0; i < sizeof(forms) / sizeof(forms[0]); ++i) {
+            lisp::object_ptr_t form = lisp::analyze_toplevel(lisp::global_env(),
+                                                             compile(forms[i])[0]);
+
+            measure(std::string("arith/") + forms[i], 100000,
+                    [&form]() { lisp::global_env()->eval(form); });
+        }
+    }
+
+    /*
+      Lookups in a table of 100000 string keys.
+    */
+    void bench_hash_table()
+    {
+        load("(setq bench-table (make-hash-table :test 'equal))");
+
+        lisp::hash_table& table = dynamic_cast<lisp::hash_table&>(
+            *lisp::global_env()->get_symbol("bench-table")->value());
+
+        for(int i = 0; i < 100000; ++i)
+            table.put(lisp::object_ptr_t(new lisp::string("key-" + lisp::to_string(i))),
+                      lisp::object_ptr_t(new lisp::number(static_cast<long long>(i))));
+
+        lisp::object_ptr_t form = lisp::analyze_toplevel(
+            lisp::global_env(), compile("(gethash \"key-4711\" bench-table)")[0]);
+
+        measure("hash-table/gethash", 100000,
+                [&form]() { lisp::global_env()->eval(form); });
+    }
+
+    /*
+      Sum of a million numbers: boxed through (apply '+ ...) and
+      unboxed with array-sum, using the AVX2 and the scalar kernel.
+    */
+    void bench_typed_arrays()
+    {
+        lisp::object_ptr_t list = lisp::nil();
+        lisp::f64_array* array = new lisp::f64_array(1000000);
+
+        lisp::global_env()->get_symbol("bench-array")->set_value(lisp::object_ptr_t(array));
+
+        for(std::size_t i = 0; i < array->size(); ++i) {
+            array->data()[i] = static_cast<double>(i % 1000) / 8;
+            list.reset(new lisp::cons_cell(lisp::object_ptr_t(new lisp::number(array->data()[i])),
+                                           list));
+        }
+
+        lisp::global_env()->get_symbol("bench-list")->set_value(list);
+
+        lisp::object_ptr_t boxed = lisp::analyze_toplevel(
+            lisp::global_env(), compile("(apply '+ bench-list)")[0]);
+        lisp::object_ptr_t unboxed = lisp::analyze_toplevel(
+            lisp::global_env(), compile("(array-sum bench-array)")[0]);
+
+        measure("typed-arrays/apply-plus", 10,
+                [&boxed]() { lisp::global_env()->eval(boxed); });
+
+        lisp::simd::enable(false);
+        measure("typed-arrays/array-sum-scalar", 100,
+                [&unboxed]() { lisp::global_env()->eval(unboxed); });
+
+        lisp::simd::enable(true);
+        measure(std::string("typed-arrays/array-sum-") +
+                (lisp::simd::available() ? "avx2" : "scalar"), 100,
+                [&unboxed]() { lisp::global_env()->eval(unboxed); });
+    }
+
+    /*
+      The native list builtins against the same operations written
+      as lisp functions, on a list of 200 numbers.
+    */
+    void bench_lists()
+    {
+        load("(defun lisp-length (l) (if l (+ 1 (lisp-length (cdr l))) 0))"
+             "(defun lisp-nth (n l) (if (= n 0) (car l) (lisp-nth (- n 1) (cdr l))))"
+             "(defun lisp-reverse-onto (l acc)"
+             "  (if l (lisp-reverse-onto (cdr l) (cons (car l) acc)) acc))"
+             "(defun lisp-reverse (l) (lisp-reverse-onto l nil))"
+             "(defun lisp-append (a b) (if a (cons (car a) (lisp-append (cdr a) b)) b))"
+             "(defun lisp-mapcar (f l) (if l (cons (apply f (list (car l))) (lisp-mapcar f (cdr l)))))"
+             "(defun lisp-reduce-from (f acc l) (if l (lisp-reduce-from f (apply f (list acc (car l))) (cdr l)) acc))"
+             "(defun lisp-member (x l) (if l (if (equal x (car l)) l (lisp-member x (cdr l)))))"
+             "(defun lisp-assoc (k l) (if l (if (equal k (car (car l))) (car l) (lisp-assoc k (cdr l)))))"
+             "(defun bench-inc (x) (+ x 1))");
+
+        lisp::object_ptr_t list = lisp::nil();
+        lisp::object_ptr_t alist = lisp::nil();
+
+        for(long long i = 199; i >= 0; --i) {
+            lisp::object_ptr_t n(new lisp::number(i));
+
+            list.reset(new lisp::cons_cell(n, list));
+            alist.reset(new lisp::cons_cell(lisp::object_ptr_t(new lisp::cons_cell(n, n)), alist));
+        }
+
+        lisp::global_env()->get_symbol("bench-list")->set_value(list);
+        lisp::global_env()->get_symbol("bench-alist")->set_value(alist);
+
+        const char* forms[][2] = {
+            { "(length bench-list)", "(lisp-length bench-list)" },
+            { "(nth 199 bench-list)", "(lisp-nth 199 bench-list)" },
+            { "(reverse bench-list)", "(lisp-reverse bench-list)" },
+            { "(append bench-list bench-list)", "(lisp-append bench-list bench-list)" },
+            { "(mapcar 'bench-inc bench-list)", "(lisp-mapcar 'bench-inc bench-list)" },
+            { "(reduce '+ bench-list 0)", "(lisp-reduce-from '+ 0 bench-list)" },
+            { "(member 199 bench-list)", "(lisp-member 199 bench-list)" },
+            { "(assoc 199 bench-alist)", "(lisp-assoc 199 bench-alist)" }
+        };
+
+        for(size_t i = 0; i < sizeof(forms) / sizeof(forms[0]); ++i) {
+            for(size_t j = 0; j < 2; ++j) {
+                lisp::object_ptr_t form = lisp::analyze_toplevel(lisp::global_env(),
+                                                                 compile(forms[i][j])[0]);
+
+                measure(std::string("lists/") + forms[i][j], 1000,
+                        [&form]() { lisp::global_env()->eval(form); });
+            }
+        }
+    }
+
+    /*
+      Collecting 1000 numbers in order: by appending to a copied
+      list, by consing and a final nreverse and through a queue whose
+      last cell is extended with setcdr.
+    */
+    void bench_destructive_lists()
+    {
+        load("(defun collect-append (n acc)"
+             "  (if (= n 0) acc (collect-append (- n 1) (append acc (list n)))))"
+             "(defun collect-nreverse (n acc)"
+             "  (if (= n 0) (nreverse acc) (collect-nreverse (- n 1) (cons n acc))))"
+             "(defun collect-queue (n head tail)"
+             "  (if (= n 0) (cdr head) (collect-queue (- n 1) head (setcdr tail (list n)))))"
+             "(defun collect-queue-start (n head) (collect-queue n head head))");
+
+        const char* forms[] = {
+            "(collect-append 1000 nil)",
+            "(collect-nreverse 1000 nil)",
+            "(collect-queue-start 1000 (list nil))"
+        };
+
+        for(size_t i = 0; i < sizeof(forms) / sizeof(forms[0]); ++i) {
+            lisp::object_ptr_t form = lisp::analyze_toplevel(lisp::global_env(),
+                                                             compile(forms[i])[0]);
+
+            measure(std::string("destructive-lists/") + forms[i], 20,
+                    [&form]() { lisp::global_env()->eval(form); });
+        }
+    }
+
+    /*
+      Throughput of (fib 16) with one runtime per thread for 1, 2, 4,
+      ... threads up to the number of cores. Runtimes share nothing,
+      so the throughput should grow almost linearly.
+    */
+    void bench_runtime_scaling()
+    {
+        const long iterations = 20;
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        double single = 0;
+
+        for(unsigned count = 1; count <= cores; count *= 2) {
+            std::vector<std::thread> threads;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            for(unsigned i = 0; i < count; ++i)
+                threads.push_back(std::thread([]() {
+                            lisp::runtime rt;
+                            lisp::runtime::scope scope(rt);
+
+                            load("(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+
+                            lisp::object_ptr_t form = lisp::analyze_toplevel(
+                                lisp::global_env(), compile("(fib 16)")[0]);
+
+                            for(long j = 0; j < iterations; ++j)
+                                lisp::global_env()->eval(form);
+                        }));
+
+            for(unsigned i = 0; i < count; ++i)
+                threads[i].join();
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            double throughput = count * iterations / elapsed.count();
+
+            if(count == 1)
+                single = throughput;
+
+            std::cout << "runtime-scaling/" << count << "-threads: "
+                      << static_cast<long>(throughput) << " evaluations/s, speedup "
+                      << throughput / single << std::endl;
+        }
+    }
+
+    /*
+      A request in an isolated environment on top of 20000 library
+      definitions: in a copy-on-write fork of the global environment
+      and in a runtime that is rebuilt for the request.
+    */
+    void bench_environment_fork()
+    {
+        const int definitions = 20000;
+        std::string library;
+
+        for(int i = 0; i < definitions; ++i)
+            library += "(defun lib-" + lisp::to_string(i) + " (x) (+ x " +
+                lisp::to_string(i) + "))";
+
+        library += "(setq lib-counter 0)";
+
+        const std::string request = "(setq lib-counter (lib-42 lib-counter))"
+                                    "(defun request-fn () lib-counter)"
+                                    "(request-fn)";
+
+        load(library);
+
+        form_list_t forms = compile(request);
+
+        measure("environment-fork/fork", 10000,
+                [&forms]() {
+                    lisp::environment fork(lisp::global_env(), true);
+
+                    for(size_t i = 0; i < forms.size(); ++i)
+                        fork.eval(lisp::analyze_toplevel(&fork, forms[i]));
+                });
+
+        measure("environment-fork/rebuild", 1,
+                [&library, &request]() {
+                    lisp::runtime rt;
+                    lisp::runtime::scope scope(rt);
+
+                    load(library);
+                    load(request);
+                });
+    }
+
+    /*
+      Function lookups in a global environment with 1000 functions,
+      shared by 1, 2, 4, ... threads up to twice the number of
+      cores.
+    */
+    void bench_global_lookup()
+    {
+        const long lookups = 1000000;
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        lisp::runtime rt;
+        lisp::runtime::scope main_scope(rt);
+        std::vector<std::string> names;
+
+        for(int i = 0; i < 1000; ++i) {
+            names.push_back("global-fn-" + lisp::to_string(i));
+            load("(defun " + names.back() + " () nil)");
+        }
+
+        double single = 0;
+
+        for(unsigned count = 1; count <= 2 * cores; count *= 2) {
+            std::vector<std::thread> threads;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            for(unsigned i = 0; i < count; ++i)
+                threads.push_back(std::thread([&rt, &names]() {
+                            lisp::runtime::scope scope(rt);
+                            lisp::environment* env = lisp::global_env();
+
+                            for(long j = 0; j < lookups; ++j)
+                                env->get_function(names[j % names.size()]);
+                        }));
+
+            for(unsigned i = 0; i < count; ++i)
+                threads[i].join();
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            double throughput = count * lookups / elapsed.count();
+
+            if(count == 1)
+                single = throughput;
+
+            std::cout << "global-lookup/" << count << "-threads: "
+                      << static_cast<long>(throughput) << " lookups/s, speedup "
+                      << throughput / single << std::endl;
+        }
+    }
+
+    /*
+      pmapcar of (fib 15) over 64 elements with 1, 2, 4, ... pool
+      threads up to the number of cores.
+    */
+    void bench_parallel()
+    {
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        lisp::runtime rt;
+        lisp::runtime::scope scope(rt);
+
+        load("(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"
+             "(setq bench-input (make-vector 64 15))");
+
+        lisp::object_ptr_t form = lisp::analyze_toplevel(
+            lisp::global_env(), compile("(pmapcar 'fib bench-input)")[0]);
+
+        for(unsigned size = 1; size <= cores; size *= 2) {
+            rt.set_pool_size(size);
+
+            measure("parallel/pmapcar-" + lisp::to_string(size) + "-threads", 3,
+                    [&form]() { lisp::global_env()->eval(form); });
+        }
+    }
+
+    /*
+      Sixteen (fib 15) as futures awaited afterwards, with 1, 2, 4,
+      ... pool threads, and the cost of (await (future 1)).
+    */
+    void bench_futures()
+    {
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        lisp::runtime rt;
+        lisp::runtime::scope scope(rt);
+
+        load("(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"
+             "(setq bench-input (make-vector 16 15))");
+
+        lisp::object_ptr_t fan_out = lisp::analyze_toplevel(
+            lisp::global_env(),
+            compile("(mapcar 'await (mapcar (lambda (n) (future (fib n))) bench-input))")[0]);
+        lisp::object_ptr_t round_trip = lisp::analyze_toplevel(
+            lisp::global_env(), compile("(await (future 1))")[0]);
+
+        for(unsigned size = 1; size <= cores; size *= 2) {
+            rt.set_pool_size(size);
+
+            measure("futures/fan-out-" + lisp::to_string(size) + "-threads", 3,
+                    [&fan_out]() { lisp::global_env()->eval(fan_out); });
+        }
+
+        measure("futures/round-trip", 100000,
+                [&round_trip]() { lisp::global_env()->eval(round_trip); });
+    }
+
+    /*
+      64 actors computing (fib 15) with 1, 2, 4, ... scheduler
+      threads, 1000 round trips between two actors and a message
+      of 100 numbers copied.
+    */
+    void bench_actors()
+    {
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        const std::string definitions =
+            "(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"
+            "(defun echo (msg)"
+            "  (if (eq msg 'stop) nil (send (car msg) (cdr msg)) (echo (receive))))"
+            "(defun ping (partner n)"
+            "  (if (= n 0) (send partner 'stop)"
+            "    (send partner (cons (self) (- n 1)))"
+            "    (ping partner (receive))))"
+            "(setq bench-input (append (make-vector 64 15)))";
+
+        for(unsigned size = 1; size <= cores; size *= 2) {
+            // The scheduler keeps the pool size it started with.
+            lisp::runtime rt;
+            lisp::runtime::scope scope(rt);
+
+            rt.set_pool_size(size);
+            load(definitions);
+
+            lisp::object_ptr_t form = lisp::analyze_toplevel(
+                lisp::global_env(),
+                compile("(mapcar 'await (mapcar (lambda (n) (spawn (fib n))) bench-input))")[0]);
+
+            measure("actors/fan-out-" + lisp::to_string(size) + "-threads", 3,
+                    [&form]() { lisp::global_env()->eval(form); });
+        }
+
+        lisp::runtime rt;
+        lisp::runtime::scope scope(rt);
+
+        load(definitions);
+
+        lisp::object_ptr_t ping_pong = lisp::analyze_toplevel(
+            lisp::global_env(),
+            compile("(await (spawn (ping (spawn (echo (receive))) 1000)))")[0]);
+
+        measure("actors/ping-pong-1000", 10,
+                [&ping_pong]() { lisp::global_env()->eval(ping_pong); });
+
+        lisp::object_ptr_t message = lisp::global_env()->eval(
+            compile("(append (make-vector 100 1.5))")[0]);
+
+        measure("actors/copy-message-100", 10000,
+                [&message]() { lisp::copy_message(message); });
+    }
+
+    /*
+      The mutex-based counterpart of lisp::atom for bench_atoms().
+    */
+    class locked_ref
+    {
+    public:
+        explicit locked_ref(const lisp::object_ptr_t& value)
+            : m_value(value)
+            {
+            }
+
+        template <typename F>
+        void swap(F update)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                m_value = update(m_value);
+            }
+
+    private:
+        std::mutex m_mutex;
+        lisp::object_ptr_t m_value;
+    };
+
+    lisp::object_ptr_t increment(const lisp::object_ptr_t& value)
+    {
+        return lisp::object_ptr_t(new lisp::number(static_cast<lisp::number&>(*value) +
+                                                   lisp::number(1ll)));
+    }
+
+    /*
+      Runs `total' increments of `ref' spread over `threads' threads.
+    */
+    template <typename Ref>
+    void contend(Ref& ref, unsigned threads, long total)
+    {
+        std::vector<std::thread> workers;
+
+        for(unsigned i = 0; i < threads; ++i)
+            workers.push_back(std::thread([&ref, threads, total]() {
+                        for(long j = 0; j < total / threads; ++j)
+                            ref.swap(increment);
+                    }));
+
+        for(unsigned i = 0; i < threads; ++i)
+            workers[i].join();
+    }
+
+    /*
+      100000 contended increments of an atom and of a mutex
+      protected reference on 1, 2, 4, ... threads, at least up to
+      4 threads even on fewer cores.
+    */
+    void bench_atoms()
+    {
+        const unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+        const long total = 100000;
+
+        for(unsigned threads = 1; threads <= max_threads; threads *= 2) {
+            lisp::atom counter(lisp::object_ptr_t(new lisp::number(0ll)));
+            locked_ref locked(lisp::object_ptr_t(new lisp::number(0ll)));
+
+            measure("atoms/atom-" + lisp::to_string(threads) + "-threads", 3,
+                    [&counter, threads, total]() { contend(counter, threads, total); });
+
+            // measure() ran the increments four times.
+            std::cout << "atoms/atom-" << threads << "-threads: "
+                      << counter.retries() / 4 << " retries/iteration" << std::endl;
+
+            measure("atoms/mutex-" + lisp::to_string(threads) + "-threads", 3,
+                    [&locked, threads, total]() { contend(locked, threads, total); });
+        }
+    }
+
+    /*
+      Cost of the profiler's call stack: fib of 15 (1973 calls) with
+      the profiler off and while it samples.
+    */
+    void bench_profiler()
+    {
+        load("(defun bench-fib (n) (if (< n 2) n (+ (bench-fib (- n 1)) (bench-fib (- n 2)))))");
+
+        lisp::object_ptr_t form = lisp::analyze_toplevel(lisp::global_env(),
+                                                         compile("(bench-fib 15)")[0]);
+
+        measure("profiler/off", 200, [&form]() { lisp::global_env()->eval(form); });
+
+        lisp::profiler::start();
+        measure("profiler/sampling", 200, [&form]() { lisp::global_env()->eval(form); });
+        lisp::profiler::stop();
+    }
+
+    struct benchmark
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    const benchmark benchmarks[] = {
+        { "call-overhead", bench_call_overhead },
+        { "conditions", bench_conditions },
+        { "arith", bench_arith },
+        { "hash-table", bench_hash_table },
+        { "typed-arrays", bench_typed_arrays },
+        { "lists", bench_lists },
+        { "destructive-lists", bench_destructive_lists },
+        { "runtime-scaling", bench_runtime_scaling },
+        { "environment-fork", bench_environment_fork },
+        { "global-lookup", bench_global_lookup },
+        { "parallel", bench_parallel },
+        { "futures", bench_futures },
+        { "actors", bench_actors },
+        { "atoms", bench_atoms },
+        { "profiler", bench_profiler }
+    };
+}
+
+int main(int argc, char** argv)
+{
+    for(size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+        bool selected = argc == 1;
+
+        for(int j = 1; j < argc; ++j)
+            selected = selected || std::strcmp(argv[j], benchmarks[i].name) == 0;
+
+        if(selected)
+            benchmarks[i].run();
+    }
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "channel.hpp"
+
+#include <algorithm>
+
+
+namespace lisp {
+    namespace {
+        /**
+           @brief The waiter of a thread that isn't running an
+           actor.
+        */
+        class thread_waiter : public waiter
+        {
+        public:
+            void block(std::unique_lock<std::mutex>& lock)
+                {
+                    m_wakeup.wait(lock);
+                }
+
+            void wake()
+                {
+                    m_wakeup.notify_one();
+                }
+
+        private:
+            std::condition_variable m_wakeup;
+        };
+
+        thread_local waiter* current_waiter = 0;
+    }
+
+    waiter::scope::scope(waiter& w)
+        : m_previous(current_waiter)
+    {
+        current_waiter = &w;
+    }
+
+    waiter::scope::~scope()
+    {
+        current_waiter = m_previous;
+    }
+
+    waiter& waiter::current()
+    {
+        if(current_waiter)
+            return *current_waiter;
+
+        thread_local thread_waiter own;
+
+        return own;
+    }
+
+    void wait_list::wake_one()
+    {
+        if(m_waiters.empty())
+            return;
+
+        waiter* w = m_waiters.front();
+
+        m_waiters.erase(m_waiters.begin());
+        w->wake();
+    }
+
+    void wait_list::wake_all()
+    {
+        std::vector<waiter*> woken;
+
+        woken.swap(m_waiters);
+
+        for(std::size_t i = 0; i < woken.size(); ++i)
+            woken[i]->wake();
+    }
+
+    void wait_list::remove(waiter& w)
+    {
+        m_waiters.erase(std::remove(m_waiters.begin(), m_waiters.end(), &w),
+                        m_waiters.end());
+    }
+
+    channel::channel(std::size_t capacity)
+        : m_capacity(std::max<std::size_t>(capacity, 1))
+    {
+    }
+
+    void channel::push(const object_ptr_t& message)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        m_senders.wait(lock, [this]() { return m_messages.size() < m_capacity; });
+        m_messages.push_back(message);
+        m_receiver.wake_one();
+    }
+
+    object_ptr_t channel::pop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        m_receiver.wait(lock, [this]() { return !m_messages.empty(); });
+
+        object_ptr_t message = m_messages.front();
+
+        m_messages.pop_front();
+        m_senders.wake_one();
+
+        return message;
+    }
+
+    std::size_t channel::size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        return m_messages.size();
+    }
+}
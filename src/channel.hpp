@@ -0,0 +1,145 @@
+#ifndef LISP_CHANNEL_HPP
+#define LISP_CHANNEL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "object.hpp"
+
+
+namespace lisp {
+    /**
+       @brief Something that can block until another thread wakes
+       it: the fiber of an actor (see actor) or an OS thread.
+
+       A blocked actor gives its scheduler thread to other actors,
+       a blocked thread sleeps.
+    */
+    class waiter : private boost::noncopyable
+    {
+    public:
+        /**
+           @brief Makes a waiter the current one of the calling
+           thread while the scope exists. Used by the scheduler
+           while it runs an actor.
+        */
+        class scope : private boost::noncopyable
+        {
+        public:
+            explicit scope(waiter& w);
+            ~scope();
+
+        private:
+            waiter* m_previous;
+        };
+
+        virtual ~waiter()
+            {
+            }
+
+        /**
+           @brief Returns the waiter of the running actor or the one
+           of the calling thread.
+        */
+        static waiter& current();
+
+        /**
+           @brief Blocks until wake() is called, with @a lock
+           released meanwhile. May return spuriously.
+
+           wake() must be called with the mutex of @a lock held, so
+           that a wakeup between checking the condition and
+           blocking isn't lost.
+        */
+        virtual void block(std::unique_lock<std::mutex>& lock) = 0;
+
+        virtual void wake() = 0;
+    };
+
+    /**
+       @brief The waiters blocked on a condition protected by a
+       mutex.
+    */
+    class wait_list : private boost::noncopyable
+    {
+    public:
+        /**
+           @brief Blocks the current waiter until @a ready returns
+           true. @a lock must hold the mutex protecting the
+           condition.
+        */
+        template <typename Predicate>
+        void wait(std::unique_lock<std::mutex>& lock, Predicate ready)
+            {
+                waiter& self = waiter::current();
+
+                while(!ready()) {
+                    m_waiters.push_back(&self);
+
+                    try {
+                        self.block(lock);
+                    }
+                    catch(...) {
+                        // An actor unwound by its scheduler.
+                        remove(self);
+                        throw;
+                    }
+
+                    // Returned spuriously if it is still listed.
+                    remove(self);
+                }
+            }
+
+        void wake_one();
+
+        void wake_all();
+
+    private:
+        void remove(waiter& w);
+
+        std::vector<waiter*> m_waiters;
+    };
+
+    /**
+       @brief Bounded queue of messages with any number of senders
+       and a single receiver, the mailbox of an actor.
+    */
+    class channel : private boost::noncopyable
+    {
+    public:
+        explicit channel(std::size_t capacity);
+
+        std::size_t capacity() const
+            {
+                return m_capacity;
+            }
+
+        /**
+           @brief Appends @a message, blocks while the channel is
+           full.
+        */
+        void push(const object_ptr_t& message);
+
+        /**
+           @brief Removes the oldest message, blocks while the
+           channel is empty.
+        */
+        object_ptr_t pop();
+
+        std::size_t size() const;
+
+    private:
+        mutable std::mutex m_mutex;
+        std::deque<object_ptr_t> m_messages;
+        std::size_t m_capacity;
+
+        wait_list m_receiver;
+        wait_list m_senders;
+    };
+}
+
+#endif  // LISP_CHANNEL_HPP
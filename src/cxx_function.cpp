@@ -3,27 +3,27 @@
 
 #include "lisp.hpp"
 #include "utils.hpp"
+#include "profiler.hpp"
 
 namespace lisp {
     object_ptr_t cxx_function::operator()(environment* env,
                                           const cons_cell_ptr_t args)
     {
         assert(args);
-        object_ptr_t func = args->car();
-        std::string errmsg = func->str() + ": listp";
 
-        //in cxx_function.hpp:
-        //typedef std::vector<object_ptr_t> argv_t;
-        argv_t vargs;
+        arg_buffer vargs;
 
-        cons_cell_ptr_t _args = list_next(args, errmsg);
+        error_context context(args->car(), ": listp");
+        cons_cell_ptr_t _args = list_next(args, context);
 
         while(_args) {
             vargs.push_back(env->eval(_args->car()));
 
-            _args = list_next(_args, errmsg);
+            _args = list_next(_args, context);
         }
 
+        profiler::frame profiled(this);
+
         return (*this)(env, vargs);
     }
 }
@@ -2,12 +2,31 @@
 #define LISP_CXX_FUNCTION_HPP
 
 #include "object.hpp"
+#include "profiler.hpp"
 
 namespace lisp {
     class cxx_function : public object
     {
+    public:
+        bool is_applicable() const
+            {
+                return true;
+            }
+
+        object_ptr_t apply(environment* env, const argv_t& args)
+            {
+                profiler::frame profiled(this);
+
+                return (*this)(env, args);
+            }
+
     protected:
-        typedef std::vector<object_ptr_t> argv_t;
+        typedef lisp::argv_t argv_t;
+
+        /**
+           @brief Evaluates the arguments of the call form into a
+           buffer on the stack and passes them to the builtin.
+        */
         object_ptr_t operator()(environment* env,
                                 const cons_cell_ptr_t args = cons_cell_ptr_t());
 
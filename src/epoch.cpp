@@ -0,0 +1,145 @@
+#include "epoch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+
+namespace lisp {
+    namespace epoch {
+        namespace {
+            // Starts at 1, readers outside a guard announce 0.
+            std::atomic<std::uint64_t> global_epoch(1);
+
+            struct thread_slot;
+
+            // Guards registered.
+            std::mutex registry_mutex;
+            std::vector<thread_slot*> registered;
+
+            /**
+               @brief The epoch a thread announced when its outermost
+               read_guard started, 0 outside of guards.
+            */
+            struct thread_slot
+            {
+                thread_slot()
+                    : epoch(0),
+                      depth(0)
+                    {
+                        std::lock_guard<std::mutex> lock(registry_mutex);
+
+                        registered.push_back(this);
+                    }
+
+                ~thread_slot()
+                    {
+                        std::lock_guard<std::mutex> lock(registry_mutex);
+
+                        registered.erase(std::find(registered.begin(), registered.end(), this));
+                    }
+
+                std::atomic<std::uint64_t> epoch;
+                std::size_t depth;
+            };
+
+            thread_local thread_slot own;
+
+            /**
+               @brief The oldest epoch announced by a reader, the
+               maximum if there is none.
+            */
+            std::uint64_t oldest_reader()
+            {
+                std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+                std::lock_guard<std::mutex> lock(registry_mutex);
+
+                for(std::size_t i = 0; i < registered.size(); ++i) {
+                    const std::uint64_t epoch = registered[i]->epoch.load();
+
+                    if(epoch != 0)
+                        oldest = std::min(oldest, epoch);
+                }
+
+                return oldest;
+            }
+        }
+
+        read_guard::read_guard()
+        {
+            // A stale epoch only delays the destruction. The store
+            // must be seen before the pointer is loaded.
+            if(own.depth++ == 0)
+                own.epoch.store(global_epoch.load());
+        }
+
+        read_guard::~read_guard()
+        {
+            if(--own.depth == 0)
+                own.epoch.store(0, std::memory_order_release);
+        }
+
+        retired_list::retired_list()
+        {
+        }
+
+        retired_list::~retired_list()
+        {
+            clear();
+        }
+
+        void retired_list::retire(const std::function<void()>& destroy)
+        {
+            // Readers that announced this epoch or an older one may
+            // have loaded the object before it was replaced.
+            entry retired = { global_epoch.fetch_add(1), destroy };
+            const std::uint64_t oldest = oldest_reader();
+            std::vector<entry> unreachable;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                m_entries.push_back(retired);
+
+                std::vector<entry>::iterator kept =
+                    std::stable_partition(m_entries.begin(), m_entries.end(),
+                                          [oldest](const entry& e) { return e.epoch >= oldest; });
+
+                unreachable.assign(kept, m_entries.end());
+                m_entries.erase(kept, m_entries.end());
+            }
+
+            // Outside of the lock, destroying may retire further
+            // objects.
+            for(std::size_t i = 0; i < unreachable.size(); ++i)
+                unreachable[i].destroy();
+        }
+
+        void retired_list::clear()
+        {
+            // Until destroying retires nothing new.
+            for(;;) {
+                std::vector<entry> entries;
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+
+                    entries.swap(m_entries);
+                }
+
+                if(entries.empty())
+                    return;
+
+                for(std::size_t i = 0; i < entries.size(); ++i)
+                    entries[i].destroy();
+            }
+        }
+
+        std::size_t retired_list::size() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            return m_entries.size();
+        }
+    }
+}
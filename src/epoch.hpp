@@ -0,0 +1,82 @@
+#ifndef LISP_EPOCH_HPP
+#define LISP_EPOCH_HPP
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+
+namespace lisp {
+    /**
+       @brief Epoch-based reclamation of objects that other threads
+       may still read after they were replaced.
+
+       A reader holds a read_guard while it loads the pointer to a
+       shared object and copies what it needs from it. A writer
+       publishes the replacement first and then hands the old object
+       to a retired_list. The list destroys it once every read_guard
+       that was active at that moment has ended.
+
+       Pointers must be published and loaded with sequentially
+       consistent atomics, so that a reader that got the old object
+       is seen by the writer.
+    */
+    namespace epoch {
+        /**
+           @brief Marks the calling thread as reading retired objects.
+           Guards may be nested.
+        */
+        class read_guard : private boost::noncopyable
+        {
+        public:
+            read_guard();
+            ~read_guard();
+        };
+
+        class retired_list : private boost::noncopyable
+        {
+        public:
+            retired_list();
+
+            /**
+               @brief Destroys the objects that are left. No thread
+               may read them anymore.
+            */
+            ~retired_list();
+
+            /**
+               @brief Calls @a destroy once no thread can read the
+               retired object anymore. Destroys the objects retired
+               before that no thread can read anymore as well.
+            */
+            void retire(const std::function<void()>& destroy);
+
+            /**
+               @brief Destroys all objects. No thread may read them
+               anymore.
+            */
+            void clear();
+
+            /**
+               @brief The number of objects waiting to be destroyed.
+            */
+            std::size_t size() const;
+
+        private:
+            struct entry
+            {
+                // The epoch the object was retired in.
+                std::uint64_t epoch;
+                std::function<void()> destroy;
+            };
+
+            mutable std::mutex m_mutex;
+            std::vector<entry> m_entries;
+        };
+    }
+}
+
+#endif  // LISP_EPOCH_HPP
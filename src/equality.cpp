@@ -0,0 +1,154 @@
+#include "equality.hpp"
+
+#include <vector>
+#include <utility>
+
+#include <boost/functional/hash.hpp>
+
+#include "lisp.hpp"
+#include "types.hpp"
+#include "utils.hpp"
+#include "vector.hpp"
+#include "runtime.hpp"
+
+
+namespace lisp {
+    namespace {
+        bool same_symbol(const object_ptr_t& a, const object_ptr_t& b)
+        {
+            const symbol_ref* x = exact_cast<symbol_ref>(a);
+            const symbol_ref* y = exact_cast<symbol_ref>(b);
+
+            return x && y && x->name() == y->name();
+        }
+
+        bool same_number(const object_ptr_t& a, const object_ptr_t& b)
+        {
+            const number* x = exact_cast<number>(a);
+            const number* y = exact_cast<number>(b);
+
+            return x && y && x->getType() == y->getType() && *x == *y;
+        }
+    }  // Anonymous namespace
+
+    bool eq(const object_ptr_t& a, const object_ptr_t& b)
+    {
+        return a == b || same_symbol(a, b);
+    }
+
+    bool eql(const object_ptr_t& a, const object_ptr_t& b)
+    {
+        return eq(a, b) || same_number(a, b);
+    }
+
+    bool equal(const object_ptr_t& a, const object_ptr_t& b)
+    {
+        // Pairs of cars still to compare. The objects are owned by
+        // a and b.
+        std::vector<std::pair<const object_ptr_t*, const object_ptr_t*> > pending;
+
+        pending.push_back(std::make_pair(&a, &b));
+
+        while(!pending.empty()) {
+            const object_ptr_t* x = pending.back().first;
+            const object_ptr_t* y = pending.back().second;
+
+            pending.pop_back();
+
+            // Follow the cdr chains, cars are compared later.
+            for(;;) {
+                if(eql(*x, *y))
+                    break;
+
+                if(typeid(**x) != typeid(**y))
+                    return false;
+
+                if(const cons_cell* cx = exact_cast<cons_cell>(*x)) {
+                    const cons_cell* cy = static_cast<const cons_cell*>(y->get());
+
+                    if(cx->hash() != cy->hash())
+                        return false;
+
+                    pending.push_back(std::make_pair(&cx->car(), &cy->car()));
+
+                    x = &cx->cdr();
+                    y = &cy->cdr();
+                }
+                else if(const string* sx = exact_cast<string>(*x)) {
+                    if(sx->value() != static_cast<const string*>(y->get())->value())
+                        return false;
+
+                    break;
+                }
+                else if(const vector* vx = exact_cast<vector>(*x)) {
+                    const vector* vy = static_cast<const vector*>(y->get());
+
+                    if(vx->size() != vy->size())
+                        return false;
+
+                    for(std::size_t i = 0; i < vx->size(); ++i)
+                        pending.push_back(std::make_pair(&(*vx)[i], &(*vy)[i]));
+
+                    break;
+                }
+                else if(const quote* qx = exact_cast<quote>(*x)) {
+                    x = &qx->quoted();
+                    y = &static_cast<const quote*>(y->get())->quoted();
+                }
+                else
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    std::size_t hash_epoch()
+    {
+        return runtime::current().hash_epoch();
+    }
+
+    void invalidate_hashes()
+    {
+        runtime::current().invalidate_hashes();
+    }
+
+    std::size_t sxhash(const object_ptr_t& obj)
+    {
+        if(const cons_cell* cell = exact_cast<cons_cell>(obj))
+            return cell->hash();
+        else if(const string* str = exact_cast<string>(obj))
+            return str->hash();
+        else if(const number* num = exact_cast<number>(obj)) {
+            std::size_t seed = num->getType();
+
+            // Fractions of the same value are equal, whatever their
+            // representation.
+            if(num->isIntegerType())
+                boost::hash_combine(seed, num->as_long());
+            else
+                boost::hash_combine(seed, num->as_double());
+
+            return seed;
+        }
+        else if(const vector* vec = exact_cast<vector>(obj)) {
+            // Not cached, vectors change through aset.
+            std::size_t seed = vec->size();
+
+            for(std::size_t i = 0; i < vec->size(); ++i)
+                boost::hash_combine(seed, sxhash((*vec)[i]));
+
+            return seed;
+        }
+        else if(const symbol_ref* ref = exact_cast<symbol_ref>(obj))
+            return boost::hash<std::string>()(ref->name());
+        else if(const quote* q = exact_cast<quote>(obj)) {
+            std::size_t seed = sxhash(q->quoted());
+
+            boost::hash_combine(seed, 'q');
+            return seed;
+        }
+
+        return boost::hash<const object*>()(obj.get());
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef LISP_EQUALITY_HPP
+#define LISP_EQUALITY_HPP
+
+#include "object.hpp"
+
+namespace lisp {
+    /**
+       @brief Identity. Symbol references are identical if they
+       name the same symbol.
+    */
+    bool eq(const object_ptr_t& a, const object_ptr_t& b);
+
+    /**
+       @brief Like eq(), but numbers of the same type and value are
+       also eql.
+    */
+    bool eql(const object_ptr_t& a, const object_ptr_t& b);
+
+    /**
+       @brief Structural equality: lists, vectors and quoted objects
+       are compared element-wise, strings by content and numbers with
+       eql().
+
+       Works without recursion, so long or deeply nested lists don't
+       overflow the stack. Lists whose cached hashes differ are
+       rejected without being traversed.
+    */
+    bool equal(const object_ptr_t& a, const object_ptr_t& b);
+
+    /**
+       @brief Hash consistent with equal(): equal objects have the
+       same hash.
+
+       Strings and lists cache their hash, objects without a
+       structure are hashed by identity.
+    */
+    std::size_t sxhash(const object_ptr_t& obj);
+
+    /**
+       @brief Returns the current hash epoch. Cached list hashes are
+       valid only while the epoch they were computed in is current.
+    */
+    std::size_t hash_epoch();
+
+    /**
+       @brief Starts a new hash epoch, invalidating all cached list
+       hashes.
+
+       Called by every destructive operation on lists and vectors: a
+       changed cell or element alters the hash of every list that
+       reaches it, and those can't be found from the changed object.
+    */
+    void invalidate_hashes();
+}
+
+#endif  // LISP_EQUALITY_HPP
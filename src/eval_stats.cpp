@@ -0,0 +1,141 @@
+#include "eval_stats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+
+namespace lisp {
+    namespace eval_stats {
+        namespace {
+            const char* const names[event_count] = {
+                ":evals",
+                ":funcalls",
+                ":symbol-hits",
+                ":symbol-parent-walks",
+                ":symbol-creations",
+                ":environments",
+                ":list-next-steps"
+            };
+
+#ifdef LISP_EVAL_STATS
+            struct thread_counts;
+
+            // Guards registered and finished.
+            std::mutex registry_mutex;
+            std::vector<thread_counts*> registered;
+            counts_t finished = counts_t();
+
+            /**
+               @brief The counters of a thread. Only the thread
+               writes them, so a relaxed load and store suffice to
+               let totals() read them meanwhile.
+            */
+            struct thread_counts
+            {
+                thread_counts()
+                    {
+                        for(std::size_t i = 0; i < event_count; ++i)
+                            counts[i].store(0, std::memory_order_relaxed);
+
+                        std::lock_guard<std::mutex> lock(registry_mutex);
+
+                        registered.push_back(this);
+                    }
+
+                ~thread_counts()
+                    {
+                        std::lock_guard<std::mutex> lock(registry_mutex);
+
+                        for(std::size_t i = 0; i < event_count; ++i)
+                            finished.counts[i] += counts[i].load(std::memory_order_relaxed);
+
+                        registered.erase(std::find(registered.begin(), registered.end(), this));
+                    }
+
+                std::atomic<std::uint64_t> counts[event_count];
+            };
+
+            thread_local thread_counts own;
+            thread_local std::size_t trace_depth = 0;
+
+            std::atomic<bool> tracing(false);
+            trace_t trace;
+#endif
+        }
+
+        const char* name(event e)
+        {
+            return names[e];
+        }
+
+#ifdef LISP_EVAL_STATS
+        void count(event e)
+        {
+            std::atomic<std::uint64_t>& counter = own.counts[e];
+
+            counter.store(counter.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+        }
+#endif
+
+        counts_t totals()
+        {
+            counts_t result = counts_t();
+
+#ifdef LISP_EVAL_STATS
+            std::lock_guard<std::mutex> lock(registry_mutex);
+
+            result = finished;
+
+            for(std::size_t i = 0; i < registered.size(); ++i)
+                for(std::size_t j = 0; j < event_count; ++j)
+                    result.counts[j] += registered[i]->counts[j].load(std::memory_order_relaxed);
+#endif
+
+            return result;
+        }
+
+        counts_t thread_totals()
+        {
+            counts_t result = counts_t();
+
+#ifdef LISP_EVAL_STATS
+            for(std::size_t i = 0; i < event_count; ++i)
+                result.counts[i] = own.counts[i].load(std::memory_order_relaxed);
+#endif
+
+            return result;
+        }
+
+        void set_trace(const trace_t& t)
+        {
+#ifdef LISP_EVAL_STATS
+            trace = t;
+            tracing.store(static_cast<bool>(t));
+#else
+            (void)t;
+#endif
+        }
+
+#ifdef LISP_EVAL_STATS
+        traced_call::traced_call(const std::string& name)
+            : m_name(tracing.load(std::memory_order_relaxed) ? &name : 0)
+        {
+            if(m_name) {
+                ++trace_depth;
+                m_start = std::chrono::steady_clock::now();
+            }
+        }
+
+        traced_call::~traced_call()
+        {
+            if(m_name) {
+                trace(*m_name, trace_depth, std::chrono::steady_clock::now() - m_start);
+                --trace_depth;
+            }
+        }
+#endif
+    }
+}
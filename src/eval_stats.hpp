@@ -0,0 +1,125 @@
+#ifndef LISP_EVAL_STATS_HPP
+#define LISP_EVAL_STATS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+
+namespace lisp {
+    /**
+       @brief Counters of evaluator events and a hook tracing calls,
+       see (eval-stats).
+
+       Only built if LISP_EVAL_STATS is defined (cmake
+       -DLISP_EVAL_STATS=ON). Otherwise count() and traced_call are
+       empty inline functions, the counters stay zero and the trace
+       is never called.
+
+       Every thread counts into counters of its own. totals() adds
+       up the counters of all threads, including the ones that
+       ended.
+    */
+    namespace eval_stats {
+#ifdef LISP_EVAL_STATS
+        const bool enabled = true;
+#else
+        const bool enabled = false;
+#endif
+
+        enum event
+        {
+            // environment::eval()
+            evals,
+            // environment::funcall()
+            funcalls,
+            // environment::get_symbol() finding the symbol in the
+            // environment asked
+            symbol_hits,
+            // environment::get_symbol() passing the lookup on to the
+            // parent environment
+            symbol_parent_walks,
+            // environment::get_symbol() creating a missing symbol
+            symbol_creations,
+            environments,
+            list_next_steps,
+            event_count
+        };
+
+        /**
+           @brief The keyword naming @a e in (eval-stats), e.g.
+           ":evals".
+        */
+        const char* name(event e);
+
+#ifdef LISP_EVAL_STATS
+        void count(event e);
+#else
+        inline void count(event)
+        {
+        }
+#endif
+
+        struct counts_t
+        {
+            std::uint64_t counts[event_count];
+        };
+
+        /**
+           @brief The events counted by all threads since the start
+           of the program. Subtract two results to get the events in
+           between.
+        */
+        counts_t totals();
+
+        /**
+           @brief The events counted by the calling thread so far.
+        */
+        counts_t thread_totals();
+
+        /**
+           @brief Called when a traced call returns or unwinds with
+           the name of the called function, the number of traced
+           calls it is nested in plus one and the time it took.
+
+           Must not throw. Calls in tail position of a lisp function
+           run in the caller's loop and are part of the caller's
+           time.
+        */
+        typedef std::function<void(const std::string& name, std::size_t depth,
+                                   std::chrono::nanoseconds duration)> trace_t;
+
+        /**
+           @brief Registers the trace of all threads, an empty
+           function removes it. Must not be called while lisp code
+           runs.
+        */
+        void set_trace(const trace_t& trace);
+
+        /**
+           @brief Reports a call of the named function to the trace
+           when it ends.
+        */
+        class traced_call : private boost::noncopyable
+        {
+        public:
+#ifdef LISP_EVAL_STATS
+            explicit traced_call(const std::string& name);
+            ~traced_call();
+
+        private:
+            const std::string* m_name;
+            std::chrono::steady_clock::time_point m_start;
+#else
+            explicit traced_call(const std::string&)
+                {
+                }
+#endif
+        };
+    }
+}
+
+#endif  // LISP_EVAL_STATS_HPP
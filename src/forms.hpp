@@ -1,8 +1,24 @@
 #ifndef LISP_FORMS_HPP
 #define LISP_FORMS_HPP
 
+#include <fstream>
+
 #include "utils.hpp"
 #include "cxx_function.hpp"
+#include "analyzer.hpp"
+#include "lisp_error.hpp"
+#include "equality.hpp"
+#include "hash_table.hpp"
+#include "vector.hpp"
+#include "typed_array.hpp"
+#include "parallel.hpp"
+#include "future.hpp"
+#include "actor.hpp"
+#include "atom.hpp"
+#include "profiler.hpp"
+#include "eval_stats.hpp"
+#include "timing.hpp"
+#include "runtime.hpp"
 
 namespace lisp {
     class if_form : public object
@@ -118,7 +134,7 @@ namespace lisp {
 
                 symbol_ref_ptr_t r_sym_ref = boost::dynamic_pointer_cast<symbol_ref>(sym_ref);
 
-                symbol_ptr_t sym = env->get_symbol(r_sym_ref->name());
+                symbol_ptr_t sym = env->get_writable_symbol(r_sym_ref->name());
 
                 cons_cell_ptr_t value = list_next(_args, "fset: listp");
 
@@ -150,7 +166,7 @@ namespace lisp {
 
                 symbol_ref_ptr_t r_sym_ref = boost::dynamic_pointer_cast<symbol_ref>(sym_ref);
 
-                symbol_ptr_t sym = env->get_symbol(r_sym_ref->name());
+                symbol_ptr_t sym = env->get_writable_symbol(r_sym_ref->name());
 
                 cons_cell_ptr_t value = list_next(_args, "setf: listp");
 
@@ -182,7 +198,7 @@ namespace lisp {
 
                 symbol_ref_ptr_t r_sym_ref = boost::dynamic_pointer_cast<symbol_ref>(sym_ref);
 
-                symbol_ptr_t sym = env->get_symbol(r_sym_ref->name());
+                symbol_ptr_t sym = env->get_writable_symbol(r_sym_ref->name());
 
                 cons_cell_ptr_t value = list_next(_args, "setq: listp");
 
@@ -214,7 +230,7 @@ namespace lisp {
                            "symbolp <argument-1 to defun>");
 
                 symbol_ref_ptr_t sym_ref = boost::dynamic_pointer_cast<symbol_ref>(sym_raw);
-                symbol_ptr_t sym = env->get_symbol(sym_ref->name());
+                symbol_ptr_t sym = env->get_writable_symbol(sym_ref->name());
 
                 cdr = list_next(cdr, "defun: listp");
 
@@ -250,67 +266,2269 @@ namespace lisp {
                 }
 
                 // Manipulate symbol and return it.
-                sym->set_function(object_ptr_t(new function(function_arg_list, body)));
+                sym->set_function(object_ptr_t(
+                                      new function(function_arg_list, body,
+                                                   analyze_body(env, body))));
                 return sym;
             }
     };
 
-    class equal_form : public object
+    /**
+       @brief Two-argument predicate like eq or equal.
+    */
+    template <bool (*Predicate)(const object_ptr_t&, const object_ptr_t&)>
+    class predicate_function : public cxx_function
+    {
+    public:
+        predicate_function(const std::string& name)
+            : m_name(name)
+            {
+            }
+
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 2)
+                    signal(env->get_symbol("wrong-number-of-arguments"), m_name);
+
+                return Predicate(args[0], args[1]) ? t() : nil();
+            }
+
+    private:
+        std::string m_name;
+    };
+
+    /**
+       @brief (sxhash OBJ), see lisp::sxhash().
+    */
+    class sxhash_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 1)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "sxhash");
+
+                return object_ptr_t(new number(static_cast<long long>(sxhash(args[0]))));
+            }
+    };
+
+    /**
+       @brief (condition-case VAR BODYFORM HANDLERS...)
+
+       Evaluates BODYFORM. If it signals an error, the first handler
+       (CONDITIONS BODY...) whose CONDITIONS match the error runs with
+       VAR bound to (ERROR-SYMBOL . DATA). Errors without a matching
+       handler propagate.
+    */
+    class condition_case_form : public object
     {
     protected:
         object_ptr_t operator()(environment* env,
                                 const cons_cell_ptr_t args = cons_cell_ptr_t())
             {
-                cons_cell_ptr_t first = list_next(args, "equal: listp");
+                cons_cell_ptr_t var = list_next(args, "condition-case: listp");
 
-                if(!first)
+                if(!var)
                     signal(env->get_symbol("wrong-number-of-arguments"),
-                           "equal");
+                           "condition-case");
 
-                cons_cell_ptr_t second = list_next(first, "equal: listp");
+                if(!var->car()->is_symbol_ref() && var->car() != nil())
+                    signal(env->get_symbol("wrong-type-argument"),
+                           "condition-case: symbolp");
+
+                cons_cell_ptr_t body = list_next(var, "condition-case: listp");
 
-                if(!second)
+                if(!body)
                     signal(env->get_symbol("wrong-number-of-arguments"),
-                           "equal");
+                           "condition-case");
 
-                if(env->eval(first->car()) == env->eval(second->car()))
-                    return t();
-                else
-                    return nil();
+                try {
+                    return env->eval(body->car());
+                }
+                catch(const lisp_error& err) {
+                    return handle(env, var->car(), body, err);
+                }
+                catch(const arith_error& err) {
+                    return handle(env, var->car(), body, as_lisp_error(err));
+                }
+            }
+
+    private:
+        /**
+           @brief Runs the handler matching @a err, rethrows the
+           current exception if there is none.
+        */
+        object_ptr_t handle(environment* env, const object_ptr_t& var,
+                            const cons_cell_ptr_t& body, const lisp_error& err)
+            {
+                cons_cell_ptr_t handlers = list_next(body, "condition-case: listp");
+
+                while(handlers) {
+                    if(!handlers->car()->is_cons_cell())
+                        signal(env->get_symbol("wrong-type-argument"),
+                               "condition-case: listp " + handlers->car()->str());
+
+                    cons_cell_ptr_t handler =
+                        boost::static_pointer_cast<cons_cell>(handlers->car());
+
+                    if(err.matches(handler->car())) {
+                        environment handler_env(env);
+                        symbol_ptr_t sym;
+
+                        if(var->is_symbol_ref()) {
+                            sym = handler_env.create_symbol(
+                                boost::static_pointer_cast<symbol_ref>(var)->name());
+                            sym->set_value(err.value());
+                        }
+
+                        object_ptr_t result = nil();
+                        cons_cell_ptr_t forms = list_next(handler, "condition-case: listp");
+
+                        while(forms) {
+                            result = handler_env.eval(forms->car());
+                            forms = list_next(forms, "condition-case: listp");
+                        }
+
+                        return result;
+                    }
+
+                    handlers = list_next(handlers, "condition-case: listp");
+                }
+
+                throw;
+            }
+    };
+
+    /**
+       @brief (unwind-protect BODYFORM UNWINDFORMS...)
+
+       Evaluates BODYFORM and then UNWINDFORMS, even if BODYFORM
+       signaled an error. Returns the value of BODYFORM.
+    */
+    class unwind_protect_form : public object
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const cons_cell_ptr_t args = cons_cell_ptr_t())
+            {
+                cons_cell_ptr_t body = list_next(args, "unwind-protect: listp");
+
+                if(!body)
+                    signal(env->get_symbol("wrong-number-of-arguments"),
+                           "unwind-protect");
+
+                object_ptr_t result;
+
+                try {
+                    result = env->eval(body->car());
+                }
+                catch(...) {
+                    unwind(env, body);
+                    throw;
+                }
+
+                unwind(env, body);
+                return result;
+            }
+
+    private:
+        void unwind(environment* env, const cons_cell_ptr_t& body)
+            {
+                cons_cell_ptr_t forms = list_next(body, "unwind-protect: listp");
+
+                while(forms) {
+                    env->eval(forms->car());
+                    forms = list_next(forms, "unwind-protect: listp");
+                }
+            }
+    };
+
+    /**
+       @brief (signal ERROR-SYMBOL DATA)
+    */
+    class signal_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 2)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "signal");
+
+                if(!args[0]->is_symbol_ref())
+                    signal(env->get_symbol("wrong-type-argument"),
+                           "signal: symbolp " + args[0]->str());
+
+                signal(boost::static_pointer_cast<symbol_ref>(args[0])->name(), args[1]);
+
+                return nil();
             }
     };
 
+    /**
+       @brief N-ary arithmetic, see number::fold().
+    */
     template <template <typename Type> class Operator, char OpName>
     class arith_op_form : public cxx_function
     {
         object_ptr_t operator()(environment* env,
                                 const argv_t& args)
             {
-                size_t sz = args.size();
-                if(sz <= 1)
+                if(args.size() <= 1)
                     signal(env->get_symbol("wrong-number-of-arguments"),
                            to_string(OpName));
-                if(!args[0]->is_number())
-                    signal(env->get_symbol("wrong-type-argument"),
-                           to_string(OpName) + ": numberp " + args[0]->str());
 
-                number_ptr_t res =  boost::dynamic_pointer_cast<lisp::number>(args[0]);
+                for(argv_t::const_iterator it = args.begin(); it != args.end(); ++it)
+                    if(!(*it)->is_number())
+                        signal(env->get_symbol("wrong-type-argument"),
+                               to_string(OpName) + ": numberp " + (*it)->str());
+
+                return number::fold<Operator, OpName>(args);
+            }
+    };
+
+    /**
+       @brief Returns @a arg as number or signals wrong-type-argument.
+    */
+    inline const number& number_argument(environment* env, const std::string& name,
+                                         const object_ptr_t& arg)
+    {
+        if(!arg->is_number())
+            signal(env->get_symbol("wrong-type-argument"),
+                   name + ": numberp " + arg->str());
+
+        return static_cast<const number&>(*arg);
+    }
+
+    /**
+       @brief Chained numeric comparison, t if every adjacent pair of
+       arguments satisfies the operator.
+
+       Stops at the first pair that doesn't, later arguments aren't
+       type checked then.
+    */
+    template <template <typename Type> class Operator>
+    class comparison_form : public cxx_function
+    {
+    public:
+        comparison_form(const std::string& name)
+            : m_name(name)
+            {
+            }
+
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.empty())
+                    signal(env->get_symbol("wrong-number-of-arguments"), m_name);
+
+                Operator<number> op;
+                const number* prev = &number_argument(env, m_name, args[0]);
+
+                for(size_t i = 1; i < args.size(); ++i) {
+                    const number& next = number_argument(env, m_name, args[i]);
+
+                    if(!op(*prev, next))
+                        return nil();
+
+                    prev = &next;
+                }
+
+                return t();
+            }
+
+    private:
+        std::string m_name;
+    };
+
+    /**
+       @brief (/= NUMBER...) is t if no two arguments are equal.
+    */
+    class distinct_form : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.empty())
+                    signal(env->get_symbol("wrong-number-of-arguments"), "/=");
+
+                for(size_t i = 0; i < args.size(); ++i) {
+                    const number& current = number_argument(env, "/=", args[i]);
+
+                    for(size_t j = 0; j < i; ++j)
+                        if(current == static_cast<const number&>(*args[j]))
+                            return nil();
+                }
+
+                return t();
+            }
+    };
+
+    /**
+       @brief Returns @a arg as hash table or signals
+       wrong-type-argument.
+    */
+    inline hash_table& hash_table_argument(environment* env, const std::string& name,
+                                           const object_ptr_t& arg)
+    {
+        hash_table* table = dynamic_cast<hash_table*>(arg.get());
+
+        if(!table)
+            signal(env->get_symbol("wrong-type-argument"),
+                   name + ": hash-table-p " + arg->str());
+
+        return *table;
+    }
+
+    /**
+       @brief (make-hash-table [:test TEST] [:size SIZE])
+
+       TEST is one of the symbols eq, eql (the default) and equal.
+    */
+    class make_hash_table_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() % 2 != 0)
+                    signal(env->get_symbol("wrong-number-of-arguments"),
+                           "make-hash-table");
+
+                hash_table::test_t test = hash_table::TEST_EQL;
+                std::size_t size = 0;
+
+                for(size_t i = 0; i < args.size(); i += 2) {
+                    const symbol_ref* keyword = exact_cast<symbol_ref>(args[i]);
+                    const symbol_ref* value = exact_cast<symbol_ref>(args[i + 1]);
+
+                    if(keyword && keyword->name() == ":test" && value) {
+                        if(value->name() == "eq")
+                            test = hash_table::TEST_EQ;
+                        else if(value->name() == "eql")
+                            test = hash_table::TEST_EQL;
+                        else if(value->name() == "equal")
+                            test = hash_table::TEST_EQUAL;
+                        else
+                            signal(env->get_symbol("error"),
+                                   "make-hash-table: invalid test " + value->name());
+                    }
+                    else if(keyword && keyword->name() == ":size") {
+                        const number& num = number_argument(env, "make-hash-table", args[i + 1]);
+
+                        if(!num.isIntegerType())
+                            signal(env->get_symbol("wrong-type-argument"),
+                                   "make-hash-table: integerp " + args[i + 1]->str());
 
-                for(unsigned int i = 1; i < sz; i++)
-                {
-                    if(args[i]->is_number())
-                    {
-                        number_ptr_t num = boost::dynamic_pointer_cast<lisp::number>(args[i]);
-                        Operator<number> op;
+                        if(num.as_long() < 0 ||
+                           static_cast<unsigned long long>(num.as_long()) > hash_table::max_size)
+                            signal(env->get_symbol("args-out-of-range"),
+                                   "make-hash-table: " + args[i + 1]->str());
 
-                        *res = op(*res, *num);
+                        size = static_cast<std::size_t>(num.as_long());
                     }
                     else
-                        signal(env->get_symbol("wrong-type-argument"),
-                               to_string(OpName) + ": numberp " + args[i]->str());
+                        signal(env->get_symbol("error"),
+                               "make-hash-table: invalid argument " + args[i]->str());
+                }
+
+                return object_ptr_t(new hash_table(test, size));
+            }
+    };
+
+    /**
+       @brief (gethash KEY TABLE [DEFAULT])
+    */
+    class gethash_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 2 && args.size() != 3)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "gethash");
+
+                object_ptr_t value = hash_table_argument(env, "gethash", args[1]).get(args[0]);
+
+                if(value)
+                    return value;
+
+                return args.size() == 3 ? args[2] : nil();
+            }
+    };
+
+    /**
+       @brief (puthash KEY VALUE TABLE) returns VALUE.
+    */
+    class puthash_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 3)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "puthash");
+
+                hash_table_argument(env, "puthash", args[2]).put(args[0], args[1]);
+
+                return args[1];
+            }
+    };
+
+    /**
+       @brief (remhash KEY TABLE)
+    */
+    class remhash_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 2)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "remhash");
+
+                hash_table_argument(env, "remhash", args[1]).remove(args[0]);
+
+                return nil();
+            }
+    };
+
+    /**
+       @brief (maphash FUNCTION TABLE) calls FUNCTION with each key
+       and value.
+    */
+    class maphash_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 2)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "maphash");
+
+                hash_table& table = hash_table_argument(env, "maphash", args[1]);
+                object_ptr_t entry[2];
+
+                // The function may change the table, so the capacity
+                // is checked on every step.
+                for(std::size_t i = 0; i < table.capacity(); ++i) {
+                    if(!table.key_at(i))
+                        continue;
+
+                    entry[0] = table.key_at(i);
+                    entry[1] = table.value_at(i);
+
+                    apply_function(env, args[0], argv_t(entry, 2));
                 }
 
-                return res;
+                return nil();
+            }
+    };
+
+    /**
+       @brief (hash-table-count TABLE)
+    */
+    class hash_table_count_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 1)
+                    signal(env->get_symbol("wrong-number-of-arguments"),
+                           "hash-table-count");
+
+                return object_ptr_t(new number(static_cast<long long>(
+                                                   hash_table_argument(env, "hash-table-count",
+                                                                       args[0]).count())));
+            }
+    };
+
+    /**
+       @brief Returns @a arg as vector or signals
+       wrong-type-argument.
+    */
+    inline vector& vector_argument(environment* env, const std::string& name,
+                                   const object_ptr_t& arg)
+    {
+        vector* vec = dynamic_cast<vector*>(arg.get());
+
+        if(!vec)
+            signal(env->get_symbol("wrong-type-argument"),
+                   name + ": vectorp " + arg->str());
+
+        return *vec;
+    }
+
+    /**
+       @brief Returns @a arg as index into @a vec or signals
+       args-out-of-range.
+    */
+    inline std::size_t index_argument(environment* env, const std::string& name,
+                                      const vector& vec, const object_ptr_t& arg)
+    {
+        const number& num = number_argument(env, name, arg);
+
+        if(!num.isIntegerType() || num.as_long() < 0 ||
+           static_cast<std::size_t>(num.as_long()) >= vec.size())
+            signal(env->get_symbol("args-out-of-range"),
+                   name + ": " + vec.str() + " " + arg->str());
+
+        return static_cast<std::size_t>(num.as_long());
+    }
+
+    /**
+       @brief Calls @a f with every element of the list or vector
+       @a seq.
+
+       Signals wrong-type-argument for other objects and dotted
+       lists.
+    */
+    template <typename F>
+    void for_each_element(environment* env, const std::string& name,
+                          const object_ptr_t& seq, F f)
+    {
+        if(const vector* vec = exact_cast<vector>(seq)) {
+            for(std::size_t i = 0; i < vec->size(); ++i)
+                f((*vec)[i]);
+
+            return;
+        }
+
+        object_ptr_t rest = seq;
+
+        while(rest->is_cons_cell()) {
+            const cons_cell* cell = static_cast<const cons_cell*>(rest.get());
+
+            f(cell->car());
+            rest = cell->cdr();
+        }
+
+        if(rest != nil())
+            signal(env->get_symbol("wrong-type-argument"),
+                   name + ": sequencep " + seq->str());
+    }
+
+    /**
+       @brief Appends the elements of the list or vector @a seq to
+       @a out.
+    */
+    template <typename Container>
+    void append_elements(environment* env, const std::string& name,
+                         const object_ptr_t& seq, Container& out)
+    {
+        for_each_element(env, name, seq,
+                         [&out](const object_ptr_t& element) { out.push_back(element); });
+    }
+
+    /**
+       @brief (make-vector LENGTH INIT)
+    */
+    class make_vector_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 2)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "make-vector");
+
+                const number& length = number_argument(env, "make-vector", args[0]);
+
+                if(!length.isIntegerType() || length.as_long() < 0)
+                    signal(env->get_symbol("wrong-type-argument"),
+                           "make-vector: wholenump " + args[0]->str());
+
+                return object_ptr_t(new vector(static_cast<std::size_t>(length.as_long()),
+                                               args[1]));
+            }
+    };
+
+    /**
+       @brief (vector OBJECTS...)
+    */
+    class vector_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment*,
+                                const argv_t& args)
+            {
+                return object_ptr_t(new vector(vector::elements_t(args.begin(), args.end())));
+            }
+    };
+
+    /**
+       @brief (aref VECTOR INDEX)
+    */
+    class aref_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 2)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "aref");
+
+                const vector& vec = vector_argument(env, "aref", args[0]);
+
+                return vec[index_argument(env, "aref", vec, args[1])];
+            }
+    };
+
+    /**
+       @brief (aset VECTOR INDEX VALUE) returns VALUE.
+    */
+    class aset_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 3)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "aset");
+
+                vector& vec = vector_argument(env, "aset", args[0]);
+
+                vec.set(index_argument(env, "aset", vec, args[1]), args[2]);
+
+                return args[2];
+            }
+    };
+
+    /**
+       @brief (vector-length VECTOR)
+    */
+    class vector_length_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != 1)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "vector-length");
+
+                return object_ptr_t(new number(static_cast<long long>(
+                                                   vector_argument(env, "vector-length",
+                                                                   args[0]).size())));
+            }
+    };
+
+    /**
+       @brief (vconcat SEQUENCES...) returns a new vector holding the
+       elements of all lists and vectors.
+    */
+    class vconcat_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                vector::elements_t elements;
+
+                for(argv_t::const_iterator it = args.begin(); it != args.end(); ++it)
+                    append_elements(env, "vconcat", *it, elements);
+
+                return object_ptr_t(new vector(elements));
+            }
+    };
+
+    /**
+       @brief (apply FUNCTION ARGS... SEQUENCE) calls FUNCTION with
+       ARGS followed by the elements of the list or vector SEQUENCE.
+    */
+    class apply_function_form : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() < 2)
+                    signal(env->get_symbol("wrong-number-of-arguments"), "apply");
+
+                if(const vector* vec = exact_cast<vector>(args[args.size() - 1]))
+                    if(args.size() == 2)
+                        return apply_function(env, args[0], *vec);
+
+                arg_buffer spread;
+
+                for(std::size_t i = 1; i + 1 < args.size(); ++i)
+                    spread.push_back(args[i]);
+
+                append_elements(env, "apply", args[args.size() - 1], spread);
+
+                return apply_function(env, args[0], spread);
+            }
+    };
+
+    /**
+       @brief Converts a number for storing it in a typed array.
+    */
+    template <typename T>
+    T typed_element(environment* env, const std::string& name, const object_ptr_t& arg);
+
+    template <>
+    inline double typed_element<double>(environment* env, const std::string& name,
+                                        const object_ptr_t& arg)
+    {
+        return number_argument(env, name, arg).as_double();
+    }
+
+    template <>
+    inline long long typed_element<long long>(environment* env, const std::string& name,
+                                              const object_ptr_t& arg)
+    {
+        const number& num = number_argument(env, name, arg);
+
+        if(!num.isIntegerType())
+            signal(env->get_symbol("wrong-type-argument"),
+                   name + ": integerp " + arg->str());
+
+        return num.as_long();
+    }
+
+    /**
+       @brief (f64-array SEQUENCE) or (i64-array SEQUENCE) converts
+       the numbers of a list or vector.
+    */
+    template <typename T>
+    class make_typed_array_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                std::string name = std::string(typed_array_traits<T>::name()) + "-array";
+
+                if(args.size() != 1)
+                    signal(env->get_symbol("wrong-number-of-arguments"), name);
+
+                std::vector<object_ptr_t> elements;
+                append_elements(env, name, args[0], elements);
+
+                typed_array<T>* array = new typed_array<T>(elements.size());
+                object_ptr_t result(array);
+
+                for(std::size_t i = 0; i < elements.size(); ++i)
+                    array->data()[i] = typed_element<T>(env, name, elements[i]);
+
+                return result;
+            }
+    };
+
+    /**
+       @brief Base of the builtins on typed arrays. Dispatches on the
+       element type of the first argument.
+    */
+    class typed_array_function : public cxx_function
+    {
+    public:
+        typed_array_function(const std::string& name, std::size_t arity)
+            : m_name(name),
+              m_arity(arity)
+            {
+            }
+
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() != m_arity)
+                    signal(env->get_symbol("wrong-number-of-arguments"), m_name);
+
+                if(f64_array* array = dynamic_cast<f64_array*>(args[0].get()))
+                    return run(env, *array, args);
+                else if(i64_array* array = dynamic_cast<i64_array*>(args[0].get()))
+                    return run(env, *array, args);
+
+                signal(env->get_symbol("wrong-type-argument"),
+                       m_name + ": typed-array-p " + args[0]->str());
+
+                return nil();
+            }
+
+        virtual object_ptr_t run(environment* env, const f64_array& array,
+                                 const argv_t& args) = 0;
+
+        virtual object_ptr_t run(environment* env, const i64_array& array,
+                                 const argv_t& args) = 0;
+
+        /**
+           @brief Returns the argument at @a index as array of the
+           same type and length as @a array.
+        */
+        template <typename T>
+        const typed_array<T>& same_array(environment* env, const typed_array<T>& array,
+                                         const argv_t& args, std::size_t index)
+            {
+                const typed_array<T>* other = dynamic_cast<const typed_array<T>*>(
+                    args[index].get());
+
+                if(!other)
+                    signal(env->get_symbol("wrong-type-argument"),
+                           m_name + ": " + typed_array_traits<T>::name() + "-array-p " +
+                           args[index]->str());
+
+                if(other->size() != array.size())
+                    signal(env->get_symbol("wrong-length-argument"), m_name);
+
+                return *other;
+            }
+
+        template <typename T>
+        object_ptr_t number_result(T value)
+            {
+                return object_ptr_t(new number(value));
+            }
+
+        std::string m_name;
+        std::size_t m_arity;
+    };
+
+    /*
+      The kernels of the typed array builtins, as types for the
+      templates below.
+    */
+    struct add_kernel
+    {
+        template <typename T>
+        static void run(const T* a, const T* b, T* out, std::size_t n)
+            {
+                simd::add(a, b, out, n);
+            }
+    };
+
+    struct sub_kernel
+    {
+        template <typename T>
+        static void run(const T* a, const T* b, T* out, std::size_t n)
+            {
+                simd::sub(a, b, out, n);
+            }
+    };
+
+    struct mul_kernel
+    {
+        template <typename T>
+        static void run(const T* a, const T* b, T* out, std::size_t n)
+            {
+                simd::mul(a, b, out, n);
+            }
+    };
+
+    struct div_kernel
+    {
+        template <typename T>
+        static void run(const T* a, const T* b, T* out, std::size_t n)
+            {
+                simd::div(a, b, out, n);
+            }
+    };
+
+    struct less_kernel
+    {
+        template <typename T>
+        static void run(const T* a, const T* b, long long* mask, std::size_t n)
+            {
+                simd::less(a, b, mask, n);
+            }
+    };
+
+    struct greater_kernel
+    {
+        template <typename T>
+        static void run(const T* a, const T* b, long long* mask, std::size_t n)
+            {
+                simd::greater(a, b, mask, n);
+            }
+    };
+
+    struct equal_kernel
+    {
+        template <typename T>
+        static void run(const T* a, const T* b, long long* mask, std::size_t n)
+            {
+                simd::equal(a, b, mask, n);
+            }
+    };
+
+    struct sum_kernel
+    {
+        template <typename T>
+        static T run(const T* a, std::size_t n)
+            {
+                return simd::sum(a, n);
+            }
+    };
+
+    struct min_kernel
+    {
+        template <typename T>
+        static T run(const T* a, std::size_t n)
+            {
+                return simd::min(a, n);
+            }
+    };
+
+    struct max_kernel
+    {
+        template <typename T>
+        static T run(const T* a, std::size_t n)
+            {
+                return simd::max(a, n);
+            }
+    };
+
+    /**
+       @brief (array+ A B) and the other elementwise operations on
+       two arrays of the same type and length.
+    */
+    template <typename Kernel>
+    class array_elementwise_function : public typed_array_function
+    {
+    public:
+        array_elementwise_function(const std::string& name)
+            : typed_array_function(name, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const f64_array& array, const argv_t& args)
+            {
+                return apply_kernel(env, array, args);
+            }
+
+        object_ptr_t run(environment* env, const i64_array& array, const argv_t& args)
+            {
+                return apply_kernel(env, array, args);
+            }
+
+    private:
+        template <typename T>
+        object_ptr_t apply_kernel(environment* env, const typed_array<T>& array,
+                                  const argv_t& args)
+            {
+                const typed_array<T>& other = same_array(env, array, args, 1);
+                typed_array<T>* result = new typed_array<T>(array.size());
+                object_ptr_t result_ptr(result);
+
+                Kernel::run(array.data(), other.data(), result->data(), array.size());
+
+                return result_ptr;
+            }
+    };
+
+    /**
+       @brief (array< A B) and the other comparisons return an i64
+       array holding 1 where the comparison holds and 0 elsewhere.
+    */
+    template <typename Kernel>
+    class array_mask_function : public typed_array_function
+    {
+    public:
+        array_mask_function(const std::string& name)
+            : typed_array_function(name, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const f64_array& array, const argv_t& args)
+            {
+                return apply_kernel(env, array, args);
+            }
+
+        object_ptr_t run(environment* env, const i64_array& array, const argv_t& args)
+            {
+                return apply_kernel(env, array, args);
+            }
+
+    private:
+        template <typename T>
+        object_ptr_t apply_kernel(environment* env, const typed_array<T>& array,
+                                  const argv_t& args)
+            {
+                const typed_array<T>& other = same_array(env, array, args, 1);
+                i64_array* mask = new i64_array(array.size());
+                object_ptr_t result(mask);
+
+                Kernel::run(array.data(), other.data(), mask->data(), array.size());
+
+                return result;
+            }
+    };
+
+    /**
+       @brief (array-sum A), (array-min A) and (array-max A).
+    */
+    template <typename Kernel>
+    class array_reduce_function : public typed_array_function
+    {
+    public:
+        array_reduce_function(const std::string& name, bool allow_empty)
+            : typed_array_function(name, 1),
+              m_allow_empty(allow_empty)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const f64_array& array, const argv_t&)
+            {
+                return reduce(env, array);
+            }
+
+        object_ptr_t run(environment* env, const i64_array& array, const argv_t&)
+            {
+                return reduce(env, array);
+            }
+
+    private:
+        template <typename T>
+        object_ptr_t reduce(environment* env, const typed_array<T>& array)
+            {
+                if(array.size() == 0 && !m_allow_empty)
+                    signal(env->get_symbol("args-out-of-range"), m_name);
+
+                return number_result(Kernel::run(array.data(), array.size()));
+            }
+
+        bool m_allow_empty;
+    };
+
+    /**
+       @brief (array-dot A B)
+    */
+    class array_dot_function : public typed_array_function
+    {
+    public:
+        array_dot_function()
+            : typed_array_function("array-dot", 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const f64_array& array, const argv_t& args)
+            {
+                return number_result(simd::dot(array.data(),
+                                               same_array(env, array, args, 1).data(),
+                                               array.size()));
+            }
+
+        object_ptr_t run(environment* env, const i64_array& array, const argv_t& args)
+            {
+                return number_result(simd::dot(array.data(),
+                                               same_array(env, array, args, 1).data(),
+                                               array.size()));
+            }
+    };
+
+    /**
+       @brief (array-scale A K) multiplies every element with the
+       number K.
+    */
+    class array_scale_function : public typed_array_function
+    {
+    public:
+        array_scale_function()
+            : typed_array_function("array-scale", 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const f64_array& array, const argv_t& args)
+            {
+                return scale(env, array, args);
+            }
+
+        object_ptr_t run(environment* env, const i64_array& array, const argv_t& args)
+            {
+                return scale(env, array, args);
+            }
+
+    private:
+        template <typename T>
+        object_ptr_t scale(environment* env, const typed_array<T>& array, const argv_t& args)
+            {
+                T factor = typed_element<T>(env, m_name, args[1]);
+                typed_array<T>* result = new typed_array<T>(array.size());
+                object_ptr_t result_ptr(result);
+
+                simd::scale(array.data(), factor, result->data(), array.size());
+
+                return result_ptr;
+            }
+    };
+
+    /**
+       @brief (array-to-list A) returns the elements as numbers.
+    */
+    class array_to_list_function : public typed_array_function
+    {
+    public:
+        array_to_list_function()
+            : typed_array_function("array-to-list", 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment*, const f64_array& array, const argv_t&)
+            {
+                return to_list(array);
+            }
+
+        object_ptr_t run(environment*, const i64_array& array, const argv_t&)
+            {
+                return to_list(array);
+            }
+
+    private:
+        template <typename T>
+        object_ptr_t to_list(const typed_array<T>& array)
+            {
+                object_ptr_t list = nil();
+
+                for(std::size_t i = array.size(); i > 0; --i)
+                    list = object_ptr_t(new cons_cell(number_result(array[i - 1]), list));
+
+                return list;
+            }
+    };
+
+    /**
+       @brief (array-length A)
+    */
+    class array_length_function : public typed_array_function
+    {
+    public:
+        array_length_function()
+            : typed_array_function("array-length", 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment*, const f64_array& array, const argv_t&)
+            {
+                return number_result(static_cast<long long>(array.size()));
+            }
+
+        object_ptr_t run(environment*, const i64_array& array, const argv_t&)
+            {
+                return number_result(static_cast<long long>(array.size()));
+            }
+    };
+
+    /**
+       @brief Returns @a arg as cons cell, a null pointer for nil.
+       Signals wrong-type-argument for other objects.
+    */
+    inline const cons_cell* list_argument(environment* env, const std::string& name,
+                                          const object_ptr_t& arg)
+    {
+        if(arg == nil())
+            return 0;
+
+        const cons_cell* cell = exact_cast<cons_cell>(arg);
+
+        if(!cell)
+            signal(env->get_symbol("wrong-type-argument"),
+                   name + ": listp " + arg->str());
+
+        return cell;
+    }
+
+    /**
+       @brief Returns the cell following @a cell or a null pointer at
+       the end of the list. Signals wrong-type-argument for dotted
+       lists.
+    */
+    inline const cons_cell* next_cell(environment* env, const std::string& name,
+                                      const cons_cell* cell)
+    {
+        return list_argument(env, name, cell->cdr());
+    }
+
+    /**
+       @brief Base of builtins taking a fixed number of arguments.
+    */
+    class fixed_arity_function : public cxx_function
+    {
+    public:
+        fixed_arity_function(const std::string& name, std::size_t min_arity,
+                             std::size_t max_arity)
+            : m_name(name),
+              m_min_arity(min_arity),
+              m_max_arity(max_arity)
+            {
+            }
+
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.size() < m_min_arity || args.size() > m_max_arity)
+                    signal(env->get_symbol("wrong-number-of-arguments"), m_name);
+
+                return run(env, args);
+            }
+
+        virtual object_ptr_t run(environment* env, const argv_t& args) = 0;
+
+        std::string m_name;
+
+    private:
+        std::size_t m_min_arity;
+        std::size_t m_max_arity;
+    };
+
+    /**
+       @brief (car LIST)
+    */
+    class car_function : public fixed_arity_function
+    {
+    public:
+        car_function()
+            : fixed_arity_function("car", 1, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                const cons_cell* cell = list_argument(env, m_name, args[0]);
+
+                return cell ? cell->car() : nil();
+            }
+    };
+
+    /**
+       @brief (cdr LIST)
+    */
+    class cdr_function : public fixed_arity_function
+    {
+    public:
+        cdr_function()
+            : fixed_arity_function("cdr", 1, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                const cons_cell* cell = list_argument(env, m_name, args[0]);
+
+                return cell ? cell->cdr() : nil();
+            }
+    };
+
+    /**
+       @brief (cons CAR CDR)
+    */
+    class cons_function : public fixed_arity_function
+    {
+    public:
+        cons_function()
+            : fixed_arity_function("cons", 2, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment*, const argv_t& args)
+            {
+                return object_ptr_t(new cons_cell(args[0], args[1]));
+            }
+    };
+
+    /**
+       @brief (list OBJECTS...)
+    */
+    class list_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment*,
+                                const argv_t& args)
+            {
+                list_builder result;
+
+                for(argv_t::const_iterator it = args.begin(); it != args.end(); ++it)
+                    result.push_back(*it);
+
+                return result.list();
+            }
+    };
+
+    /**
+       @brief (length SEQUENCE) of a list, vector or string.
+    */
+    class length_function : public fixed_arity_function
+    {
+    public:
+        length_function()
+            : fixed_arity_function("length", 1, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                long long length = 0;
+
+                if(const string* str = exact_cast<string>(args[0]))
+                    length = static_cast<long long>(str->value().size());
+                else
+                    for_each_element(env, m_name, args[0],
+                                     [&length](const object_ptr_t&) { ++length; });
+
+                return object_ptr_t(new number(length));
+            }
+    };
+
+    /**
+       @brief (nth N LIST)
+    */
+    class nth_function : public fixed_arity_function
+    {
+    public:
+        nth_function()
+            : fixed_arity_function("nth", 2, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                long long n = typed_element<long long>(env, m_name, args[0]);
+                const cons_cell* cell = list_argument(env, m_name, args[1]);
+
+                for(; cell && n > 0; --n)
+                    cell = next_cell(env, m_name, cell);
+
+                return cell ? cell->car() : nil();
+            }
+    };
+
+    /**
+       @brief (append LISTS...) copies all lists but the last one,
+       which becomes the shared tail of the result.
+    */
+    class append_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                if(args.empty())
+                    return nil();
+
+                list_builder result;
+
+                for(std::size_t i = 0; i + 1 < args.size(); ++i)
+                    for_each_element(env, "append", args[i],
+                                     [&result](const object_ptr_t& element) {
+                                         result.push_back(element);
+                                     });
+
+                result.set_rest(args[args.size() - 1]);
+
+                return result.list();
+            }
+    };
+
+    /**
+       @brief (reverse SEQUENCE) returns a reversed copy of a list or
+       vector.
+    */
+    class reverse_function : public fixed_arity_function
+    {
+    public:
+        reverse_function()
+            : fixed_arity_function("reverse", 1, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                if(const vector* vec = exact_cast<vector>(args[0]))
+                    return object_ptr_t(new vector(vector::elements_t(vec->elements().rbegin(),
+                                                                      vec->elements().rend())));
+
+                object_ptr_t result = nil();
+
+                for(const cons_cell* cell = list_argument(env, m_name, args[0]); cell;
+                    cell = next_cell(env, m_name, cell))
+                    result = object_ptr_t(new cons_cell(cell->car(), result));
+
+                return result;
+            }
+    };
+
+    /**
+       @brief (mapcar FUNCTION SEQUENCE) returns the list of the
+       results of FUNCTION applied to each element.
+    */
+    class mapcar_function : public fixed_arity_function
+    {
+    public:
+        mapcar_function()
+            : fixed_arity_function("mapcar", 2, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                list_builder result;
+                const object_ptr_t& func = args[0];
+
+                for_each_element(env, m_name, args[1],
+                                 [env, &func, &result](const object_ptr_t& element) {
+                                     result.push_back(apply_function(env, func,
+                                                                     argv_t(&element, 1)));
+                                 });
+
+                return result.list();
+            }
+    };
+
+    /**
+       @brief (reduce FUNCTION SEQUENCE [INITIAL-VALUE]) combines the
+       elements from left to right.
+
+       Without INITIAL-VALUE an empty sequence gives the result of
+       calling FUNCTION without arguments and a single element is
+       returned as it is.
+    */
+    class reduce_function : public fixed_arity_function
+    {
+    public:
+        reduce_function()
+            : fixed_arity_function("reduce", 2, 3)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                const object_ptr_t& func = args[0];
+                object_ptr_t pair[2];
+                bool empty = args.size() < 3;
+
+                if(!empty)
+                    pair[0] = args[2];
+
+                for_each_element(env, m_name, args[1],
+                                 [env, &func, &pair, &empty](const object_ptr_t& element) {
+                                     if(empty) {
+                                         pair[0] = element;
+                                         empty = false;
+                                         return;
+                                     }
+
+                                     pair[1] = element;
+                                     pair[0] = apply_function(env, func, argv_t(pair, 2));
+                                 });
+
+                if(empty)
+                    return apply_function(env, func, argv_t());
+
+                return pair[0];
+            }
+    };
+
+    /**
+       @brief (member ELT LIST) returns the tail of LIST starting with
+       the first element equal to ELT.
+    */
+    class member_function : public fixed_arity_function
+    {
+    public:
+        member_function()
+            : fixed_arity_function("member", 2, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                object_ptr_t rest = args[1];
+
+                for(const cons_cell* cell = list_argument(env, m_name, rest); cell;
+                    cell = next_cell(env, m_name, cell)) {
+                    if(equal(args[0], cell->car()))
+                        return rest;
+
+                    rest = cell->cdr();
+                }
+
+                return nil();
+            }
+    };
+
+    /**
+       @brief (assoc KEY ALIST) returns the first cons whose car is
+       equal to KEY. Elements that aren't conses are skipped.
+    */
+    class assoc_function : public fixed_arity_function
+    {
+    public:
+        assoc_function()
+            : fixed_arity_function("assoc", 2, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                for(const cons_cell* cell = list_argument(env, m_name, args[1]); cell;
+                    cell = next_cell(env, m_name, cell)) {
+                    const cons_cell* entry = exact_cast<cons_cell>(cell->car());
+
+                    if(entry && equal(args[0], entry->car()))
+                        return cell->car();
+                }
+
+                return nil();
+            }
+    };
+
+    /**
+       @brief Returns @a arg as cons cell or signals
+       wrong-type-argument.
+    */
+    inline cons_cell& cons_argument(environment* env, const std::string& name,
+                                    const object_ptr_t& arg)
+    {
+        cons_cell* cell = dynamic_cast<cons_cell*>(arg.get());
+
+        if(!cell)
+            signal(env->get_symbol("wrong-type-argument"),
+                   name + ": consp " + arg->str());
+
+        return *cell;
+    }
+
+    /**
+       @brief (setcar CELL OBJECT) returns OBJECT.
+    */
+    class setcar_function : public fixed_arity_function
+    {
+    public:
+        setcar_function()
+            : fixed_arity_function("setcar", 2, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                cons_argument(env, m_name, args[0]).set_car(args[1]);
+                invalidate_hashes();
+
+                return args[1];
+            }
+    };
+
+    /**
+       @brief (setcdr CELL OBJECT) returns OBJECT.
+    */
+    class setcdr_function : public fixed_arity_function
+    {
+    public:
+        setcdr_function()
+            : fixed_arity_function("setcdr", 2, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                cons_argument(env, m_name, args[0]).set_cdr(args[1]);
+                invalidate_hashes();
+
+                return args[1];
+            }
+    };
+
+    /**
+       @brief (nconc LISTS...) links the lists together by changing
+       the last cdr of each but the last one. Empty lists are
+       skipped.
+    */
+    class nconc_function : public cxx_function
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const argv_t& args)
+            {
+                object_ptr_t result = nil();
+                cons_cell* last = 0;
+
+                // Up front, a later argument that isn't a list signals
+                // after some cells changed.
+                invalidate_hashes();
+
+                for(std::size_t i = 0; i < args.size(); ++i) {
+                    if(args[i] == nil())
+                        continue;
+
+                    if(last)
+                        last->set_cdr(args[i]);
+                    else
+                        result = args[i];
+
+                    if(i + 1 == args.size())
+                        break;
+
+                    last = &cons_argument(env, "nconc", args[i]);
+
+                    while(cons_cell* next = dynamic_cast<cons_cell*>(last->cdr().get()))
+                        last = next;
+                }
+
+                return result;
+            }
+    };
+
+    /**
+       @brief (nreverse SEQUENCE) reverses a list by redirecting its
+       cdrs or a vector in place and returns the result.
+    */
+    class nreverse_function : public fixed_arity_function
+    {
+    public:
+        nreverse_function()
+            : fixed_arity_function("nreverse", 1, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                if(exact_cast<vector>(args[0])) {
+                    vector_argument(env, m_name, args[0]).reverse();
+
+                    return args[0];
+                }
+
+                list_argument(env, m_name, args[0]);
+
+                object_ptr_t reversed = nil();
+                object_ptr_t rest = args[0];
+
+                while(cons_cell* cell = dynamic_cast<cons_cell*>(rest.get())) {
+                    object_ptr_t next = cell->cdr();
+
+                    cell->set_cdr(reversed);
+                    reversed.swap(rest);
+                    rest.swap(next);
+                }
+
+                invalidate_hashes();
+
+                return reversed;
+            }
+    };
+
+    /**
+       @brief (pmapcar FUNCTION SEQUENCE) is mapcar with the calls
+       spread over the thread pool (see parallel_chunks()).
+
+       FUNCTION must not change objects shared with other calls.
+       The results keep the order of the elements.
+    */
+    class pmapcar_function : public fixed_arity_function
+    {
+    public:
+        pmapcar_function()
+            : fixed_arity_function("pmapcar", 2, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                const object_ptr_t callee = resolve_function(env, args[0]);
+                std::vector<object_ptr_t> elements;
+
+                append_elements(env, m_name, args[1], elements);
+
+                std::vector<object_ptr_t> results(elements.size());
+
+                parallel_chunks(elements.size(),
+                                [&callee, &elements, &results](environment* chunk_env,
+                                                               std::size_t begin,
+                                                               std::size_t end) {
+                                    for(std::size_t i = begin; i < end; ++i)
+                                        results[i] = callee->apply(chunk_env,
+                                                                   argv_t(&elements[i], 1));
+                                });
+
+                list_builder result;
+
+                for(std::size_t i = 0; i < results.size(); ++i)
+                    result.push_back(results[i]);
+
+                return result.list();
+            }
+    };
+
+    /**
+       @brief (preduce FUNCTION SEQUENCE [INITIAL-VALUE]) is reduce
+       with the chunks of SEQUENCE reduced in parallel.
+
+       The chunk results are combined from left to right, so
+       FUNCTION has to be associative. INITIAL-VALUE is combined
+       once, with the first chunk's result.
+    */
+    class preduce_function : public fixed_arity_function
+    {
+    public:
+        preduce_function()
+            : fixed_arity_function("preduce", 2, 3)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                const object_ptr_t callee = resolve_function(env, args[0]);
+                std::vector<object_ptr_t> elements;
+
+                append_elements(env, m_name, args[1], elements);
+
+                if(elements.empty())
+                    return args.size() == 3 ? args[2] : callee->apply(env, argv_t());
+
+                // The result of a chunk is stored at its first index.
+                std::vector<object_ptr_t> partial(elements.size());
+
+                parallel_chunks(elements.size(),
+                                [&callee, &elements, &partial](environment* chunk_env,
+                                                               std::size_t begin,
+                                                               std::size_t end) {
+                                    object_ptr_t pair[2] = { elements[begin] };
+
+                                    for(std::size_t i = begin + 1; i < end; ++i) {
+                                        pair[1] = elements[i];
+                                        pair[0] = callee->apply(chunk_env, argv_t(pair, 2));
+                                    }
+
+                                    partial[begin] = pair[0];
+                                });
+
+                object_ptr_t pair[2];
+                bool empty = args.size() < 3;
+
+                if(!empty)
+                    pair[0] = args[2];
+
+                for(std::size_t i = 0; i < partial.size(); ++i) {
+                    if(!partial[i])
+                        continue;
+
+                    if(empty) {
+                        pair[0] = partial[i];
+                        empty = false;
+                        continue;
+                    }
+
+                    pair[1] = partial[i];
+                    pair[0] = callee->apply(env, argv_t(pair, 2));
+                }
+
+                return pair[0];
+            }
+    };
+
+    /**
+       @brief (set-pool-size N) sets the number of threads the
+       parallel builtins use, 1 runs them sequentially.
+    */
+    class set_pool_size_function : public fixed_arity_function
+    {
+    public:
+        set_pool_size_function()
+            : fixed_arity_function("set-pool-size", 1, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                long long size = typed_element<long long>(env, m_name, args[0]);
+
+                if(size < 1)
+                    signal(env->get_symbol("args-out-of-range"),
+                           m_name + ": " + args[0]->str());
+
+                if(!runtime::current().set_pool_size(static_cast<std::size_t>(size)))
+                    signal(env->get_symbol("error"), m_name + ": the thread pool is busy");
+
+                return args[0];
+            }
+    };
+
+    /**
+       @brief (future EXPR) starts evaluating EXPR on the thread
+       pool and returns its handle for await.
+
+       EXPR sees copies of the caller's local variables, see
+       lisp::future.
+    */
+    class future_form : public object
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const cons_cell_ptr_t args = cons_cell_ptr_t())
+            {
+                cons_cell_ptr_t expr = list_next(args, "future: listp");
+
+                if(!expr || list_next(expr, "future: listp"))
+                    signal(env->get_symbol("wrong-number-of-arguments"), "future");
+
+                const object_ptr_t form = expr->car();
+
+                return future::start(env, [form](environment* future_env) {
+                        return future_env->eval(form);
+                    });
+            }
+    };
+
+    /**
+       @brief (await FUTURE) returns the value of FUTURE's expression
+       or signals its error again. (await ACTOR) does the same when
+       ACTOR finished.
+    */
+    class await_function : public fixed_arity_function
+    {
+    public:
+        await_function()
+            : fixed_arity_function("await", 1, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                if(future_ptr_t handle = boost::dynamic_pointer_cast<future>(args[0]))
+                    return handle->await();
+
+                if(actor_ptr_t handle = boost::dynamic_pointer_cast<actor>(args[0]))
+                    return handle->await();
+
+                signal(env->get_symbol("wrong-type-argument"),
+                       m_name + ": futurep " + args[0]->str());
+
+                return nil();
+            }
+    };
+
+    /**
+       @brief (spawn EXPR) starts an actor evaluating EXPR and
+       returns it.
+
+       EXPR sees copies of the caller's local variables, see
+       lisp::actor.
+    */
+    class spawn_form : public object
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const cons_cell_ptr_t args = cons_cell_ptr_t())
+            {
+                cons_cell_ptr_t expr = list_next(args, "spawn: listp");
+
+                if(!expr || list_next(expr, "spawn: listp"))
+                    signal(env->get_symbol("wrong-number-of-arguments"), "spawn");
+
+                const object_ptr_t form = expr->car();
+
+                return actor::spawn(env, [form](environment* actor_env) {
+                        return actor_env->eval(form);
+                    });
+            }
+    };
+
+    /**
+       @brief (send ACTOR MESSAGE) puts a copy of MESSAGE into
+       ACTOR's mailbox (see copy_message()) and returns MESSAGE.
+       Blocks while the mailbox is full.
+    */
+    class send_function : public fixed_arity_function
+    {
+    public:
+        send_function()
+            : fixed_arity_function("send", 2, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                actor_ptr_t receiver = boost::dynamic_pointer_cast<actor>(args[0]);
+
+                if(!receiver)
+                    signal(env->get_symbol("wrong-type-argument"),
+                           m_name + ": actorp " + args[0]->str());
+
+                receiver->send(args[1]);
+
+                return args[1];
+            }
+    };
+
+    /**
+       @brief (receive) returns the oldest message of the running
+       actor's mailbox, blocks while it is empty.
+    */
+    class receive_function : public fixed_arity_function
+    {
+    public:
+        receive_function()
+            : fixed_arity_function("receive", 0, 0)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment*, const argv_t&)
+            {
+                return actor::self()->receive();
+            }
+    };
+
+    /**
+       @brief (self) returns the running actor, outside of actors
+       the actor standing for the calling thread.
+    */
+    class self_function : public fixed_arity_function
+    {
+    public:
+        self_function()
+            : fixed_arity_function("self", 0, 0)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment*, const argv_t&)
+            {
+                return actor::self();
+            }
+    };
+
+    inline atom& atom_argument(environment* env, const std::string& name,
+                               const object_ptr_t& obj)
+    {
+        atom* a = dynamic_cast<atom*>(obj.get());
+
+        if(!a)
+            signal(env->get_symbol("wrong-type-argument"),
+                   name + ": atomp " + obj->str());
+
+        return *a;
+    }
+
+    /**
+       @brief (make-atom VALUE) returns an atom holding VALUE, see
+       lisp::atom.
+    */
+    class make_atom_function : public fixed_arity_function
+    {
+    public:
+        make_atom_function()
+            : fixed_arity_function("make-atom", 1, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment*, const argv_t& args)
+            {
+                return object_ptr_t(new atom(args[0]));
+            }
+    };
+
+    /**
+       @brief (deref ATOM)
+    */
+    class deref_function : public fixed_arity_function
+    {
+    public:
+        deref_function()
+            : fixed_arity_function("deref", 1, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                return atom_argument(env, m_name, args[0]).deref();
+            }
+    };
+
+    /**
+       @brief (reset! ATOM VALUE) returns VALUE.
+    */
+    class reset_function : public fixed_arity_function
+    {
+    public:
+        reset_function()
+            : fixed_arity_function("reset!", 2, 2)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                atom_argument(env, m_name, args[0]).reset(args[1]);
+
+                return args[1];
+            }
+    };
+
+    /**
+       @brief (swap! ATOM FUNCTION ARGS...) sets ATOM to
+       (FUNCTION VALUE ARGS...) and returns the new value.
+
+       FUNCTION is called again if another thread updated ATOM
+       meanwhile, so it shouldn't have side effects.
+    */
+    class swap_function : public fixed_arity_function
+    {
+    public:
+        swap_function()
+            : fixed_arity_function("swap!", 2, std::size_t(-1))
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                atom& a = atom_argument(env, m_name, args[0]);
+                const object_ptr_t callee = resolve_function(env, args[1]);
+
+                return a.swap([env, &callee, &args](const object_ptr_t& value) {
+                        arg_buffer call_args;
+
+                        call_args.push_back(value);
+
+                        for(std::size_t i = 2; i < args.size(); ++i)
+                            call_args.push_back(args[i]);
+
+                        return callee->apply(env, call_args);
+                    });
+            }
+    };
+
+    /**
+       @brief (compare-and-set! ATOM OLD NEW) sets ATOM to NEW if its
+       value is eql to OLD. Returns t if it did.
+    */
+    class compare_and_set_function : public fixed_arity_function
+    {
+    public:
+        compare_and_set_function()
+            : fixed_arity_function("compare-and-set!", 3, 3)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                return atom_argument(env, m_name, args[0]).compare_and_set(args[1], args[2]) ?
+                    t() : nil();
+            }
+    };
+
+    /**
+       @brief (atom-retries ATOM) returns the number of updates of
+       ATOM that were retried because of a concurrent update.
+    */
+    class atom_retries_function : public fixed_arity_function
+    {
+    public:
+        atom_retries_function()
+            : fixed_arity_function("atom-retries", 1, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                return object_ptr_t(new number(static_cast<long long>(
+                                                   atom_argument(env, m_name, args[0]).retries())));
+            }
+    };
+
+    /**
+       @brief (profile-start &optional INTERVAL) starts sampling the
+       lisp call stacks every INTERVAL microseconds of CPU time,
+       1000 by default. See lisp::profiler.
+    */
+    class profile_start_function : public fixed_arity_function
+    {
+    public:
+        profile_start_function()
+            : fixed_arity_function("profile-start", 0, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                long long interval = 1000;
+
+                if(args.size() == 1) {
+                    interval = typed_element<long long>(env, m_name, args[0]);
+
+                    if(interval < 1 || interval > 1000000)
+                        signal(env->get_symbol("args-out-of-range"),
+                               m_name + ": " + args[0]->str());
+                }
+
+                profiler::start(static_cast<long>(interval));
+
+                return t();
+            }
+    };
+
+    /**
+       @brief (profile-report &optional FILE) stops the profiler,
+       prints the self and total time of the sampled functions and
+       returns the samples as folded stacks, which are written to
+       FILE as well if given (e.g. for flamegraph.pl).
+    */
+    class profile_report_function : public fixed_arity_function
+    {
+    public:
+        profile_report_function()
+            : fixed_arity_function("profile-report", 0, 1)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment* env, const argv_t& args)
+            {
+                const string* file = 0;
+
+                if(args.size() == 1 && !(file = exact_cast<string>(args[0])))
+                    signal(env->get_symbol("wrong-type-argument"),
+                           m_name + ": stringp " + args[0]->str());
+
+                profiler::report_t report = profiler::report();
+
+                std::cerr << report.table;
+
+                if(file) {
+                    std::ofstream out(file->value().c_str());
+
+                    if(!(out << report.folded))
+                        signal(env->get_symbol("file-error"),
+                               m_name + ": " + file->value());
+                }
+
+                return object_ptr_t(new string(report.folded));
+            }
+    };
+
+    /**
+       @brief (eval-stats) returns the evaluator events counted by
+       all threads so far as a plist, e.g. (:evals 10 :funcalls 2
+       ...), or nil if they aren't counted. See lisp::eval_stats.
+    */
+    class eval_stats_function : public fixed_arity_function
+    {
+    public:
+        eval_stats_function()
+            : fixed_arity_function("eval-stats", 0, 0)
+            {
+            }
+
+    protected:
+        object_ptr_t run(environment*, const argv_t&)
+            {
+                if(!eval_stats::enabled)
+                    return nil();
+
+                const eval_stats::counts_t totals = eval_stats::totals();
+                list_builder plist;
+
+                for(std::size_t i = 0; i < eval_stats::event_count; ++i) {
+                    plist.push_back(object_ptr_t(new symbol_ref(
+                                                     eval_stats::name(eval_stats::event(i)))));
+                    plist.push_back(object_ptr_t(new number(
+                                                     static_cast<long long>(totals.counts[i]))));
+                }
+
+                return plist.list();
+            }
+    };
+
+    /**
+       @brief (time EXPR) evaluates EXPR, prints how long it took,
+       how many objects it allocated and how many calls it made and
+       returns that as a plist holding the value of EXPR as :value.
+       See lisp::measure_evaluation().
+    */
+    class time_form : public object
+    {
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const cons_cell_ptr_t args = cons_cell_ptr_t())
+            {
+                cons_cell_ptr_t expr = list_next(args, "time: listp");
+
+                if(!expr || list_next(expr, "time: listp"))
+                    signal(env->get_symbol("wrong-number-of-arguments"), "time");
+
+                const object_ptr_t form = expr->car();
+
+                return measure_evaluation("time", 1, [env, &form]() {
+                        return env->eval(form);
+                    });
+            }
+    };
+
+    /**
+       @brief (benchmark N EXPR) evaluates EXPR N times and reports
+       the totals like (time EXPR).
+    */
+    class benchmark_form : public object
+    {
+    public:
+        /**
+           @brief Returns the number of iterations @a count
+           evaluated to.
+        */
+        static long long iterations(environment* env, const object_ptr_t& count)
+            {
+                long long n = typed_element<long long>(env, "benchmark", count);
+
+                if(n < 1)
+                    signal(env->get_symbol("args-out-of-range"),
+                           "benchmark: " + count->str());
+
+                return n;
+            }
+
+    protected:
+        object_ptr_t operator()(environment* env,
+                                const cons_cell_ptr_t args = cons_cell_ptr_t())
+            {
+                cons_cell_ptr_t count = list_next(args, "benchmark: listp");
+                cons_cell_ptr_t expr = count ? list_next(count, "benchmark: listp") :
+                    cons_cell_ptr_t();
+
+                if(!expr || list_next(expr, "benchmark: listp"))
+                    signal(env->get_symbol("wrong-number-of-arguments"), "benchmark");
+
+                const object_ptr_t form = expr->car();
+
+                return measure_evaluation("benchmark", iterations(env, env->eval(count->car())),
+                                          [env, &form]() {
+                                              return env->eval(form);
+                                          });
             }
     };
 }
@@ -1,9 +1,13 @@
 
 #include "function.hpp"
 
+#include <algorithm>
+
 #include <boost/foreach.hpp>
 
 #include "utils.hpp"
+#include "analyzer.hpp"
+#include "profiler.hpp"
 
 
 namespace lisp {
@@ -11,46 +15,166 @@ namespace lisp {
                        cons_cell_ptr_t body)
         : object(),
           m_arg_symbols(arg_symbols),
-          m_body(body)
+          m_body(body),
+          m_analyzed_body(analyze_body(global_env(), body))
     {
     }
 
+    function::function(const arg_sym_list_t& arg_symbols,
+                       cons_cell_ptr_t body,
+                       node_ptr_t analyzed_body)
+        : object(),
+          m_arg_symbols(arg_symbols),
+          m_body(body),
+          m_analyzed_body(analyzed_body)
+    {
+        assert(m_analyzed_body);
+    }
+
     object_ptr_t function::operator()(environment* env, const cons_cell_ptr_t args)
     {
-        // Create isolated environment.
-        environment func_env(env);
+        arg_buffer vargs;
 
-        cons_cell_ptr_t _args = list_next(args, args->car()->str() + ": listp");
+        error_context context(args->car(), ": listp");
+        cons_cell_ptr_t _args = list_next(args, context);
 
-        // Hold all given arguments to save them from garbage collection.
-        std::list<symbol_ptr_t> arg_symbols;
+        while(_args) {
+            vargs.push_back(env->eval(_args->car()));
 
-        // Assign all given args to corresponding symbols
-        // in the function environment.
-        BOOST_FOREACH(const std::string& current, m_arg_symbols) {
-            if(!_args)
-                signal(env->get_symbol("wrong-number-of-arguments"),
-                       args->car()->str());
+            _args = list_next(_args, context);
+        }
 
-            // Create new symbol in function environment.
-            symbol_ptr_t new_sym = func_env.create_symbol(current);
-            new_sym->set_value(env->eval(_args->car()));
+        return apply(env, vargs);
+    }
 
-            // Push to argument list to save from garbage collection.
-            arg_symbols.push_back(new_sym);
+    namespace {
+        /**
+           @brief The environment of a function call holding the
+           parameter symbols.
+        */
+        class frame
+        {
+        public:
+            frame(environment* parent, const function::arg_sym_list_t& names,
+                  const argv_t& args)
+                : m_env(parent),
+                  m_names(&names)
+                {
+                    argv_t::const_iterator arg = args.begin();
+
+                    // Assign all given args to corresponding symbols
+                    // in the function environment.
+                    BOOST_FOREACH(const std::string& current, names) {
+                        // Create new symbol in function environment.
+                        symbol_ptr_t new_sym = m_env.create_symbol(current);
+                        new_sym->set_value(*arg++);
+
+                        // Hold the symbol to save it from garbage collection.
+                        m_symbols.push_back(new_sym);
+                    }
+                }
 
-            _args = list_next(_args, args->car()->str() + ": listp");
-        }
+            /**
+               @brief Assigns new arguments to the parameter symbols.
+            */
+            void rebind(const argv_t& args)
+                {
+                    for(size_t i = 0; i < m_symbols.size(); ++i)
+                        m_symbols[i]->set_value(args[i]);
+                }
 
-        object_ptr_t last_result = nil();
-        cons_cell_ptr_t _body = m_body;
+            /**
+               @brief Binds the parameters @a names of a function
+               called in tail position. The ones the frame has are
+               assigned, the others are added. Parameters of the
+               frame the callee doesn't have stay bound, just as if
+               the callee's frame were chained to this one.
+            */
+            void rebind(const function::arg_sym_list_t& names, const argv_t& args)
+                {
+                    argv_t::const_iterator arg = args.begin();
+
+                    BOOST_FOREACH(const std::string& current, names) {
+                        function::arg_sym_list_t::const_iterator at =
+                            std::find(m_names->begin(), m_names->end(), current);
+
+                        if(at != m_names->end())
+                            m_symbols[std::distance(m_names->begin(), at)]->set_value(*arg++);
+                        else {
+                            if(m_names != &m_own_names) {
+                                m_own_names = *m_names;
+                                m_names = &m_own_names;
+                            }
+
+                            symbol_ptr_t new_sym = m_env.create_symbol(current);
+                            new_sym->set_value(*arg++);
+
+                            m_own_names.push_back(current);
+                            m_symbols.push_back(new_sym);
+                        }
+                    }
+                }
 
-        while(_body) {
-            last_result = func_env.eval(_body->car());
-            _body = list_next(_body, args->car()->str() + ": listp");
-        }
+            environment* env()
+                {
+                    return &m_env;
+                }
+
+            const function::arg_sym_list_t& names() const
+                {
+                    return *m_names;
+                }
+
+        private:
+            environment m_env;
+            // The parameters once the frame has more than the ones of
+            // the function it was created for.
+            function::arg_sym_list_t m_own_names;
+            const function::arg_sym_list_t* m_names;
+            std::vector<symbol_ptr_t> m_symbols;
+        };
+    }
 
-        return last_result;
+    object_ptr_t function::apply(environment* env, const argv_t& args)
+    {
+        if(args.size() < m_arg_symbols.size())
+            signal(env->get_symbol("wrong-number-of-arguments"), str());
+
+        /*
+          Calls of lisp functions in tail position of the body are
+          returned in `tail' and run by this loop instead of growing
+          the C++ stack. All calls share a single frame: because
+          variables are dynamically scoped the callee's parameters are
+          bound in it next to the ones it doesn't shadow, which the
+          callee would see through the caller's frame otherwise. The
+          frame never has more bindings than the distinct parameter
+          names of the functions called.
+        */
+        tail_call tail;
+        function* current = this;
+        profiler::frame profiled(this);
+        object_ptr_t current_holder;
+        frame top(env, m_arg_symbols, args);
+
+        for(;;) {
+            object_ptr_t result = current->m_analyzed_body->eval_tail(top.env(), tail);
+
+            if(result)
+                return result;
+
+            // Keep the callee alive while its body is evaluated.
+            current_holder = tail.callee;
+            current = static_cast<function*>(current_holder.get());
+            profiled.replace(current);
+
+            if(tail.args.size() < current->m_arg_symbols.size())
+                signal(env->get_symbol("wrong-number-of-arguments"), current->str());
+
+            if(current->m_arg_symbols == top.names())
+                top.rebind(tail.args);
+            else
+                top.rebind(current->m_arg_symbols, tail.args);
+        }
     }
 
     std::string function::str() const
@@ -89,6 +213,7 @@ namespace lisp {
             }
         }
 
-        return object_ptr_t(new function(function_arg_list, body));
+        return object_ptr_t(new function(function_arg_list, body,
+                                         analyze_body(env, body)));
     }
 }
@@ -29,7 +29,17 @@ namespace lisp {
         function(const arg_sym_list_t& arg_symbols, cons_cell_ptr_t body);
 
         /**
-           @brief Sets the parameter symbols and evaluates the body.
+           @brief Instantiates a new function whose body was already
+           analyzed.
+
+           @see analyze_body().
+        */
+        function(const arg_sym_list_t& arg_symbols, cons_cell_ptr_t body,
+                 node_ptr_t analyzed_body);
+
+        /**
+           @brief Evaluates the arguments of the call form and
+           applies the function to them.
 
            TODO: Implement a return form.
 
@@ -37,11 +47,24 @@ namespace lisp {
          */
         object_ptr_t operator()(environment* env, const cons_cell_ptr_t args);
 
+        bool is_applicable() const
+            {
+                return true;
+            }
+
+        /**
+           @brief Sets the parameter symbols and evaluates the body.
+
+           @return The last result.
+        */
+        object_ptr_t apply(environment* env, const argv_t& args);
+
         std::string str() const;
 
     private:
         arg_sym_list_t m_arg_symbols;
         cons_cell_ptr_t m_body;
+        node_ptr_t m_analyzed_body;
     };
 
     /**
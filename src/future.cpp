@@ -0,0 +1,78 @@
+#include "future.hpp"
+
+#include <vector>
+
+#include "lisp.hpp"
+#include "runtime.hpp"
+#include "thread_pool.hpp"
+
+
+namespace lisp {
+    namespace {
+        /**
+           @brief The environment of a future's evaluation.
+        */
+        struct future_frame
+        {
+            future_frame(runtime& rt, const environment* caller)
+                : env(rt.global_env(), true),
+                  bindings(env.capture_bindings(caller))
+                {
+                }
+
+            environment env;
+            // Declared after env, so they are released first.
+            std::vector<symbol_ptr_t> bindings;
+        };
+    }
+
+    future::future(runtime& rt)
+        : m_runtime(rt),
+          m_ready(false)
+    {
+    }
+
+    object_ptr_t future::start(environment* env, body_t body)
+    {
+        runtime& rt = runtime::current();
+        future_ptr_t handle(new future(rt));
+        boost::shared_ptr<future_frame> frame(new future_frame(rt, env));
+
+        rt.pool().submit([handle, frame, body]() mutable {
+                runtime::scope scope(handle->m_runtime);
+
+                try {
+                    handle->m_result = body(&frame->env);
+                }
+                catch(...) {
+                    handle->m_error = std::current_exception();
+                }
+
+                // The frame's symbols belong to this runtime, so they
+                // are released within its scope. The result may
+                // refer to them, it is published afterwards.
+                frame.reset();
+                body = body_t();
+
+                handle->m_ready.store(true, std::memory_order_release);
+            });
+
+        return handle;
+    }
+
+    object_ptr_t future::await()
+    {
+        if(!is_ready())
+            m_runtime.pool().help_until([this]() { return is_ready(); });
+
+        if(m_error)
+            std::rethrow_exception(m_error);
+
+        return m_result;
+    }
+
+    std::string future::str() const
+    {
+        return is_ready() ? "#<future done>" : "#<future pending>";
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef LISP_FUTURE_HPP
+#define LISP_FUTURE_HPP
+
+#include <atomic>
+#include <exception>
+#include <functional>
+
+#include "object.hpp"
+
+
+namespace lisp {
+    class runtime;
+
+    /**
+       @brief The handle of an evaluation running on the thread pool
+       of a runtime, see (future EXPR) and (await FUTURE).
+
+       The evaluation gets an environment of its own: a fork of the
+       global environment (see environment::environment()) holding
+       copies of the caller's local variables. Its assignments stay
+       in that environment, definitions and global variables are
+       looked up in the shared global environment.
+    */
+    class future : public object
+    {
+    public:
+        typedef std::function<object_ptr_t(environment* env)> body_t;
+
+        /**
+           @brief Queues @a body on the pool of the current runtime
+           and returns the handle of its result right away.
+
+           @param env The environment whose local variables are
+           copied for @a body.
+        */
+        static object_ptr_t start(environment* env, body_t body);
+
+        bool is_ready() const
+            {
+                return m_ready.load(std::memory_order_acquire);
+            }
+
+        /**
+           @brief Returns the result of the evaluation or rethrows
+           the error it signaled. Waits until the evaluation is done
+           and runs tasks of the pool meanwhile, so with a pool size
+           of 1 the evaluation happens here.
+        */
+        object_ptr_t await();
+
+        std::string str() const;
+
+    private:
+        explicit future(runtime& rt);
+
+        runtime& m_runtime;
+
+        // Written by the task before m_ready is set.
+        object_ptr_t m_result;
+        std::exception_ptr m_error;
+
+        std::atomic<bool> m_ready;
+    };
+
+    typedef boost::shared_ptr<future> future_ptr_t;
+}
+
+#endif  // LISP_FUTURE_HPP
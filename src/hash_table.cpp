@@ -0,0 +1,200 @@
+#include "hash_table.hpp"
+
+#include <sstream>
+
+#include <boost/functional/hash.hpp>
+
+#include "lisp.hpp"
+#include "equality.hpp"
+#include "utils.hpp"
+
+
+namespace lisp {
+    namespace {
+        const std::size_t min_capacity = 8;
+
+        const char* test_names[] = { "eq", "eql", "equal" };
+    }
+
+    hash_table::hash_table(test_t test, std::size_t size)
+        : m_test(test),
+          m_count(0),
+          m_used(0)
+    {
+        assert(size <= max_size);
+
+        std::size_t capacity = min_capacity;
+
+        // Keep the load below 3/4.
+        while(capacity * 3 < size * 4)
+            capacity *= 2;
+
+        m_slots.resize(capacity);
+    }
+
+    object_ptr_t hash_table::get(const object_ptr_t& key) const
+    {
+        std::size_t index = find(key, hash_of(key));
+
+        if(index == m_slots.size())
+            return object_ptr_t();
+
+        return m_slots[index].value;
+    }
+
+    void hash_table::put(const object_ptr_t& key, const object_ptr_t& value)
+    {
+        std::size_t hash = hash_of(key);
+        std::size_t index = find(key, hash);
+
+        if(index != m_slots.size()) {
+            m_slots[index].value = value;
+            return;
+        }
+
+        // Make room for twice the entries, so that removing and
+        // adding keys doesn't rehash on every insertion.
+        if((m_used + 1) * 4 > m_slots.size() * 3)
+            rehash(2 * (m_count + 1));
+
+        std::size_t mask = m_slots.size() - 1;
+
+        for(index = hash & mask; m_slots[index].key; index = (index + 1) & mask)
+            ;
+
+        slot& target = m_slots[index];
+
+        if(!target.deleted)
+            ++m_used;
+
+        target.key = key;
+        target.value = value;
+        target.hash = hash;
+        target.deleted = false;
+
+        ++m_count;
+    }
+
+    bool hash_table::remove(const object_ptr_t& key)
+    {
+        std::size_t index = find(key, hash_of(key));
+
+        if(index == m_slots.size())
+            return false;
+
+        slot& target = m_slots[index];
+
+        target.key.reset();
+        target.value.reset();
+        target.deleted = true;
+
+        --m_count;
+        return true;
+    }
+
+    std::string hash_table::str() const
+    {
+        std::stringstream os;
+
+        os << "#s(hash-table size " << m_count
+           << " test " << test_names[m_test] << " data (";
+
+        bool first = true;
+
+        for(std::size_t i = 0; i < m_slots.size(); ++i) {
+            if(!m_slots[i].key)
+                continue;
+
+            if(!first)
+                os << " ";
+
+            os << m_slots[i].key->str() << " " << m_slots[i].value->str();
+            first = false;
+        }
+
+        os << "))";
+
+        return os.str();
+    }
+
+    std::size_t hash_table::hash_of(const object_ptr_t& key) const
+    {
+        switch(m_test)
+        {
+        case TEST_EQ:
+            if(const symbol_ref* ref = exact_cast<symbol_ref>(key))
+                return boost::hash<std::string>()(ref->name());
+
+            return boost::hash<const object*>()(key.get());
+
+        case TEST_EQL:
+            if(key->is_number() || key->is_symbol_ref())
+                return sxhash(key);
+
+            return boost::hash<const object*>()(key.get());
+
+        case TEST_EQUAL:
+            return sxhash(key);
+        }
+
+        assert(0);
+        return 0;
+    }
+
+    bool hash_table::same_key(const object_ptr_t& a, const object_ptr_t& b) const
+    {
+        switch(m_test)
+        {
+        case TEST_EQ:
+            return eq(a, b);
+
+        case TEST_EQL:
+            return eql(a, b);
+
+        case TEST_EQUAL:
+            return equal(a, b);
+        }
+
+        assert(0);
+        return false;
+    }
+
+    std::size_t hash_table::find(const object_ptr_t& key, std::size_t hash) const
+    {
+        std::size_t mask = m_slots.size() - 1;
+
+        for(std::size_t index = hash & mask; ; index = (index + 1) & mask) {
+            const slot& current = m_slots[index];
+
+            if(!current.key) {
+                if(!current.deleted)
+                    return m_slots.size();
+            }
+            else if(current.hash == hash && same_key(current.key, key))
+                return index;
+        }
+    }
+
+    void hash_table::rehash(std::size_t size)
+    {
+        hash_table grown(m_test, size);
+
+        for(std::size_t i = 0; i < m_slots.size(); ++i) {
+            slot& current = m_slots[i];
+
+            if(!current.key)
+                continue;
+
+            std::size_t mask = grown.m_slots.size() - 1;
+            std::size_t index = current.hash & mask;
+
+            while(grown.m_slots[index].key)
+                index = (index + 1) & mask;
+
+            grown.m_slots[index] = current;
+        }
+
+        m_slots.swap(grown.m_slots);
+        m_used = m_count;
+    }
+}
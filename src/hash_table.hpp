@@ -0,0 +1,128 @@
+#ifndef LISP_HASH_TABLE_HPP
+#define LISP_HASH_TABLE_HPP
+
+#include <vector>
+
+#include "object.hpp"
+
+namespace lisp {
+    /**
+       @brief Hash table with open addressing and linear probing.
+
+       Keys are compared with eq(), eql() or equal(). Every slot
+       keeps the hash of its key, so probing compares hashes first
+       and growing the table doesn't hash the keys again.
+    */
+    class hash_table : public object
+    {
+    public:
+        enum test_t
+        {
+            TEST_EQ,
+            TEST_EQL,
+            TEST_EQUAL
+        };
+
+        /**
+           @brief The most entries a table can reserve space for
+           when it is created.
+        */
+        static const std::size_t max_size = std::size_t(1) << 24;
+
+        /**
+           @param test The function comparing the keys.
+           @param size Number of entries to reserve space for, at
+           most max_size.
+        */
+        hash_table(test_t test = TEST_EQL, std::size_t size = 0);
+
+        test_t test() const
+            {
+                return m_test;
+            }
+
+        /**
+           @brief Returns the number of entries.
+        */
+        std::size_t count() const
+            {
+                return m_count;
+            }
+
+        /**
+           @brief Returns the value stored for @a key or a null
+           pointer if there is none.
+        */
+        object_ptr_t get(const object_ptr_t& key) const;
+
+        void put(const object_ptr_t& key, const object_ptr_t& value);
+
+        /**
+           @return false if there was no entry for @a key.
+        */
+        bool remove(const object_ptr_t& key);
+
+        /**
+           @brief Number of slots, see key_at() and value_at().
+        */
+        std::size_t capacity() const
+            {
+                return m_slots.size();
+            }
+
+        /**
+           @brief Returns the key of the slot at @a index or a null
+           pointer if the slot is empty.
+        */
+        const object_ptr_t& key_at(std::size_t index) const
+            {
+                return m_slots[index].key;
+            }
+
+        const object_ptr_t& value_at(std::size_t index) const
+            {
+                return m_slots[index].value;
+            }
+
+        std::string str() const;
+
+    private:
+        struct slot
+        {
+            slot()
+                : hash(0),
+                  deleted(false)
+                {
+                }
+
+            // Null if the slot is unused or deleted.
+            object_ptr_t key;
+            object_ptr_t value;
+            std::size_t hash;
+            // Marks removed entries, probing continues behind them.
+            bool deleted;
+        };
+
+        std::size_t hash_of(const object_ptr_t& key) const;
+
+        bool same_key(const object_ptr_t& a, const object_ptr_t& b) const;
+
+        /**
+           @brief Returns the index of the slot holding @a key or
+           capacity() if there is none.
+        */
+        std::size_t find(const object_ptr_t& key, std::size_t hash) const;
+
+        void rehash(std::size_t capacity);
+
+        test_t m_test;
+        std::vector<slot> m_slots;
+        std::size_t m_count;
+        // Entries plus deleted slots.
+        std::size_t m_used;
+    };
+
+    typedef boost::shared_ptr<hash_table> hash_table_ptr_t;
+}
+
+#endif  // LISP_HASH_TABLE_HPP
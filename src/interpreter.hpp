@@ -4,6 +4,7 @@
 #include "lisp.hpp"
 #include "tokenizer.hpp"
 #include "number.hpp"
+#include "vector.hpp"
 
 namespace lisp {
     namespace interpreter
@@ -97,6 +98,24 @@ namespace lisp {
             case QUOTE:
                 tok.next_token();
                 return object_ptr_t(new quote(compile_expr(env, tok)));
+            case VECTOR_START:
+            {
+                vector::elements_t elements;
+
+                for(;;) {
+                    token element_token = tok.next_token();
+
+                    if(element_token == RIGHT_PARENTHESIS)
+                        break;
+                    else if(element_token == END)
+                        throw parse_error("unexpected end of file in vector",
+                                          tok.line());
+
+                    elements.push_back(compile_expr(env, tok));
+                }
+
+                return object_ptr_t(new vector(elements));
+            }
             default:
                 throw parse_error("unexpected token: " + tok.value(),
                                   tok.line());
@@ -6,73 +6,34 @@
 
 #include "lisp.hpp"
 #include "function.hpp"
-#include "forms.hpp"
+#include "analyzer.hpp"
+#include "lisp_error.hpp"
+#include "equality.hpp"
+#include "utils.hpp"
+#include "runtime.hpp"
+#include "epoch.hpp"
+#include "symbol_table.hpp"
+#include "eval_stats.hpp"
 
 namespace lisp {
-    namespace {
-        // The unique nil object. Is returned by nil().
-        object_ptr_t _nil_object;
-        object_ptr_t _t_object;
-
-        environment _global_env;
-        bool _global_env_initialized = false;
-    }
-
-
     const object_ptr_t nil()
     {
-        if(!_nil_object)
-            _nil_object = object_ptr_t(new nil_object);
-
-        return _nil_object;
+        return runtime::current().nil();
     }
 
     const object_ptr_t t()
     {
-        if(!_t_object)
-            _t_object = object_ptr_t(new t_object);
-
-        return _t_object;
+        return runtime::current().t();
     }
 
     environment* global_env()
     {
-        if(!_global_env_initialized) {
-
-            // Register default forms.
-            _global_env.get_symbol("lambda")->set_function(
-                object_ptr_t(new lambda_form()));
-            _global_env.get_symbol("if")->set_function(
-                object_ptr_t(new if_form()));
-            _global_env.get_symbol("or")->set_function(
-                object_ptr_t(new or_form()));
-            _global_env.get_symbol("and")->set_function(
-                object_ptr_t(new and_form()));
-            _global_env.get_symbol("print")->set_function(
-                object_ptr_t(new print_function()));
-            _global_env.get_symbol("fset")->set_function(
-                object_ptr_t(new fset_form()));
-            _global_env.get_symbol("setf")->set_function(
-                object_ptr_t(new setf_form()));
-            _global_env.get_symbol("setq")->set_function(
-                object_ptr_t(new setq_form()));
-            _global_env.get_symbol("defun")->set_function(
-                object_ptr_t(new defun_form()));
-            _global_env.get_symbol("equal")->set_function(
-                object_ptr_t(new equal_form()));
-            _global_env.get_symbol("+")->set_function(
-                object_ptr_t(new arith_op_form<std::plus, '+'>()));
-            _global_env.get_symbol("-")->set_function(
-                object_ptr_t(new arith_op_form<std::minus, '-'>()));
-            _global_env.get_symbol("*")->set_function(
-                object_ptr_t(new arith_op_form<std::multiplies, '*'>()));
-            _global_env.get_symbol("/")->set_function(
-                object_ptr_t(new arith_op_form<std::divides, '/'>()));
-
-            _global_env_initialized = true;
-        }
+        return runtime::current().global_env();
+    }
 
-        return &_global_env;
+    unsigned long definition_version()
+    {
+        return runtime::current().definition_version();
     }
 
 
@@ -95,33 +56,108 @@ namespace lisp {
 
     void signal(symbol_ptr_t err_sym, const std::string& what)
     {
-        std::cerr << err_sym->name() << " " << what << std::endl;
+        signal(err_sym->name(),
+               object_ptr_t(new cons_cell(object_ptr_t(new string(what)))));
+    }
 
-        /*
-          FIXME: Add a real catchable exception. To build a system
-          comparable to emacs try-catch mechanism.
-        */
-        throw;
+    void signal(const std::string& err_sym, object_ptr_t data)
+    {
+        throw lisp_error(err_sym, data);
+    }
+
+    lisp_error::lisp_error(const std::string& symbol_name, object_ptr_t data)
+        : std::runtime_error(symbol_name + " " + data->str()),
+          m_symbol_name(symbol_name),
+          m_data(data)
+    {
+    }
+
+    object_ptr_t lisp_error::value() const
+    {
+        return object_ptr_t(new cons_cell(object_ptr_t(new symbol_ref(m_symbol_name)),
+                                          m_data));
+    }
+
+    lisp_error as_lisp_error(const arith_error& err)
+    {
+        return lisp_error("arith-error",
+                          object_ptr_t(new cons_cell(object_ptr_t(new string(err.what())))));
+    }
+
+    bool lisp_error::matches(const object_ptr_t& condition) const
+    {
+        if(condition == t())
+            return true;
+
+        if(condition->is_symbol_ref()) {
+            const std::string& name =
+                boost::static_pointer_cast<symbol_ref>(condition)->name();
+
+            return name == m_symbol_name || name == "error";
+        }
+
+        object_ptr_t rest = condition;
+
+        while(rest->is_cons_cell()) {
+            const cons_cell* cell = static_cast<const cons_cell*>(rest.get());
+
+            if(matches(cell->car()))
+                return true;
+
+            rest = cell->cdr();
+        }
+
+        return false;
     }
 
     cons_cell::cons_cell(object_ptr_t car, object_ptr_t cdr)
         : object(),
           m_car(car),
-          m_cdr(cdr)
+          m_cdr(cdr),
+          m_hash(0),
+          m_hash_epoch(0)
     {
         assert(car && cdr);
     }
 
-    object_ptr_t cons_cell::car() const
+    cons_cell::~cons_cell()
+    {
+        object_ptr_t next;
+        next.swap(m_cdr);
+
+        while(next.unique() && typeid(*next) == typeid(cons_cell)) {
+            object_ptr_t rest;
+            rest.swap(static_cast<cons_cell*>(next.get())->m_cdr);
+
+            // Destroys the cell, its cdr is empty now.
+            next.swap(rest);
+        }
+    }
+
+    const object_ptr_t& cons_cell::car() const
     {
         return m_car;
     }
 
-    object_ptr_t cons_cell::cdr() const
+    const object_ptr_t& cons_cell::cdr() const
     {
         return m_cdr;
     }
 
+    void cons_cell::set_car(const object_ptr_t& car)
+    {
+        assert(car);
+
+        m_car = car;
+    }
+
+    void cons_cell::set_cdr(const object_ptr_t& cdr)
+    {
+        assert(cdr);
+
+        m_cdr = cdr;
+    }
+
     bool cons_cell::empty() const
     {
         return m_car == nil() && m_cdr == nil();
@@ -132,23 +168,66 @@ namespace lisp {
         return true;
     }
 
+    std::size_t cons_cell::hash() const
+    {
+        const std::size_t epoch = hash_epoch();
+
+        // A cached hash is stored before its epoch, see below.
+        if(m_hash_epoch.load(std::memory_order_acquire) == epoch)
+            return m_hash.load(std::memory_order_relaxed);
+
+        // Walk to the end of the chain or the first hashed cell.
+        std::vector<const cons_cell*> chain;
+        const cons_cell* cell = this;
+        std::size_t seed;
+
+        for(;;) {
+            chain.push_back(cell);
+
+            const cons_cell* next = exact_cast<cons_cell>(cell->m_cdr);
+
+            if(!next) {
+                seed = sxhash(cell->m_cdr);
+                break;
+            }
+
+            if(next->m_hash_epoch.load(std::memory_order_acquire) == epoch) {
+                seed = next->m_hash.load(std::memory_order_relaxed);
+                break;
+            }
+
+            cell = next;
+        }
+
+        // Threads hashing the same list in the same epoch store the
+        // same values.
+        for(std::vector<const cons_cell*>::reverse_iterator it = chain.rbegin();
+            it != chain.rend(); ++it) {
+            boost::hash_combine(seed, sxhash((*it)->m_car));
+
+            (*it)->m_hash.store(seed, std::memory_order_relaxed);
+            (*it)->m_hash_epoch.store(epoch, std::memory_order_release);
+        }
+
+        return seed;
+    }
+
     std::string cons_cell::str() const
     {
         std::stringstream os;
 
         os << "(" << m_car->str();
 
-        if(m_cdr->is_cons_cell()) {
-            cons_cell_ptr_t cell = boost::dynamic_pointer_cast<cons_cell>(m_cdr);
+        const cons_cell* cell = this;
 
-            while(cell && *cell) {
-                os << " " << cell->car()->str();
+        while(const cons_cell* next = exact_cast<cons_cell>(cell->m_cdr)) {
+            os << " " << next->m_car->str();
 
-                cell = boost::dynamic_pointer_cast<lisp::cons_cell>(cell->cdr());
-            }
+            cell = next;
         }
-        else if(m_cdr != nil())
-            os << " . " << m_cdr->str();
+
+        if(cell->m_cdr != nil())
+            os << " . " << cell->m_cdr->str();
 
         os << ")";
 
@@ -157,6 +236,9 @@ namespace lisp {
 
     object_ptr_t cons_cell::eval(environment* env)
     {
+        if(m_analyzed)
+            return m_analyzed->eval(env);
+
         object_ptr_t func = m_car;
 
         if(m_car->is_cons_cell()) {
@@ -167,32 +249,74 @@ namespace lisp {
                 func = env->eval(car_cell);
         }
 
-        return env->funcall(func, cons_cell_ptr_t(
-                                new cons_cell(m_car, m_cdr)));
+        return env->funcall(func, shared_from_this());
+    }
+
+    symbol::~symbol()
+    {
+        delete m_function.load(std::memory_order_relaxed);
+    }
+
+    object_ptr_t symbol::raw_function() const
+    {
+        if(!m_shared) {
+            const function_cell* cell = m_function.load(std::memory_order_relaxed);
+
+            return cell ? cell->function : object_ptr_t();
+        }
+
+        epoch::read_guard guard;
+        const function_cell* cell = m_function.load();
+
+        return cell ? cell->function : object_ptr_t();
     }
 
     object_ptr_t symbol::value() const
     {
-        if(!m_value)
+        object_ptr_t value = raw_value();
+
+        if(!value)
             signal(m_env->get_symbol("void-variable"), m_name);
 
-        return m_value;
+        return value;
     }
 
     object_ptr_t symbol::function() const
     {
-        if(!m_function)
+        const object_ptr_t function = raw_function();
+
+        if(!function)
             signal(m_env->get_symbol("void-function"), m_name);
 
-        return m_function;
+        return function;
+    }
+
+    void symbol::set_function(object_ptr_t obj)
+    {
+        function_cell* cell = new function_cell(obj);
+        function_cell* previous = m_function.exchange(cell);
+
+        if(m_shared && previous)
+            runtime::current().retired().retire([previous]() { delete previous; });
+        else
+            delete previous;
+
+        // Published before the version changes, see
+        // runtime::has_local_functions().
+        if(m_env && m_env->function_scope() != m_env)
+            runtime::current().local_function_defined();
+
+        runtime::current().definitions_changed();
     }
 
     bool symbol::is_useless() const
     {
         assert(m_property_list);
 
+        const object_ptr_t function = raw_function();
+
         if((!m_value || m_value == nil()) &&
-           (!m_function || m_function == nil()) && m_property_list == nil())
+           (!function || function == nil()) && m_property_list == nil())
            //&& !m_gc_flag)
             return true;
 
@@ -202,14 +326,19 @@ namespace lisp {
     object_ptr_t symbol::operator()(environment* env,
                             const cons_cell_ptr_t args)
     {
-        if(m_function && *m_function)
-            return env->funcall(m_function, args);
+        const object_ptr_t function = raw_function();
+
+        if(function && *function)
+            return env->funcall(function, args);
         else
             return object_ptr_t();
     }
 
     object_ptr_t symbol_ref::eval(environment* env)
     {
+        if(is_keyword())
+            return object_ptr_t();
+
         symbol_ptr_t sym = env->get_symbol(m_name);
 
         return env->eval(sym);
@@ -218,9 +347,12 @@ namespace lisp {
     object_ptr_t symbol_ref::operator()(environment* env,
                                         const cons_cell_ptr_t args)
     {
-        symbol_ptr_t sym = env->get_symbol(m_name);
+        object_ptr_t func = env->get_function(m_name);
 
-        return (*sym)(env, args);
+        if(func)
+            return env->funcall(func, args);
+        else
+            return object_ptr_t();
     }
 
     void environment::deleter::operator()(symbol* sym)
@@ -231,14 +363,37 @@ namespace lisp {
         }
     }
 
-    environment::environment(environment* parent)
-        : m_parent(parent)
+    environment::environment(environment* parent, bool overlay)
+        : m_global_symbols(parent ? 0 : new concurrent_symbol_table),
+          m_parent(parent),
+          m_overlay(overlay),
+          m_function_scope(!parent || overlay ? this : parent->m_function_scope)
     {
+        assert(parent || !overlay);
+
+        eval_stats::count(eval_stats::environments);
     }
 
     environment::~environment()
     {
+        if(m_global_symbols) {
+            m_global_symbols->for_each([](symbol* sym) {
+                    // Functions looked up through this environment
+                    // vanish.
+                    if(sym->raw_function())
+                        runtime::current().definitions_changed();
+
+                    delete sym;
+                });
+
+            return;
+        }
+
         BOOST_FOREACH(symbol_table_t::value_type& c, m_symbols) {
+            // Functions looked up through this environment vanish.
+            if(c.second.first->raw_function())
+                runtime::current().definitions_changed();
+
             if(m_parent && c.second.second > 0)
                 // Enable closures and append to parent.
                 c.second.first->set_env(m_parent);
@@ -251,51 +406,48 @@ namespace lisp {
 
     symbol_ptr_t environment::create_symbol(const std::string& name)
     {
-        symbol_table_t::iterator iter = m_symbols.find(name);
-        symbol* sym_ptr = 0;
-
-        if(iter == m_symbols.end()) {
-            // Allocate memory for a new symbol.
-            sym_ptr = new symbol(this, name);
-
-            symbol_entry_t sym_entry(sym_ptr, 1);
-
-            m_symbols.insert(m_symbols.begin(),
-                             std::pair<std::string, symbol_entry_t>(name, sym_entry));
-        }
-        else
+        if(find_own_symbol(name))
             // Invalid usage of the method.
             throw std::logic_error("symbol already exists: " + name);
 
-        symbol_ptr_t new_sym = symbol_ptr_t(sym_ptr, deleter());
+        symbol_ptr_t new_sym = symbol_ptr_t(insert_symbol(name), deleter());
 
         return new_sym;
     }
 
     symbol_ptr_t environment::get_symbol(const std::string& name)
     {
+        if(m_global_symbols) {
+            // Global symbols aren't reference counted.
+            symbol* sym_ptr = m_global_symbols->find(name);
+
+            if(sym_ptr)
+                eval_stats::count(eval_stats::symbol_hits);
+            else {
+                eval_stats::count(eval_stats::symbol_creations);
+                sym_ptr = insert_symbol(name);
+            }
+
+            return symbol_ptr_t(sym_ptr, deleter());
+        }
+
         symbol_table_t::iterator iter = m_symbols.find(name);
         symbol* sym_ptr = 0;
 
         if(iter == m_symbols.end()) {
-            if(m_parent) {
-                // Check parent.
-
-                symbol_ptr_t sym = m_parent->get_symbol(name);
-
-                if(sym)
-                    return sym;
+            // Check parent. An overlay doesn't add new symbols to
+            // the environment it shares.
+            if(m_parent && (!m_overlay || m_parent->find_symbol(name))) {
+                eval_stats::count(eval_stats::symbol_parent_walks);
+                return m_parent->get_symbol(name);
             }
 
-            // Allocate memory for a new symbol.
-            sym_ptr = new symbol(this, name);
-
-            symbol_entry_t sym_entry(sym_ptr, 1);
-
-            m_symbols.insert(m_symbols.begin(),
-                             std::pair<std::string, symbol_entry_t>(name, sym_entry));
+            eval_stats::count(eval_stats::symbol_creations);
+            sym_ptr = insert_symbol(name);
         }
         else {
+            eval_stats::count(eval_stats::symbol_hits);
+
             // Increase ref_count.
             ++entry_refcount(iter);
 
@@ -307,8 +459,126 @@ namespace lisp {
         return new_sym;
     }
 
+    symbol_ptr_t environment::get_writable_symbol(const std::string& name)
+    {
+        for(environment* env = this; env; env = env->m_parent) {
+            if(env->find_own_symbol(name))
+                return env->get_symbol(name);
+
+            if(env->m_overlay) {
+                symbol* shared = env->m_parent->find_symbol(name);
+
+                if(!shared)
+                    return env->get_symbol(name);
+
+                // Copy on write.
+                symbol* copy = env->insert_symbol(name);
+
+                copy->m_value = shared->raw_value();
+                copy->m_function.store(new symbol::function_cell(shared->raw_function()),
+                                       std::memory_order_relaxed);
+                copy->m_property_list = shared->m_property_list;
+
+                return symbol_ptr_t(copy, deleter());
+            }
+        }
+
+        return get_symbol(name);
+    }
+
+    std::vector<symbol_ptr_t> environment::capture_bindings(
+        const environment* env, object_ptr_t (*copy)(const object_ptr_t&))
+    {
+        std::vector<symbol_ptr_t> bindings;
+
+        // The innermost binding of a name shadows the outer ones.
+        for(; env && !env->m_global_symbols; env = env->m_parent) {
+            BOOST_FOREACH(const symbol_table_t::value_type& c, env->m_symbols) {
+                if(find_own_symbol(c.first))
+                    continue;
+
+                symbol_ptr_t sym = create_symbol(c.first);
+                object_ptr_t value = c.second.first->raw_value();
+
+                if(value)
+                    sym->set_value(copy ? copy(value) : value);
+
+                bindings.push_back(sym);
+            }
+        }
+
+        return bindings;
+    }
+
+    void environment::for_each_own_symbol(const std::function<void(const symbol& sym)>& f) const
+    {
+        if(m_global_symbols) {
+            m_global_symbols->for_each([&f](const symbol* sym) { f(*sym); });
+            return;
+        }
+
+        BOOST_FOREACH(const symbol_table_t::value_type& c, m_symbols)
+            f(*c.second.first);
+    }
+
+    symbol* environment::find_symbol(const std::string& name) const
+    {
+        for(const environment* env = this; env; env = env->m_parent) {
+            if(symbol* sym = env->find_own_symbol(name))
+                return sym;
+        }
+
+        return 0;
+    }
+
+    symbol* environment::find_own_symbol(const std::string& name) const
+    {
+        if(m_global_symbols)
+            return m_global_symbols->find(name);
+
+        symbol_table_t::const_iterator iter = m_symbols.find(name);
+
+        return iter != m_symbols.end() ? iter->second.first : 0;
+    }
+
+    symbol* environment::insert_symbol(const std::string& name)
+    {
+        if(m_global_symbols) {
+            symbol* sym_ptr = new symbol(this, name, true);
+            symbol* interned = m_global_symbols->insert(name, sym_ptr);
+
+            if(interned != sym_ptr)
+                delete sym_ptr;
+
+            return interned;
+        }
+
+        symbol* sym_ptr = new symbol(this, name);
+
+        m_symbols.insert(std::make_pair(name, symbol_entry_t(sym_ptr, 1)));
+
+        return sym_ptr;
+    }
+
+    object_ptr_t environment::get_function(const std::string& name) const
+    {
+        for(const environment* env = this; env; env = env->m_parent) {
+            if(const symbol* sym = env->find_own_symbol(name)) {
+                const object_ptr_t func = sym->raw_function();
+
+                if(func && *func)
+                    return func;
+            }
+        }
+
+        return object_ptr_t();
+    }
+
     void environment::del_ref(const std::string& name) 
     {
+        if(m_global_symbols)
+            return;
+
         symbol_table_t::iterator iter = m_symbols.find(name);
 
         if(iter == m_symbols.end())
@@ -318,8 +588,11 @@ namespace lisp {
 
         --entry_refcount(iter);
 
-        // Refcount is 0 -> Do garbage collection.
-        if(entry_refcount(iter) <= 0 && entry_pointer(iter)->is_useless()) {
+        // Refcount is 0 -> Do garbage collection. Symbols of an
+        // overlay that shadow a parent's symbol are kept, otherwise
+        // the parent's value would show through again.
+        if(entry_refcount(iter) <= 0 && entry_pointer(iter)->is_useless() &&
+           !(m_overlay && m_parent->find_symbol(name))) {
             delete entry_pointer(iter);
 
             m_symbols.erase(iter);
@@ -328,6 +601,8 @@ namespace lisp {
 
     object_ptr_t environment::eval(object_ptr_t obj)
     {
+        eval_stats::count(eval_stats::evals);
+
         object_ptr_t r = obj->eval(this);
 
         if(r)
@@ -338,6 +613,8 @@ namespace lisp {
 
     object_ptr_t environment::funcall(object_ptr_t obj, const cons_cell_ptr_t args)
     {
+        eval_stats::count(eval_stats::funcalls);
+
         object_ptr_t r = (*obj)(this, args);
 
         if(r)
@@ -6,7 +6,12 @@
 #include <map>
 #include <sstream>
 
+#include <atomic>
+#include <functional>
+
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
 
 #include "types.hpp"
 
@@ -14,14 +19,28 @@
 namespace lisp {
     /**
        @brief Represents the nil object. Always returns the
-       pointer to same object. @c nil is unique.
+       pointer to same object. @c nil is unique within the current
+       runtime (see runtime::current()).
     */
     const object_ptr_t nil();
 
     const object_ptr_t t();
 
+    /**
+       @brief The global environment of the current runtime.
+    */
     environment* global_env();
 
+    /**
+       @brief Returns the version of the function definitions.
+
+       It is increased whenever the content of a function cell
+       changes or a symbol holding a function is destroyed. Function
+       objects that were looked up by name are stale if the version
+       differs.
+    */
+    unsigned long definition_version();
+
 
     /**
        @brief Special t-object that does nothing but
@@ -40,7 +59,7 @@ namespace lisp {
                 return "t";
             }
 
-        friend const object_ptr_t t();
+        friend class runtime;
 
     private:
         t_object()
@@ -62,11 +81,11 @@ namespace lisp {
                 return "nil";
             }
 
-        friend const object_ptr_t nil();
+        friend class runtime;
 
     private:
         // Make it impossible to instantiate an
-        // object without using the nil() function.
+        // object outside of a runtime.
         nil_object()
             : object()
             {
@@ -78,15 +97,38 @@ namespace lisp {
 
        Used for building lists for example.
     */
-    class cons_cell : public object
+    class cons_cell : public object,
+                      public boost::enable_shared_from_this<cons_cell>
     {
     public:
+        friend class list_builder;
+
         cons_cell(object_ptr_t car = nil(),
                   object_ptr_t cdr = nil());
 
-        object_ptr_t car() const;
+        /**
+           Releases the cells of the cdr chain that aren't shared in
+           a loop, so destroying a long list doesn't recurse.
+        */
+        ~cons_cell();
+
+        const object_ptr_t& car() const;
+
+        const object_ptr_t& cdr() const;
+
+        /**
+           @brief Replaces the car. The caller must invalidate the
+           cached hashes of all lists (see invalidate_hashes()), once
+           for all cells it changes.
+        */
+        void set_car(const object_ptr_t& car);
 
-        object_ptr_t cdr() const;
+        /**
+           @brief Replaces the cdr. The caller must invalidate the
+           cached hashes of all lists (see invalidate_hashes()), once
+           for all cells it changes.
+        */
+        void set_cdr(const object_ptr_t& cdr);
 
         bool empty() const;
 
@@ -94,12 +136,43 @@ namespace lisp {
 
         std::string str() const;
 
+        /**
+           @brief Returns the structural hash of the list starting
+           here (see sxhash()).
+
+           Computed iteratively along the cdr chain on first use and
+           cached in every cell of the chain until the next hash
+           epoch. The cache is atomic, threads sharing a list may
+           hash it concurrently as long as none of them changes it.
+        */
+        std::size_t hash() const;
+
+        /**
+           @brief Returns the analyzed form attached to the cell or
+           a null pointer if the cell wasn't analyzed.
+
+           @see analyze_toplevel().
+        */
+        const node_ptr_t& analyzed() const
+            {
+                return m_analyzed;
+            }
+
+        void set_analyzed(node_ptr_t analyzed)
+            {
+                m_analyzed = analyzed;
+            }
+
     protected:
         object_ptr_t eval(environment* env);
 
     private:
         object_ptr_t m_car;
         object_ptr_t m_cdr;
+        node_ptr_t m_analyzed;
+
+        mutable std::atomic<std::size_t> m_hash;
+        mutable std::atomic<std::size_t> m_hash_epoch;
     };
 
 
@@ -130,6 +203,13 @@ namespace lisp {
 
         object_ptr_t function() const;
 
+        /**
+           @brief Returns the content of the function cell without
+           signaling `void-function'. Is a null pointer if the cell
+           is empty.
+        */
+        object_ptr_t raw_function() const;
+
         object_ptr_t property_list() const
             {
                 assert(m_property_list);
@@ -138,12 +218,30 @@ namespace lisp {
 
         void set_value(object_ptr_t obj)
             {
-                m_value = obj;
+                if(m_shared)
+                    boost::atomic_store(&m_value, obj);
+                else
+                    m_value = obj;
             }
 
-        void set_function(object_ptr_t obj)
+        /**
+           @brief Sets the function cell and increases the
+           definition_version().
+
+           The function of a shared symbol is published atomically.
+           The replaced cell is retired (see runtime::retired()),
+           because other threads may still be reading it in
+           raw_function().
+        */
+        void set_function(object_ptr_t obj);
+
+        /**
+           @brief Indicates whether the symbol lives in a global
+           environment that several threads may share.
+        */
+        bool is_shared() const
             {
-                m_function = obj;
+                return m_shared;
             }
 
         /**
@@ -195,11 +293,13 @@ namespace lisp {
                 assert(false);
             }
 
-        symbol(environment* env, const std::string& name)
+        symbol(environment* env, const std::string& name, bool shared = false)
             : object(),
               m_name(name),
+              m_function(0),
               m_property_list(nil()),
-              m_env(env)
+              m_env(env),
+              m_shared(shared)
             {
             }
 
@@ -210,11 +310,36 @@ namespace lisp {
                 assert(false);
             }
 
+        ~symbol();
+
+        /**
+           @brief The value cell without signaling `void-variable'.
+        */
+        object_ptr_t raw_value() const
+            {
+                return m_shared ? boost::atomic_load(&m_value) : m_value;
+            }
+
+        /**
+           @brief A function cell's content. Replaced as a whole, so
+           readers can use it without locking.
+        */
+        struct function_cell
+        {
+            function_cell(const object_ptr_t& function)
+                : function(function)
+                {
+                }
+
+            object_ptr_t function;
+        };
+
         std::string m_name;
         object_ptr_t m_value;
-        object_ptr_t m_function;
+        std::atomic<function_cell*> m_function;
         object_ptr_t m_property_list;
         environment* m_env;
+        bool m_shared;
     };
 
     typedef boost::shared_ptr<symbol> symbol_ptr_t;
@@ -242,6 +367,15 @@ namespace lisp {
                 return true;
             }
 
+        /**
+           @brief Keywords like `:test' start with a colon and
+           evaluate to themselves.
+        */
+        bool is_keyword() const
+            {
+                return !m_name.empty() && m_name[0] == ':';
+            }
+
     protected:
         object_ptr_t operator()(environment* env,
                                 const cons_cell_ptr_t args = cons_cell_ptr_t());
@@ -274,6 +408,11 @@ namespace lisp {
                 return "'" + m_object->str();
             }
 
+        const object_ptr_t& quoted() const
+            {
+                return m_object;
+            }
+
     protected:
         /**
            @brief On evaluation simply return the
@@ -290,13 +429,30 @@ namespace lisp {
         object_ptr_t m_object;
     };
 
+    /**
+       @brief Signals the error @a err_sym by throwing a lisp_error
+       whose data is a list holding @a what as string.
+    */
     void signal(symbol_ptr_t err_sym, const std::string& what);
 
+    /**
+       @brief Signals the error named @a err_sym with the given data.
+    */
+    void signal(const std::string& err_sym, object_ptr_t data);
+
+    class concurrent_symbol_table;
+
     /**
        @brief Handles a symbol table and takes care
        that the symbols are destroyed if they aren't needed
        anymore.
 
+       A global environment (one without parent) keeps its symbols
+       in a concurrent_symbol_table instead: several threads may
+       look up, intern and assign its symbols at the same time, and
+       its symbols are never collected. Nested environments belong
+       to a single thread.
+
        @see symbol::is_useless().
     */
     class environment
@@ -310,7 +466,15 @@ namespace lisp {
         typedef std::pair<symbol*, int> symbol_entry_t;
         typedef std::map<std::string, symbol_entry_t> symbol_table_t;
 
-        environment(environment* parent = 0);
+        /**
+           @param parent The enclosing environment or a null pointer
+           for a global environment.
+           @param overlay Creates a copy-on-write fork of
+           @a parent instead of a nested scope (see
+           get_writable_symbol()). Creating the fork is O(1), the
+           parent's symbols are shared until they are written.
+        */
+        environment(environment* parent = 0, bool overlay = false);
         ~environment();
 
         /**
@@ -334,6 +498,56 @@ namespace lisp {
         */
         symbol_ptr_t get_symbol(const std::string& name);
 
+        /**
+           @brief Returns the symbol for assigning one of its cells
+           through setq, defun, ...
+
+           Like get_symbol(), but the lookup stops at the first
+           overlay: a symbol that only exists behind it is copied into
+           the overlay, so the write stays invisible to the parent
+           and vanishes with the overlay.
+        */
+        symbol_ptr_t get_writable_symbol(const std::string& name);
+
+        /**
+           @brief Binds the variables that are visible in @a env but
+           don't belong to a global environment to their current
+           values in this environment.
+
+           Lets this environment evaluate forms written for @a env
+           after @a env is gone, e.g. on another thread. Only values
+           are copied, later assignments on either side aren't
+           seen by the other one.
+
+           @param copy Applied to the values if given, e.g.
+           copy_message().
+           @return The created symbols. They have to be held as long
+           as they are needed and released before this environment
+           is destroyed.
+        */
+        std::vector<symbol_ptr_t> capture_bindings(
+            const environment* env, object_ptr_t (*copy)(const object_ptr_t&) = 0);
+
+        /**
+           @brief Calls @a f with every symbol of this environment,
+           not looking at its parents. Must not run concurrently with
+           the creation of symbols in this environment.
+        */
+        void for_each_own_symbol(const std::function<void(const symbol& sym)>& f) const;
+
+        /**
+           @brief Looks up the function named @a name in this
+           environment and its parents.
+
+           Symbols with an empty function cell (e.g. the parameters
+           of a function) don't hide the function of a symbol in a
+           parent environment.
+
+           @return The function object or a null pointer if there is
+           none.
+        */
+        object_ptr_t get_function(const std::string& name) const;
+
         /**
            @brief Evaluates the given object by calling the
            its eval() method and interpreting return-code.
@@ -361,12 +575,70 @@ namespace lisp {
         object_ptr_t funcall(object_ptr_t obj,
                              const cons_cell_ptr_t args = cons_cell_ptr_t());
 
+        /**
+           @brief Binds a C++ function or lambda to the function cell
+           of the named symbol.
+
+           The parameter and return types are mapped to lisp objects
+           at compile time (see native_type). Defined in
+           native_function.hpp which has to be included to use it.
+
+           @return The symbol.
+        */
+        template <typename F>
+        symbol_ptr_t defun(const std::string& name, F f);
+
+        environment* parent() const
+            {
+                return m_parent;
+            }
+
+        bool is_overlay() const
+            {
+                return m_overlay;
+            }
+
+        /**
+           @brief The nearest of this environment and its parents
+           that is global or an overlay.
+
+           Functions are defined in those, so environments with the
+           same function scope see the same functions, unless a
+           function was bound in a local environment (see
+           runtime::has_local_functions()).
+        */
+        const environment* function_scope() const
+            {
+                return m_function_scope;
+            }
+
     private:
         void del_ref(const std::string& name);
 
+        /**
+           @brief Finds the named symbol in this environment or its
+           parents without creating it.
+        */
+        symbol* find_symbol(const std::string& name) const;
+
+        /**
+           @brief Finds the named symbol in this environment only.
+        */
+        symbol* find_own_symbol(const std::string& name) const;
+
+        /**
+           @brief Adds a new symbol to this environment's table. In
+           a global environment the symbol interned by another thread
+           meanwhile is returned instead.
+        */
+        symbol* insert_symbol(const std::string& name);
+
         symbol_table_t m_symbols;
+        boost::scoped_ptr<concurrent_symbol_table> m_global_symbols;
 
         environment* m_parent;
+        bool m_overlay;
+        const environment* m_function_scope;
     };
 }
 
@@ -0,0 +1,65 @@
+#ifndef LISP_LISP_ERROR_HPP
+#define LISP_LISP_ERROR_HPP
+
+#include <stdexcept>
+
+#include "object.hpp"
+#include "arith_error.hpp"
+
+namespace lisp {
+    /**
+       @brief Thrown by signal(). Can be caught by the lisp side
+       with a condition-case form.
+    */
+    class lisp_error : public std::runtime_error
+    {
+    public:
+        /**
+           @param symbol_name The name of the error symbol,
+           e.g. `void-variable'.
+           @param data Lisp object describing the error.
+        */
+        lisp_error(const std::string& symbol_name, object_ptr_t data);
+
+        ~lisp_error() throw()
+            {
+            }
+
+        const std::string& symbol_name() const
+            {
+                return m_symbol_name;
+            }
+
+        const object_ptr_t& data() const
+            {
+                return m_data;
+            }
+
+        /**
+           @brief Returns (ERROR-SYMBOL . DATA), the value a
+           condition-case handler gets.
+        */
+        object_ptr_t value() const;
+
+        /**
+           @brief Checks whether the condition of a condition-case
+           handler catches this error.
+
+           @param condition An error symbol or a list of them. The
+           symbols `error' and `t' catch all errors.
+        */
+        bool matches(const object_ptr_t& condition) const;
+
+    private:
+        std::string m_symbol_name;
+        object_ptr_t m_data;
+    };
+
+    /**
+       @brief Converts an error of the number implementation into the
+       lisp error `arith-error'.
+    */
+    lisp_error as_lisp_error(const arith_error& err);
+}
+
+#endif  // LISP_LISP_ERROR_HPP
@@ -5,6 +5,10 @@
 #include <cstring>
 #include <fstream>
 #include <iterator>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <atomic>
 
 #include <boost/test/unit_test.hpp>
 
@@ -12,7 +16,80 @@
 #include "interpreter.hpp"
 #include "types.hpp"
 #include "function.hpp"
+#include "analyzer.hpp"
+#include "cxx_function.hpp"
+#include "lisp_error.hpp"
+#include "native_function.hpp"
+#include "equality.hpp"
+#include "hash_table.hpp"
+#include "typed_array.hpp"
+#include "runtime.hpp"
+#include "epoch.hpp"
+#include "channel.hpp"
+#include "actor.hpp"
+#include "atom.hpp"
+#include "profiler.hpp"
+#include "eval_stats.hpp"
 
+namespace {
+    // Number of calls of the global operator new.
+    std::atomic<std::size_t> allocations(0);
+}
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+
+    void* mem = std::malloc(size);
+
+    if(!mem)
+        throw std::bad_alloc();
+
+    return mem;
+}
+
+void operator delete(void* mem) throw()
+{
+    std::free(mem);
+}
+
+namespace {
+    std::string native_greeting(const std::string& name)
+    {
+        return "hello " + name;
+    }
+
+    /*
+      Compiles, analyzes and evaluates all top-level forms of
+      `script' in `env' and returns the last result.
+      With `analyze' false the forms are interpreted from the cons
+      tree.
+    */
+    lisp::object_ptr_t eval_string(lisp::environment* env, std::string script,
+                                   bool analyze = true)
+    {
+        std::string::iterator iter = script.begin();
+        lisp::tokenizer<std::string::iterator> tok(iter, script.end());
+
+        lisp::object_ptr_t result = lisp::nil();
+
+        while(tok.next_token()) {
+            lisp::object_ptr_t form = lisp::interpreter::compile_expr(env, tok);
+
+            if(analyze)
+                form = lisp::analyze_toplevel(env, form);
+
+            result = env->eval(form);
+        }
+
+        return result;
+    }
+
+    lisp::object_ptr_t eval_string(std::string script, bool analyze = true)
+    {
+        return eval_string(lisp::global_env(), script, analyze);
+    }
+}
 
 BOOST_AUTO_TEST_CASE(test_gc)
 {
@@ -132,6 +209,1225 @@ BOOST_AUTO_TEST_CASE(test_interpreter)
                                                     new lisp::number(4.5)))))));
 }
 
+BOOST_AUTO_TEST_CASE(test_analyzer)
+{
+    BOOST_CHECK_EQUAL(eval_string("(defun analyzer-square (x) (* x x))"
+                                  "(analyzer-square 7)")->str(), "49");
+
+    BOOST_CHECK_EQUAL(eval_string("((lambda (a b) (if a b 'else)) nil 1)")->str(),
+                      "else");
+    BOOST_CHECK_EQUAL(eval_string("(and 1 (or nil 2))")->str(), "2");
+
+    eval_string("(setq analyzer-var \"value\")");
+    BOOST_CHECK_EQUAL(eval_string("analyzer-var")->str(), "\"value\"");
+
+    // The analysis is attached to the top-level form and reused.
+    std::string script("(if analyzer-var analyzer-var 'no)");
+    std::string::iterator iter = script.begin();
+    lisp::tokenizer<std::string::iterator> tok(iter, script.end());
+    tok.next_token();
+
+    lisp::object_ptr_t form = lisp::analyze_toplevel(
+        lisp::global_env(), lisp::interpreter::compile_expr(lisp::global_env(), tok));
+
+    BOOST_CHECK(boost::dynamic_pointer_cast<lisp::cons_cell>(form)->analyzed());
+    BOOST_CHECK_EQUAL(lisp::global_env()->eval(form)->str(), "\"value\"");
+
+    eval_string("(setq analyzer-var 'other)");
+    BOOST_CHECK_EQUAL(lisp::global_env()->eval(form)->str(), "other");
+}
+
+class zerop : public lisp::cxx_function
+{
+protected:
+    lisp::object_ptr_t operator()(lisp::environment*, const argv_t& args)
+        {
+            lisp::number_ptr_t num = boost::dynamic_pointer_cast<lisp::number>(args[0]);
+
+            return *num == lisp::number(0LL) ? lisp::t() : lisp::nil();
+        }
+};
+
+class environment_depth : public lisp::cxx_function
+{
+protected:
+    lisp::object_ptr_t operator()(lisp::environment* env, const argv_t&)
+        {
+            long long depth = 0;
+
+            for(; env->parent(); env = env->parent())
+                ++depth;
+
+            return lisp::object_ptr_t(new lisp::number(depth));
+        }
+};
+
+BOOST_AUTO_TEST_CASE(test_tail_calls)
+{
+    lisp::global_env()->get_symbol("tail-zerop")->set_function(
+        lisp::object_ptr_t(new zerop()));
+
+    // Both loops would overflow the C++ stack without tail calls.
+    eval_string("(defun tail-count (n) (if (tail-zerop n) 'done (tail-count (- n 1))))");
+    BOOST_CHECK_EQUAL(eval_string("(tail-count 100000)")->str(), "done");
+
+    eval_string("(defun tail-even (n) (or (tail-zerop n) (tail-odd (- n 1))))"
+                "(defun tail-odd (n) (if (tail-zerop n) nil (tail-even (- n 1))))");
+    BOOST_CHECK_EQUAL(eval_string("(tail-even 100000)")->str(), "t");
+    BOOST_CHECK_EQUAL(eval_string("(tail-even 100001)")->str(), "nil");
+
+    // The caller's parameters stay visible to the callee.
+    eval_string("(defun tail-outer (tail-outer-var) (tail-inner))"
+                "(defun tail-inner () tail-outer-var)");
+    BOOST_CHECK_EQUAL(eval_string("(tail-outer 'dynamic)")->str(), "dynamic");
+
+    // Mutually recursive functions with different parameters run
+    // in a single frame.
+    lisp::global_env()->get_symbol("tail-depth")->set_function(
+        lisp::object_ptr_t(new environment_depth()));
+
+    eval_string("(defun tail-ping (ping-n)"
+                "  (if (tail-zerop ping-n) (tail-depth) (tail-pong (- ping-n 1))))"
+                "(defun tail-pong (pong-n) (tail-ping pong-n))");
+    BOOST_CHECK_EQUAL(eval_string("(tail-ping 100000)")->str(),
+                      eval_string("(tail-ping 0)")->str());
+
+    // Parameters the callee doesn't shadow stay visible.
+    eval_string("(defun tail-visible (a) (tail-visible-b (list a)))"
+                "(defun tail-visible-b (b) (list a b))");
+    BOOST_CHECK_EQUAL(eval_string("(tail-visible 1)")->str(), "(1 (1))");
+}
+
+BOOST_AUTO_TEST_CASE(test_builtin_allocations)
+{
+    lisp::global_env()->get_symbol("alloc-zerop")->set_function(
+        lisp::object_ptr_t(new zerop()));
+
+    std::string script("(alloc-zerop 0)");
+    std::string::iterator iter = script.begin();
+    lisp::tokenizer<std::string::iterator> tok(iter, script.end());
+    tok.next_token();
+
+    lisp::object_ptr_t form = lisp::analyze_toplevel(
+        lisp::global_env(), lisp::interpreter::compile_expr(lisp::global_env(), tok));
+
+    // Fill the call site's cache.
+    lisp::global_env()->eval(form);
+
+    std::size_t before = allocations;
+
+    for(int i = 0; i < 100; ++i)
+        BOOST_CHECK(lisp::global_env()->eval(form) == lisp::t());
+
+    BOOST_CHECK_EQUAL(allocations - before, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_inline_cache)
+{
+    eval_string("(defun cache-callee () 'first)"
+                "(defun cache-caller () (cache-callee))");
+    BOOST_CHECK_EQUAL(eval_string("(cache-caller)")->str(), "first");
+    BOOST_CHECK_EQUAL(eval_string("(cache-caller)")->str(), "first");
+
+    // Redefinitions invalidate the cached function.
+    eval_string("(defun cache-callee () 'second)");
+    BOOST_CHECK_EQUAL(eval_string("(cache-caller)")->str(), "second");
+
+    eval_string("(fset 'cache-callee (lambda () 'third))");
+    BOOST_CHECK_EQUAL(eval_string("(cache-caller)")->str(), "third");
+
+    // Parameters don't hide functions of the same name.
+    eval_string("(defun cache-shadow (cache-callee) (cache-callee))");
+    BOOST_CHECK_EQUAL(eval_string("(cache-shadow 1)")->str(), "third");
+
+    // A function bound to a parameter is seen by the callees only.
+    lisp::runtime rt;
+    lisp::runtime::scope scope(rt);
+
+    eval_string("(defun cache-callee () 'global)"
+                "(defun cache-caller () (cache-callee))"
+                "(defun cache-local (cache-callee)"
+                "  (fset 'cache-callee (lambda () 'local))"
+                "  (cache-caller))");
+    BOOST_CHECK_EQUAL(eval_string("(cache-caller)")->str(), "global");
+    BOOST_CHECK_EQUAL(eval_string("(cache-local 1)")->str(), "local");
+    BOOST_CHECK_EQUAL(eval_string("(cache-caller)")->str(), "global");
+}
+
+BOOST_AUTO_TEST_CASE(test_conditions)
+{
+    for(int analyze = 0; analyze < 2; ++analyze) {
+        BOOST_CHECK_EQUAL(
+            eval_string("(condition-case err no-such-variable (void-variable err))",
+                        analyze)->str(),
+            "(void-variable \"no-such-variable\")");
+        BOOST_CHECK_EQUAL(
+            eval_string("(condition-case nil (signal 'my-error nil)"
+                        "  (other-error 'other) ((foo my-error) 'mine))", analyze)->str(),
+            "mine");
+        BOOST_CHECK_EQUAL(
+            eval_string("(condition-case nil (/ 1 0) (arith-error 'arith))", analyze)->str(),
+            "arith");
+        BOOST_CHECK_EQUAL(
+            eval_string("(condition-case nil (signal 'my-error nil) (error 'any))",
+                        analyze)->str(),
+            "any");
+        BOOST_CHECK_EQUAL(
+            eval_string("(condition-case nil 'value (error 'any))", analyze)->str(),
+            "value");
+        BOOST_CHECK_THROW(
+            eval_string("(condition-case nil (signal 'my-error nil) (other-error 1))",
+                        analyze),
+            lisp::lisp_error);
+
+        eval_string("(setq unwind-state 'before)");
+        BOOST_CHECK_EQUAL(
+            eval_string("(condition-case nil"
+                        "  (unwind-protect (signal 'my-error '(1 2)) (setq unwind-state 'cleaned))"
+                        "  (my-error unwind-state))", analyze)->str(),
+            "cleaned");
+        BOOST_CHECK_EQUAL(
+            eval_string("(unwind-protect 'value (setq unwind-state 'done))", analyze)->str(),
+            "value");
+        BOOST_CHECK_EQUAL(eval_string("unwind-state")->str(), "done");
+    }
+
+    try {
+        eval_string("(signal 'my-error '(1 2))");
+        BOOST_ERROR("signal didn't throw");
+    }
+    catch(const lisp::lisp_error& err) {
+        BOOST_CHECK_EQUAL(err.symbol_name(), "my-error");
+        BOOST_CHECK_EQUAL(err.data()->str(), "(1 2)");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_native_functions)
+{
+    int calls = 0;
+
+    lisp::global_env()->defun("native-scale", [](long long a, double b) { return a * b; });
+    lisp::global_env()->defun("native-greeting", native_greeting);
+    lisp::global_env()->defun("native-count", [&calls]() { ++calls; });
+    lisp::global_env()->defun("native-positive-p",
+                              [](const lisp::number& num) { return num > lisp::number(0LL); });
+    lisp::global_env()->defun("native-negate", [](int a) { return -a; });
+
+    BOOST_CHECK_EQUAL(eval_string("(native-scale 3 1.5)")->str(), "4.5");
+    BOOST_CHECK_EQUAL(eval_string("(native-greeting \"lisp\")")->str(), "\"hello lisp\"");
+    BOOST_CHECK(eval_string("(native-count)") == lisp::nil());
+    BOOST_CHECK_EQUAL(calls, 1);
+    BOOST_CHECK(eval_string("(native-positive-p 1/2)") == lisp::t());
+    BOOST_CHECK(eval_string("(native-positive-p -2)") == lisp::nil());
+
+    // The unanalyzed path reaches the same builtin.
+    BOOST_CHECK_EQUAL(eval_string("(native-scale 2 2)", false)->str(), "4");
+
+    BOOST_CHECK_THROW(eval_string("(native-scale 1)"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(native-scale 1 2 3)"), lisp::lisp_error);
+
+    try {
+        eval_string("(native-scale 1.5 2)");
+        BOOST_ERROR("wrong argument type not signaled");
+    }
+    catch(const lisp::lisp_error& err) {
+        BOOST_CHECK_EQUAL(err.symbol_name(), "wrong-type-argument");
+        BOOST_CHECK_EQUAL(err.data()->str(), "(integerp 1.5)");
+    }
+
+    // Integers beyond an int don't wrap.
+    BOOST_CHECK_EQUAL(eval_string("(native-negate 2147483647)")->str(), "-2147483647");
+
+    try {
+        eval_string("(native-negate 4294967297)");
+        BOOST_ERROR("integer out of range not signaled");
+    }
+    catch(const lisp::lisp_error& err) {
+        BOOST_CHECK_EQUAL(err.symbol_name(), "args-out-of-range");
+        BOOST_CHECK_EQUAL(err.data()->str(), "(4294967297)");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_arithmetic)
+{
+    BOOST_CHECK_EQUAL(eval_string("(+ 1 2 3)")->str(), "6");
+    BOOST_CHECK_EQUAL(eval_string("(- 10 1 2)")->str(), "7");
+    BOOST_CHECK_EQUAL(eval_string("(* 2 3 4)")->str(), "24");
+    BOOST_CHECK_EQUAL(eval_string("(/ 12 3 2)")->str(), "2");
+    BOOST_CHECK_EQUAL(eval_string("(/ 1 2)")->str(), "1/2");
+    BOOST_CHECK_EQUAL(eval_string("(/ 12 3 8)")->str(), "1/2");
+    BOOST_CHECK_EQUAL(eval_string("(+ 1 1/2 1/2)")->str(), "2/1");
+    BOOST_CHECK_EQUAL(eval_string("(+ 1 1/2 0.5)")->str(), "2");
+    BOOST_CHECK_EQUAL(eval_string("(* 0.5 4)")->str(), "2");
+    BOOST_CHECK_THROW(eval_string("(/ 1 0)"), lisp::arith_error);
+    BOOST_CHECK_THROW(eval_string("(+ 1 \"2\")"), lisp::lisp_error);
+
+    // Longs beyond the ints of fractions are divided as doubles.
+    BOOST_CHECK_EQUAL(eval_string("(/ 4294967297 2)")->str(), "2147483648.5");
+    BOOST_CHECK_EQUAL(eval_string("(/ 3 4294967296)")->str(),
+                      lisp::number(3.0 / 4294967296.0).str());
+    BOOST_CHECK_EQUAL(eval_string("(+ 1/2 4294967296)")->str(), "4294967296.5");
+    BOOST_CHECK_EQUAL(eval_string("(/ 8589934592 2)")->str(), "4294967296");
+
+    // Results beyond a long continue as doubles instead of wrapping
+    // or trapping.
+    BOOST_CHECK_EQUAL(eval_string("(/ -9223372036854775808 -1)")->str(),
+                      lisp::number(9223372036854775808.0).str());
+    BOOST_CHECK_EQUAL(eval_string("(/ 1/2 -9223372036854775808 -1)")->str(),
+                      lisp::number(0.5 / -9223372036854775808.0 / -1).str());
+    BOOST_CHECK_EQUAL(eval_string("(+ 9223372036854775807 1)")->str(),
+                      lisp::number(9223372036854775808.0).str());
+    BOOST_CHECK_EQUAL(eval_string("(- -9223372036854775808 1 -1)")->str(),
+                      lisp::number(-9223372036854775808.0).str());
+    BOOST_CHECK_EQUAL(eval_string("(* 4294967296 4294967296 1/2)")->str(),
+                      lisp::number(9223372036854775808.0).str());
+    BOOST_CHECK_EQUAL(eval_string("(* -4294967296 2147483648)")->str(), "-9223372036854775808");
+
+    // Neither literals nor variable values are modified.
+    eval_string("(defun arith-literal () (+ 1 2))"
+                "(setq arith-x 5)");
+    BOOST_CHECK_EQUAL(eval_string("(arith-literal)")->str(), "3");
+    BOOST_CHECK_EQUAL(eval_string("(arith-literal)")->str(), "3");
+    BOOST_CHECK_EQUAL(eval_string("(+ arith-x 1)")->str(), "6");
+    BOOST_CHECK_EQUAL(eval_string("(/ arith-x 2)")->str(), "5/2");
+    BOOST_CHECK_EQUAL(eval_string("arith-x")->str(), "5");
+
+    // The result is the only allocation.
+    std::string script = "(+ 1 2 3 4 5 6 7 8)";
+    std::string::iterator iter = script.begin();
+    lisp::tokenizer<std::string::iterator> tok(iter, script.end());
+    tok.next_token();
+    lisp::object_ptr_t form = lisp::analyze_toplevel(
+        lisp::global_env(), lisp::interpreter::compile_expr(lisp::global_env(), tok));
+
+    // Fills the inline cache of the call.
+    lisp::global_env()->eval(form);
+
+    std::size_t before = allocations;
+    lisp::object_ptr_t result = lisp::global_env()->eval(form);
+    std::size_t count = allocations - before;
+
+    BOOST_CHECK_EQUAL(result->str(), "36");
+    // The number and the control block of its shared_ptr.
+    BOOST_CHECK_EQUAL(count, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(test_comparisons)
+{
+    BOOST_CHECK(eval_string("(= 1 1 1)") == lisp::t());
+    BOOST_CHECK(eval_string("(= 1 1 2)") == lisp::nil());
+    BOOST_CHECK(eval_string("(= 1/2 0.5)") == lisp::t());
+    BOOST_CHECK(eval_string("(< 1 2 3)") == lisp::t());
+    BOOST_CHECK(eval_string("(< 1 3 2)") == lisp::nil());
+    BOOST_CHECK(eval_string("(< 0.4 1/2 1)") == lisp::t());
+    BOOST_CHECK(eval_string("(> 3 2 1/2)") == lisp::t());
+    BOOST_CHECK(eval_string("(<= 1 1 2)") == lisp::t());
+    BOOST_CHECK(eval_string("(>= 2 2 3)") == lisp::nil());
+    BOOST_CHECK(eval_string("(< 5)") == lisp::t());
+    BOOST_CHECK(eval_string("(/= 1 2 3)") == lisp::t());
+    BOOST_CHECK(eval_string("(/= 1 2 1)") == lisp::nil());
+
+    // Longs beyond an int or whose product with the denominator
+    // exceeds one.
+    BOOST_CHECK(eval_string("(< 4294967296 1/2)") == lisp::nil());
+    BOOST_CHECK(eval_string("(> 4294967296 1/2)") == lisp::t());
+    BOOST_CHECK(eval_string("(< -4294967296 1/2 4294967296)") == lisp::t());
+    BOOST_CHECK(eval_string("(= 4294967296 1/2)") == lisp::nil());
+    BOOST_CHECK(eval_string("(< 100000 (/ 1 100000))") == lisp::nil());
+    BOOST_CHECK(eval_string("(> (/ 1 100000) -100000)") == lisp::t());
+
+    // Stops at the first failing pair.
+    BOOST_CHECK(eval_string("(< 2 1 \"no number\")") == lisp::nil());
+    BOOST_CHECK_THROW(eval_string("(< 1 2 \"no number\")"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(<)"), lisp::lisp_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_equality)
+{
+    BOOST_CHECK(eval_string("(eq 'a 'a)") == lisp::t());
+    BOOST_CHECK(eval_string("(eq 1 1)") == lisp::nil());
+    BOOST_CHECK(eval_string("(eql 1 1)") == lisp::t());
+    BOOST_CHECK(eval_string("(eql 1 1.0)") == lisp::nil());
+    BOOST_CHECK(eval_string("(eql \"a\" \"a\")") == lisp::nil());
+    BOOST_CHECK(eval_string("(equal \"a\" \"a\")") == lisp::t());
+    BOOST_CHECK(eval_string("(equal \"a\" \"b\")") == lisp::nil());
+    BOOST_CHECK(eval_string("(equal 1/2 2/4)") == lisp::t());
+    BOOST_CHECK(eval_string("(equal '(1 (2 \"x\") 'c) '(1 (2 \"x\") 'c))") == lisp::t());
+    BOOST_CHECK(eval_string("(equal '(1 (2 \"x\")) '(1 (2 \"y\")))") == lisp::nil());
+    BOOST_CHECK(eval_string("(equal '(1 2) '(1 2 3))") == lisp::nil());
+    BOOST_CHECK(eval_string("(= (sxhash '(a \"b\" 3)) (sxhash '(a \"b\" 3)))") == lisp::t());
+
+    // Long lists are compared along the cdr chain without recursion.
+    lisp::object_ptr_t long_a = lisp::nil();
+    lisp::object_ptr_t long_b = lisp::nil();
+
+    for(int i = 0; i < 10000; ++i) {
+        long_a.reset(new lisp::cons_cell(lisp::object_ptr_t(new lisp::number(1LL)), long_a));
+        long_b.reset(new lisp::cons_cell(lisp::object_ptr_t(new lisp::number(1LL)), long_b));
+    }
+
+    BOOST_CHECK(lisp::equal(long_a, long_b));
+    BOOST_CHECK_EQUAL(lisp::sxhash(long_a), lisp::sxhash(long_b));
+
+    long_b.reset(new lisp::cons_cell(lisp::object_ptr_t(new lisp::number(1LL)), long_b));
+    BOOST_CHECK(!lisp::equal(long_a, long_b));
+}
+
+BOOST_AUTO_TEST_CASE(test_hash_tables)
+{
+    eval_string("(setq eq-table (make-hash-table :test 'eq))"
+                "(setq eql-table (make-hash-table))"
+                "(setq equal-table (make-hash-table :test 'equal :size 100))"
+                "(setq shared-key \"key\")");
+
+    const char* tables[] = { "eq-table", "eql-table", "equal-table" };
+
+    for(int i = 0; i < 3; ++i) {
+        std::string table = tables[i];
+
+        eval_string("(puthash 'a 1 " + table + ")"
+                    "(puthash shared-key 2 " + table + ")"
+                    "(puthash 1 3 " + table + ")"
+                    "(puthash '(1 \"x\") 4 " + table + ")");
+
+        BOOST_CHECK_EQUAL(eval_string("(gethash 'a " + table + ")")->str(), "1");
+        BOOST_CHECK_EQUAL(eval_string("(gethash shared-key " + table + ")")->str(), "2");
+        BOOST_CHECK_EQUAL(eval_string("(hash-table-count " + table + ")")->str(), "4");
+        BOOST_CHECK_EQUAL(eval_string("(gethash 'missing " + table + " 'default)")->str(),
+                          "default");
+    }
+
+    // Keys that are only eql or equal.
+    BOOST_CHECK(eval_string("(gethash 1 eq-table)") == lisp::nil());
+    BOOST_CHECK_EQUAL(eval_string("(gethash 1 eql-table)")->str(), "3");
+    BOOST_CHECK(eval_string("(gethash \"key\" eql-table)") == lisp::nil());
+    BOOST_CHECK_EQUAL(eval_string("(gethash \"key\" equal-table)")->str(), "2");
+    BOOST_CHECK(eval_string("(gethash '(1 \"x\") eql-table)") == lisp::nil());
+    BOOST_CHECK_EQUAL(eval_string("(gethash '(1 \"x\") equal-table)")->str(), "4");
+
+    eval_string("(puthash 'a 10 equal-table)"
+                "(remhash 1 equal-table)"
+                "(setq hash-sum 0)"
+                "(maphash (lambda (k v) (setq hash-sum (+ hash-sum v))) equal-table)");
+    BOOST_CHECK_EQUAL(eval_string("(hash-table-count equal-table)")->str(), "3");
+    BOOST_CHECK_EQUAL(eval_string("hash-sum")->str(), "16");
+    BOOST_CHECK_THROW(eval_string("(gethash 1 '(1 2))"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(make-hash-table :test 'foo)"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(make-hash-table :size -1)"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(make-hash-table :size 1/2)"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(make-hash-table :size 9223372036854775807)"), lisp::lisp_error);
+    BOOST_CHECK_EQUAL(eval_string("(hash-table-count (make-hash-table :size 0))")->str(), "0");
+
+    // Growing and removing keep all entries reachable.
+    lisp::hash_table table(lisp::hash_table::TEST_EQUAL);
+    std::vector<lisp::object_ptr_t> keys;
+
+    for(int i = 0; i < 20000; ++i) {
+        keys.push_back(lisp::object_ptr_t(new lisp::string(lisp::to_string(i))));
+        table.put(keys.back(), keys.back());
+    }
+
+    for(int i = 0; i < 20000; i += 2)
+        BOOST_CHECK(table.remove(lisp::object_ptr_t(new lisp::string(lisp::to_string(i)))));
+
+    BOOST_CHECK_EQUAL(table.count(), 10000u);
+
+    for(int i = 0; i < 20000; ++i) {
+        lisp::object_ptr_t value = table.get(
+            lisp::object_ptr_t(new lisp::string(lisp::to_string(i))));
+
+        if(i % 2 == 0)
+            BOOST_CHECK(!value);
+        else
+            BOOST_CHECK(value == keys[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_vectors)
+{
+    BOOST_CHECK_EQUAL(eval_string("#(1 \"two\" (3 4))")->str(), "#(1 \"two\" (3 4))");
+    BOOST_CHECK_EQUAL(eval_string("(make-vector 3 'x)")->str(), "#(x x x)");
+    BOOST_CHECK_EQUAL(eval_string("(vector 1 (+ 1 1))")->str(), "#(1 2)");
+
+    eval_string("(setq test-vector (make-vector 4 0))"
+                "(aset test-vector 2 'two)");
+    BOOST_CHECK_EQUAL(eval_string("(aref test-vector 2)")->str(), "two");
+    BOOST_CHECK_EQUAL(eval_string("(vector-length test-vector)")->str(), "4");
+    BOOST_CHECK_THROW(eval_string("(aref test-vector 4)"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(aref '(1 2) 0)"), lisp::lisp_error);
+
+    BOOST_CHECK_EQUAL(eval_string("(vconcat #(1 2) '(3 4) nil #())")->str(), "#(1 2 3 4)");
+    BOOST_CHECK(eval_string("(equal #(1 (2)) (vector 1 '(2)))") == lisp::t());
+    BOOST_CHECK(eval_string("(equal #(1 2) #(1 2 3))") == lisp::nil());
+
+    // Spreading arguments.
+    BOOST_CHECK_EQUAL(eval_string("(apply '+ #(1 2 3))")->str(), "6");
+    BOOST_CHECK_EQUAL(eval_string("(apply '+ 1 '(2 3))")->str(), "6");
+    BOOST_CHECK_EQUAL(eval_string("(apply (lambda (a b) (- a b)) #(5 3))")->str(), "2");
+}
+
+BOOST_AUTO_TEST_CASE(test_typed_arrays)
+{
+    eval_string("(setq f64-a (f64-array '(1 2 3 4 5 1/2)))"
+                "(setq f64-b (f64-array #(6 5 4 3 2 1)))"
+                "(setq i64-a (i64-array '(1 2 3 4 5 6)))"
+                "(setq i64-b (i64-array '(6 5 4 3 2 1)))");
+
+    BOOST_CHECK_EQUAL(eval_string("f64-a")->str(), "#f64(1 2 3 4 5 0.5)");
+    BOOST_CHECK_EQUAL(eval_string("(array+ f64-a f64-b)")->str(), "#f64(7 7 7 7 7 1.5)");
+    BOOST_CHECK_EQUAL(eval_string("(array- i64-a i64-b)")->str(), "#i64(-5 -3 -1 1 3 5)");
+    BOOST_CHECK_EQUAL(eval_string("(array* i64-a i64-b)")->str(), "#i64(6 10 12 12 10 6)");
+    BOOST_CHECK_EQUAL(eval_string("(array/ i64-b i64-a)")->str(), "#i64(6 2 1 0 0 0)");
+    BOOST_CHECK_EQUAL(eval_string("(array-sum f64-a)")->str(), "15.5");
+    BOOST_CHECK_EQUAL(eval_string("(array-sum i64-a)")->str(), "21");
+    BOOST_CHECK_EQUAL(eval_string("(array-dot i64-a i64-b)")->str(), "56");
+    BOOST_CHECK_EQUAL(eval_string("(array-min f64-a)")->str(), "0.5");
+    BOOST_CHECK_EQUAL(eval_string("(array-max i64-b)")->str(), "6");
+    BOOST_CHECK_EQUAL(eval_string("(array-scale i64-a 2)")->str(), "#i64(2 4 6 8 10 12)");
+    BOOST_CHECK_EQUAL(eval_string("(array< f64-a f64-b)")->str(), "#i64(1 1 1 0 0 1)");
+    BOOST_CHECK_EQUAL(eval_string("(array= i64-a i64-b)")->str(), "#i64(0 0 0 0 0 0)");
+    BOOST_CHECK_EQUAL(eval_string("(array-to-list (array> i64-a i64-b))")->str(),
+                      "(0 0 0 1 1 1)");
+    BOOST_CHECK_EQUAL(eval_string("(array-length f64-a)")->str(), "6");
+
+    BOOST_CHECK_THROW(eval_string("(i64-array '(1 1/2))"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(array+ f64-a i64-a)"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(array+ f64-a (f64-array '(1)))"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(array/ i64-a (i64-array '(1 1 1 0 1 1)))"),
+                      lisp::arith_error);
+    BOOST_CHECK_THROW(eval_string("(array/ (i64-array '(1 -9223372036854775808))"
+                                  "        (i64-array '(1 -1)))"),
+                      lisp::arith_error);
+    BOOST_CHECK_THROW(eval_string("(array-min (f64-array nil))"), lisp::lisp_error);
+
+    // The AVX2 kernels agree with the scalar ones, including the
+    // elements that don't fill a whole register.
+    for(std::size_t n = 1; n < 14; ++n) {
+        std::vector<double> a(n), b(n);
+        std::vector<long long> ia(n), ib(n);
+
+        for(std::size_t i = 0; i < n; ++i) {
+            a[i] = static_cast<double>((i * 7) % 5) - 2;
+            b[i] = static_cast<double>((i * 3) % 4) - 1;
+            ia[i] = static_cast<long long>((i * 7) % 5) - 2;
+            ib[i] = static_cast<long long>((i * 3) % 4) - 1;
+        }
+
+        double results[2][5];
+        long long int_results[2][4];
+        std::vector<long long> masks[2][3];
+        std::vector<double> sums[2];
+
+        for(int simd = 0; simd < 2; ++simd) {
+            lisp::simd::enable(simd == 1);
+
+            results[simd][0] = lisp::simd::sum(&a[0], n);
+            results[simd][1] = lisp::simd::dot(&a[0], &b[0], n);
+            results[simd][2] = lisp::simd::min(&a[0], n);
+            results[simd][3] = lisp::simd::max(&a[0], n);
+            int_results[simd][0] = lisp::simd::sum(&ia[0], n);
+            int_results[simd][1] = lisp::simd::min(&ia[0], n);
+            int_results[simd][2] = lisp::simd::max(&ia[0], n);
+
+            sums[simd].resize(n);
+            lisp::simd::add(&a[0], &b[0], &sums[simd][0], n);
+
+            for(int i = 0; i < 3; ++i)
+                masks[simd][i].resize(n);
+
+            lisp::simd::less(&a[0], &b[0], &masks[simd][0][0], n);
+            lisp::simd::greater(&ia[0], &ib[0], &masks[simd][1][0], n);
+            lisp::simd::equal(&a[0], &b[0], &masks[simd][2][0], n);
+        }
+
+        lisp::simd::enable(true);
+
+        for(int i = 0; i < 4; ++i)
+            BOOST_CHECK_EQUAL(results[0][i], results[1][i]);
+
+        for(int i = 0; i < 3; ++i) {
+            BOOST_CHECK_EQUAL(int_results[0][i], int_results[1][i]);
+            BOOST_CHECK(masks[0][i] == masks[1][i]);
+        }
+
+        BOOST_CHECK(sums[0] == sums[1]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_lists)
+{
+    BOOST_CHECK_EQUAL(eval_string("(car '(1 2))")->str(), "1");
+    BOOST_CHECK_EQUAL(eval_string("(cdr '(1 2))")->str(), "(2)");
+    BOOST_CHECK(eval_string("(car nil)") == lisp::nil());
+    BOOST_CHECK_THROW(eval_string("(car 1)"), lisp::lisp_error);
+    BOOST_CHECK_EQUAL(eval_string("(cons 1 2)")->str(), "(1 . 2)");
+    BOOST_CHECK_EQUAL(eval_string("(list 1 (+ 1 1) 'three)")->str(), "(1 2 three)");
+
+    BOOST_CHECK_EQUAL(eval_string("(length '(1 2 3))")->str(), "3");
+    BOOST_CHECK_EQUAL(eval_string("(length #(1 2))")->str(), "2");
+    BOOST_CHECK_EQUAL(eval_string("(length \"four\")")->str(), "4");
+    BOOST_CHECK_EQUAL(eval_string("(length nil)")->str(), "0");
+    BOOST_CHECK_EQUAL(eval_string("(nth 1 '(a b c))")->str(), "b");
+    BOOST_CHECK(eval_string("(nth 5 '(a b c))") == lisp::nil());
+
+    // The last argument of append is shared, not copied.
+    eval_string("(setq test-tail '(3 4))");
+    BOOST_CHECK_EQUAL(eval_string("(append '(1) #(2) test-tail)")->str(), "(1 2 3 4)");
+    BOOST_CHECK(eval_string("(eq (cdr (cdr (append '(1) #(2) test-tail))) test-tail)") == lisp::t());
+    BOOST_CHECK_EQUAL(eval_string("(append '(1) 2)")->str(), "(1 . 2)");
+    BOOST_CHECK(eval_string("(append)") == lisp::nil());
+
+    BOOST_CHECK_EQUAL(eval_string("(reverse '(1 2 3))")->str(), "(3 2 1)");
+    BOOST_CHECK_EQUAL(eval_string("(reverse #(1 2 3))")->str(), "#(3 2 1)");
+    BOOST_CHECK_EQUAL(eval_string("(mapcar (lambda (x) (* x x)) '(1 2 3))")->str(), "(1 4 9)");
+    BOOST_CHECK_EQUAL(eval_string("(reduce '+ '(1 2 3 4))")->str(), "10");
+    BOOST_CHECK_EQUAL(eval_string("(reduce '- '(1 2 3) 10)")->str(), "4");
+    BOOST_CHECK(eval_string("(reduce 'list nil)") == lisp::nil());
+    BOOST_CHECK_EQUAL(eval_string("(member \"b\" '(\"a\" \"b\" \"c\"))")->str(), "(\"b\" \"c\")");
+    BOOST_CHECK(eval_string("(member 'd '(a b c))") == lisp::nil());
+    BOOST_CHECK_EQUAL(eval_string("(assoc '(k) '(x ((j) . 1) ((k) . 2)))")->str(), "((k) . 2)");
+
+    // Long lists are walked without recursion.
+    lisp::object_ptr_t list = lisp::nil();
+
+    for(int i = 0; i < 100000; ++i)
+        list.reset(new lisp::cons_cell(lisp::object_ptr_t(new lisp::number(1LL)), list));
+
+    lisp::global_env()->get_symbol("test-long-list")->set_value(list);
+    BOOST_CHECK_EQUAL(eval_string("(length (reverse (append test-long-list nil)))")->str(),
+                      "100000");
+    lisp::global_env()->get_symbol("test-long-list")->set_value(lisp::nil());
+}
+
+BOOST_AUTO_TEST_CASE(test_destructive_lists)
+{
+    eval_string("(setq test-cell (list 1 2))");
+    BOOST_CHECK_EQUAL(eval_string("(setcar test-cell 'one)")->str(), "one");
+    BOOST_CHECK_EQUAL(eval_string("(setcdr (cdr test-cell) '(3))")->str(), "(3)");
+    BOOST_CHECK_EQUAL(eval_string("test-cell")->str(), "(one 2 3)");
+    BOOST_CHECK_THROW(eval_string("(setcar nil 1)"), lisp::lisp_error);
+
+    eval_string("(setq test-a (list 1 2))"
+                "(setq test-b (list 3))");
+    BOOST_CHECK_EQUAL(eval_string("(nconc nil test-a nil test-b (list 4) 5)")->str(), "(1 2 3 4 . 5)");
+    BOOST_CHECK_EQUAL(eval_string("test-a")->str(), "(1 2 3 4 . 5)");
+    BOOST_CHECK(eval_string("(nconc)") == lisp::nil());
+
+    eval_string("(setq test-a (list 1 2 3))");
+    BOOST_CHECK_EQUAL(eval_string("(nreverse test-a)")->str(), "(3 2 1)");
+    BOOST_CHECK_EQUAL(eval_string("test-a")->str(), "(1)");
+    BOOST_CHECK_EQUAL(eval_string("(nreverse (vector 1 2 3))")->str(), "#(3 2 1)");
+
+    // Cached hashes don't survive a mutation.
+    eval_string("(setq test-a (list 1 (list 2 3)))"
+                "(sxhash test-a)"
+                "(setcar (car (cdr test-a)) 9)");
+    BOOST_CHECK(eval_string("(equal test-a '(1 (9 3)))") == lisp::t());
+    BOOST_CHECK(eval_string("(= (sxhash test-a) (sxhash '(1 (9 3))))") == lisp::t());
+
+    eval_string("(setq test-v (vector 1))"
+                "(setq test-a (list test-v))"
+                "(sxhash test-a)"
+                "(aset test-v 0 2)");
+    BOOST_CHECK(eval_string("(equal test-a '(#(2)))") == lisp::t());
+
+    // A mutating call starts a single hash epoch, however many cells
+    // it changes.
+    eval_string("(setq test-a (list 1 2 3 4 5 6 7 8))");
+    std::size_t epoch = lisp::hash_epoch();
+    eval_string("(nreverse test-a)");
+    BOOST_CHECK_EQUAL(lisp::hash_epoch(), epoch + 1);
+
+    // Cells changed before a signal are covered as well.
+    eval_string("(setq test-a (list 1))"
+                "(sxhash test-a)");
+    BOOST_CHECK_THROW(eval_string("(nconc test-a (list 2) 3 4)"), lisp::lisp_error);
+    BOOST_CHECK(eval_string("(= (sxhash test-a) (sxhash '(1 2 . 3)))") == lisp::t());
+}
+
+BOOST_AUTO_TEST_CASE(test_runtimes)
+{
+    lisp::runtime first;
+    lisp::runtime second;
+
+    {
+        lisp::runtime::scope scope(first);
+
+        eval_string("(defun runtime-name () 'first)");
+        BOOST_CHECK(lisp::nil() == first.nil());
+        BOOST_CHECK_EQUAL(eval_string("(runtime-name)")->str(), "first");
+    }
+
+    {
+        lisp::runtime::scope scope(second);
+
+        BOOST_CHECK(lisp::nil() == second.nil());
+        BOOST_CHECK(lisp::nil() != first.nil());
+        BOOST_CHECK_THROW(eval_string("(runtime-name)"), lisp::lisp_error);
+    }
+
+    BOOST_CHECK(lisp::nil() != first.nil() && lisp::nil() != second.nil());
+    BOOST_CHECK_THROW(eval_string("(runtime-name)"), lisp::lisp_error);
+
+    // Every thread evaluates in a runtime of its own.
+    std::vector<std::string> results(4);
+    std::vector<std::thread> threads;
+
+    for(std::size_t i = 0; i < results.size(); ++i)
+        threads.push_back(std::thread([i, &results]() {
+                    lisp::runtime rt;
+                    lisp::runtime::scope scope(rt);
+
+                    eval_string("(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"
+                                "(setq offset " + lisp::to_string(i) + ")");
+                    results[i] = eval_string("(+ (fib 15) offset)")->str();
+                }));
+
+    for(std::size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    for(std::size_t i = 0; i < results.size(); ++i)
+        BOOST_CHECK_EQUAL(results[i], lisp::to_string(610 + i));
+}
+
+BOOST_AUTO_TEST_CASE(test_environment_fork)
+{
+    eval_string("(setq fork-var 'library)"
+                "(defun fork-fn () 'library)"
+                "(defun fork-set (value) (setq fork-var value))");
+
+    {
+        lisp::environment fork(lisp::global_env(), true);
+
+        BOOST_CHECK_EQUAL(eval_string(&fork, "fork-var")->str(), "library");
+        BOOST_CHECK_EQUAL(eval_string(&fork, "(fork-fn)")->str(), "library");
+
+        eval_string(&fork, "(setq fork-var 'request)"
+                           "(defun fork-fn () 'request)"
+                           "(defun fork-new () 'new)"
+                           "(setq fork-new-var 1)");
+
+        BOOST_CHECK_EQUAL(eval_string(&fork, "(list fork-var (fork-fn) (fork-new) fork-new-var)")->str(),
+                          "(request request new 1)");
+        BOOST_CHECK_EQUAL(eval_string("(list fork-var (fork-fn))")->str(), "(library library)");
+        BOOST_CHECK_THROW(eval_string("(fork-new)"), lisp::lisp_error);
+        BOOST_CHECK_THROW(eval_string("fork-new-var"), lisp::lisp_error);
+
+        // Writes from functions defined in the parent stay in the
+        // fork, as do writes of nil.
+        eval_string(&fork, "(fork-set 'from-function)");
+        BOOST_CHECK_EQUAL(eval_string(&fork, "fork-var")->str(), "from-function");
+        eval_string(&fork, "(fork-set nil)");
+        BOOST_CHECK(eval_string(&fork, "fork-var") == lisp::nil());
+        BOOST_CHECK_EQUAL(eval_string("fork-var")->str(), "library");
+    }
+
+    BOOST_CHECK_EQUAL(eval_string("(list fork-var (fork-fn))")->str(), "(library library)");
+    BOOST_CHECK_THROW(eval_string("(fork-new)"), lisp::lisp_error);
+
+    // A function of the parent calling a function one fork redefines
+    // shares its call sites with the sibling fork and the parent.
+    eval_string("(defun fork-helper () 'global)"
+                "(defun fork-handler () (fork-helper))");
+
+    {
+        lisp::environment fork_a(lisp::global_env(), true);
+        lisp::environment fork_b(lisp::global_env(), true);
+
+        BOOST_CHECK_EQUAL(eval_string("(fork-handler)")->str(), "global");
+
+        eval_string(&fork_a, "(defun fork-helper () 'fork-a)");
+
+        for(int i = 0; i < 2; ++i) {
+            BOOST_CHECK_EQUAL(eval_string(&fork_a, "(fork-handler)")->str(), "fork-a");
+            BOOST_CHECK_EQUAL(eval_string(&fork_b, "(fork-handler)")->str(), "global");
+            BOOST_CHECK_EQUAL(eval_string("(fork-handler)")->str(), "global");
+        }
+    }
+
+    BOOST_CHECK_EQUAL(eval_string("(fork-handler)")->str(), "global");
+
+    // Each fork replaces the cached function of the call sites, the
+    // replaced entries don't pile up.
+    for(int i = 0; i < 1000; ++i) {
+        lisp::environment fork(lisp::global_env(), true);
+
+        BOOST_CHECK_EQUAL(eval_string(&fork, "(fork-handler)")->str(), "global");
+    }
+
+    BOOST_CHECK_EQUAL(lisp::runtime::current().retired().size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_environment)
+{
+    // Readers look up symbols of a global environment shared with a
+    // thread that keeps redefining and adding symbols. Meant to be
+    // run under ThreadSanitizer as well.
+    lisp::runtime rt;
+    lisp::runtime::scope main_scope(rt);
+
+    const int function_count = 16;
+
+    for(int i = 0; i < function_count; ++i)
+        eval_string("(defun stress-fn-" + lisp::to_string(i) + " () 0)");
+
+    eval_string("(setq stress-counter 0)");
+
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+
+    // The definitions are read here, the reader isn't part of the
+    // test.
+    std::vector<lisp::object_ptr_t> definitions;
+
+    for(int i = 0; i < 300; ++i) {
+        std::string script = "(defun stress-fn-" + lisp::to_string(i % function_count) +
+            " () " + lisp::to_string(i) + ")"
+            "(setq stress-counter " + lisp::to_string(i) + ")"
+            "(setq stress-new-" + lisp::to_string(i) + " t)";
+        std::string::iterator iter = script.begin();
+        lisp::tokenizer<std::string::iterator> tok(iter, script.end());
+
+        while(tok.next_token())
+            definitions.push_back(lisp::interpreter::compile_expr(lisp::global_env(), tok));
+    }
+
+    threads.push_back(std::thread([&rt, &done, &definitions]() {
+                lisp::runtime::scope scope(rt);
+                lisp::environment* env = lisp::global_env();
+
+                for(std::size_t i = 0; i < definitions.size(); ++i)
+                    env->eval(lisp::analyze_toplevel(env, definitions[i]));
+
+                done = true;
+            }));
+
+    for(int t = 0; t < 3; ++t)
+        threads.push_back(std::thread([&rt, &done, &failures, t]() {
+                    lisp::runtime::scope scope(rt);
+                    lisp::environment* env = lisp::global_env();
+
+                    for(int i = 0; !done || i < 1000; ++i) {
+                        std::string name = "stress-fn-" + lisp::to_string(i % function_count);
+
+                        if(!env->get_function(name))
+                            ++failures;
+
+                        if(!dynamic_cast<const lisp::number*>(
+                               env->get_symbol("stress-counter")->value().get()))
+                            ++failures;
+
+                        env->get_symbol("stress-reader-" + lisp::to_string(t) + "-" +
+                                        lisp::to_string(i % 100));
+                    }
+                }));
+
+    for(std::size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    BOOST_CHECK_EQUAL(failures, 0);
+    BOOST_CHECK_EQUAL(eval_string("(list (stress-fn-3) stress-counter stress-new-299)")->str(),
+                      "(291 299 t)");
+}
+
+BOOST_AUTO_TEST_CASE(test_retired_functions)
+{
+    lisp::runtime rt;
+    lisp::runtime::scope scope(rt);
+
+    eval_string("(defun retired-fn () 0)");
+
+    // Replaced cells of global symbols are kept while a reader may
+    // hold them...
+    {
+        lisp::epoch::read_guard guard;
+
+        for(int i = 0; i < 100; ++i)
+            eval_string("(defun retired-fn () " + lisp::to_string(i) + ")");
+
+        BOOST_CHECK_EQUAL(rt.retired().size(), 100);
+        BOOST_CHECK_EQUAL(eval_string("(retired-fn)")->str(), "99");
+    }
+
+    // ... and destroyed afterwards.
+    for(int i = 0; i < 1000; ++i)
+        eval_string("(defun retired-fn () " + lisp::to_string(i) + ")");
+
+    BOOST_CHECK_EQUAL(rt.retired().size(), 0);
+    BOOST_CHECK_EQUAL(eval_string("(retired-fn)")->str(), "999");
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel)
+{
+    lisp::runtime rt;
+    lisp::runtime::scope scope(rt);
+
+    rt.set_pool_size(4);
+
+    eval_string("(defun par-fib (n) (if (< n 2) n (+ (par-fib (- n 1)) (par-fib (- n 2)))))"
+                "(defun par-fail (n) (if (= n 37) (signal 'par-error n) n))"
+                "(setq par-input (list 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20))");
+
+    BOOST_CHECK_EQUAL(eval_string("(pmapcar 'par-fib par-input)")->str(),
+                      eval_string("(mapcar 'par-fib par-input)")->str());
+    BOOST_CHECK_EQUAL(eval_string("(pmapcar (lambda (x) (* x x)) #(1 2 3))")->str(), "(1 4 9)");
+    BOOST_CHECK(eval_string("(pmapcar 'par-fib nil)") == lisp::nil());
+
+    // Nested calls run on the same pool.
+    BOOST_CHECK_EQUAL(eval_string("(pmapcar (lambda (n) (preduce '+ (pmapcar 'par-fib (list n n))))"
+                                  "         '(5 6 7))")->str(), "(10 16 26)");
+
+    BOOST_CHECK_EQUAL(eval_string("(preduce '+ par-input)")->str(), "210");
+    BOOST_CHECK_EQUAL(eval_string("(preduce '+ par-input 1000)")->str(), "1210");
+    BOOST_CHECK_EQUAL(eval_string("(preduce 'list '(1 2 3 4 5 6 7 8 9 10))")->str(),
+                      eval_string("(reduce 'list '(1 2 3 4 5 6 7 8 9 10))")->str());
+    BOOST_CHECK_EQUAL(eval_string("(preduce '+ nil 7)")->str(), "7");
+
+    // Workers fill the hash caches of a shared list and its strings.
+    eval_string("(setq par-shared (list 1 \"two\" (list 3 \"four\") 5))");
+    BOOST_CHECK_EQUAL(eval_string("(pmapcar (lambda (n) (sxhash par-shared)) par-input)")->str(),
+                      eval_string("(mapcar (lambda (n) (sxhash par-shared)) par-input)")->str());
+
+    // Errors signaled in a worker reach the caller.
+    BOOST_CHECK_EQUAL(eval_string("(condition-case err"
+                                  "  (pmapcar 'par-fail '(1 37 3 4 5 6 7 8 9 10))"
+                                  "  (par-error (cdr err)))")->str(), "37");
+
+    // Tasks can't replace the pool they run on.
+    eval_string("(defun par-resize (n) (set-pool-size 2) n)");
+    BOOST_CHECK_THROW(eval_string("(pmapcar 'par-resize par-input)"), lisp::lisp_error);
+    BOOST_CHECK_EQUAL(eval_string("(pmapcar 'par-fib '(10 11))")->str(), "(55 89)");
+
+    BOOST_CHECK_EQUAL(eval_string("(set-pool-size 1)")->str(), "1");
+    BOOST_CHECK_EQUAL(eval_string("(pmapcar 'par-fib '(10 11))")->str(), "(55 89)");
+    BOOST_CHECK_THROW(eval_string("(set-pool-size 0)"), lisp::lisp_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_futures)
+{
+    lisp::runtime rt;
+    lisp::runtime::scope scope(rt);
+
+    rt.set_pool_size(4);
+
+    eval_string("(defun fut-fib (n) (if (< n 2) n (+ (fut-fib (- n 1)) (fut-fib (- n 2)))))"
+                "(defun fut-set () (setq fut-x 2) fut-x)"
+                "(setq fut-x 1)");
+
+    for(int analyze = 0; analyze < 2; ++analyze) {
+        BOOST_CHECK_EQUAL(eval_string("(await (future (fut-fib 15)))", analyze)->str(), "610");
+
+        // The caller's local variables are copied.
+        BOOST_CHECK_EQUAL(eval_string("(mapcar 'await"
+                                      "        (mapcar (lambda (n) (future (fut-fib n)))"
+                                      "                '(10 11 12)))", analyze)->str(),
+                          "(55 89 144)");
+
+        // Assignments stay in the future's environment.
+        BOOST_CHECK_EQUAL(eval_string("(await (future (fut-set)))",
+                                      analyze)->str(), "2");
+        BOOST_CHECK_EQUAL(eval_string("fut-x", analyze)->str(), "1");
+
+        BOOST_CHECK_EQUAL(eval_string("(condition-case err"
+                                      "  (await (future (signal 'fut-error 42)))"
+                                      "  (fut-error (cdr err)))", analyze)->str(), "42");
+
+        BOOST_CHECK_THROW(eval_string("(future)", analyze), lisp::lisp_error);
+        BOOST_CHECK_THROW(eval_string("(future 1 2)", analyze), lisp::lisp_error);
+    }
+
+    eval_string("(setq fut-handle (future (list 1 2)))");
+
+    BOOST_CHECK_EQUAL(eval_string("(await fut-handle)")->str(), "(1 2)");
+    BOOST_CHECK(eval_string("(await fut-handle)") == eval_string("(await fut-handle)"));
+    BOOST_CHECK_EQUAL(eval_string("fut-handle")->str(), "#<future done>");
+    BOOST_CHECK_THROW(eval_string("(await 5)"), lisp::lisp_error);
+
+    // Without worker threads await does the evaluation.
+    rt.set_pool_size(1);
+
+    BOOST_CHECK_EQUAL(eval_string("(await (future (fut-fib 10)))")->str(), "55");
+}
+
+BOOST_AUTO_TEST_CASE(test_actors)
+{
+    lisp::runtime rt;
+    lisp::runtime::scope scope(rt);
+
+    rt.set_pool_size(4);
+
+    eval_string("(setq act-main (self))"
+                "(defun act-echo (msg)"
+                "  (if (eq msg 'stop) 'stopped"
+                "    (send (car msg) (cdr msg))"
+                "    (act-echo (receive))))"
+                "(defun act-ping (partner n)"
+                "  (if (= n 0) (send partner 'stop)"
+                "    (send partner (cons (self) (- n 1)))"
+                "    (act-ping partner (receive))))"
+                "(defun act-collect (n sum)"
+                "  (if (= n 0) sum (act-collect (- n 1) (+ sum (receive)))))"
+                "(defun act-mutate (l) (setcar l 99) l)"
+                "(defun act-deep (n) (if (= n 0) 0 (+ 1 (act-deep (- n 1)))))"
+                "(setq act-list (list 1 2 3))");
+
+    for(int analyze = 0; analyze < 2; ++analyze) {
+        eval_string("(spawn (send act-main (* 6 7)))", analyze);
+        BOOST_CHECK_EQUAL(eval_string("(receive)", analyze)->str(), "42");
+
+        // The caller's local variables are copied.
+        BOOST_CHECK_EQUAL(eval_string("(mapcar 'await"
+                                      "        (mapcar (lambda (n) (spawn (* n n))) '(1 2 3)))",
+                                      analyze)->str(), "(1 4 9)");
+
+        BOOST_CHECK_EQUAL(eval_string("(condition-case err"
+                                      "  (await (spawn (signal 'act-error 7)))"
+                                      "  (act-error (cdr err)))", analyze)->str(), "7");
+
+        BOOST_CHECK_THROW(eval_string("(spawn)", analyze), lisp::lisp_error);
+
+        // Fibers recurse as deep as threads.
+        BOOST_CHECK_EQUAL(eval_string("(await (spawn (act-deep 1000)))", analyze)->str(), "1000");
+    }
+
+    // Two actors blocking on each other's messages.
+    eval_string("(setq act-echoer (spawn (act-echo (receive))))"
+                "(setq act-pinger (spawn (act-ping act-echoer 1000)))");
+
+    BOOST_CHECK_EQUAL(eval_string("(await act-echoer)")->str(), "stopped");
+    BOOST_CHECK_EQUAL(eval_string("(await act-pinger)")->str(), "stop");
+
+    // Many actors on a few threads.
+    eval_string("(mapcar (lambda (n) (spawn (send act-main n)))"
+                "        (append (make-vector 100 1)))");
+    BOOST_CHECK_EQUAL(eval_string("(act-collect 100 0)")->str(), "100");
+
+    // Messages are copies.
+    eval_string("(setq act-mutator (spawn (act-mutate (receive))))"
+                "(send act-mutator act-list)");
+    BOOST_CHECK_EQUAL(eval_string("(await act-mutator)")->str(), "(99 2 3)");
+    BOOST_CHECK_EQUAL(eval_string("act-list")->str(), "(1 2 3)");
+
+    BOOST_CHECK_EQUAL(eval_string("act-mutator")->str(), "#<actor done>");
+    BOOST_CHECK_EQUAL(eval_string("act-main")->str(), "#<actor thread>");
+    BOOST_CHECK_THROW(eval_string("(send 1 2)"), lisp::lisp_error);
+
+    lisp::object_ptr_t message = eval_string("(list \"a\" 1.5 #(x (y)) (i64-array '(1 2)))");
+    lisp::object_ptr_t copy = lisp::copy_message(message);
+
+    BOOST_CHECK_EQUAL(copy->str(), message->str());
+    BOOST_CHECK(boost::static_pointer_cast<lisp::cons_cell>(copy)->car() !=
+                boost::static_pointer_cast<lisp::cons_cell>(message)->car());
+
+    // An actor that never finishes is unwound with the runtime.
+    eval_string("(spawn (receive))");
+}
+
+BOOST_AUTO_TEST_CASE(test_channel)
+{
+    lisp::runtime rt;
+    lisp::runtime::scope scope(rt);
+
+    lisp::channel ch(2);
+
+    ch.push(lisp::nil());
+    ch.push(lisp::t());
+
+    const lisp::object_ptr_t message = lisp::nil();
+    std::atomic<bool> pushed(false);
+    std::thread sender([&ch, &message, &pushed]() {
+            ch.push(message);
+            pushed = true;
+        });
+
+    // The sender blocks until a message is taken.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK(!pushed);
+    BOOST_CHECK_EQUAL(ch.size(), 2u);
+
+    BOOST_CHECK(ch.pop() == lisp::nil());
+    sender.join();
+
+    BOOST_CHECK(pushed);
+    BOOST_CHECK(ch.pop() == lisp::t());
+    BOOST_CHECK(ch.pop() == lisp::nil());
+}
+
+BOOST_AUTO_TEST_CASE(test_atoms)
+{
+    lisp::runtime rt;
+    lisp::runtime::scope scope(rt);
+
+    rt.set_pool_size(4);
+
+    eval_string("(setq at-counter (make-atom 0))");
+
+    BOOST_CHECK_EQUAL(eval_string("(deref at-counter)")->str(), "0");
+    BOOST_CHECK_EQUAL(eval_string("(swap! at-counter '+ 5 2)")->str(), "7");
+    BOOST_CHECK_EQUAL(eval_string("(reset! at-counter 10)")->str(), "10");
+    BOOST_CHECK(eval_string("(compare-and-set! at-counter 11 12)") == lisp::nil());
+    BOOST_CHECK(eval_string("(compare-and-set! at-counter 10 12)") == lisp::t());
+    BOOST_CHECK_EQUAL(eval_string("at-counter")->str(), "#<atom 12>");
+    BOOST_CHECK_THROW(eval_string("(deref 1)"), lisp::lisp_error);
+
+    // An error in the update leaves the value alone.
+    BOOST_CHECK_THROW(eval_string("(swap! at-counter 'car)"), lisp::lisp_error);
+    BOOST_CHECK_EQUAL(eval_string("(deref at-counter)")->str(), "12");
+
+    eval_string("(reset! at-counter 0)"
+                "(pmapcar (lambda (x) (swap! at-counter '+ x)) (make-vector 100 1))");
+    BOOST_CHECK_EQUAL(eval_string("(deref at-counter)")->str(), "100");
+
+    // Contended updates while another thread keeps reading.
+    lisp::atom counter(lisp::object_ptr_t(new lisp::number(0ll)));
+    std::atomic<bool> done(false);
+    std::thread reader([&counter, &done]() {
+            while(!done)
+                counter.deref();
+        });
+    std::vector<std::thread> writers;
+
+    for(int i = 0; i < 4; ++i)
+        writers.push_back(std::thread([&counter]() {
+                    for(int j = 0; j < 10000; ++j)
+                        counter.swap([](const lisp::object_ptr_t& value) {
+                                return lisp::object_ptr_t(
+                                    new lisp::number(
+                                        static_cast<lisp::number&>(*value) +
+                                        lisp::number(1ll)));
+                            });
+                }));
+
+    for(std::size_t i = 0; i < writers.size(); ++i)
+        writers[i].join();
+
+    done = true;
+    reader.join();
+
+    BOOST_CHECK_EQUAL(counter.deref()->str(), "40000");
+}
+
+BOOST_AUTO_TEST_CASE(test_profiler)
+{
+    lisp::runtime rt;
+    lisp::runtime::scope scope(rt);
+
+    eval_string("(defun prof-fib (n) (if (< n 2) n (+ (prof-fib (- n 1)) (prof-fib (- n 2)))))"
+                "(defun prof-loop (n) (if (= n 0) 0 (prof-loop (- n 1))))");
+
+    BOOST_CHECK(eval_string("(profile-start 100)") == lisp::t());
+    BOOST_CHECK(lisp::profiler::is_running());
+
+    eval_string("(prof-fib 20)"
+                "(prof-loop 20000)");
+
+    lisp::object_ptr_t folded = eval_string("(profile-report)");
+
+    BOOST_CHECK(!lisp::profiler::is_running());
+    BOOST_CHECK(folded->str().find("prof-fib;prof-fib") != std::string::npos);
+    // Tail calls replace their caller on the stack.
+    BOOST_CHECK(folded->str().find("prof-loop;prof-loop") == std::string::npos);
+
+    // Every call was popped again.
+    BOOST_CHECK_EQUAL(lisp::profiler::current_stack().depth.load(), 0u);
+
+    BOOST_CHECK_THROW(eval_string("(profile-start 0)"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(profile-report 1)"), lisp::lisp_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_eval_stats)
+{
+    lisp::runtime rt;
+    lisp::runtime::scope scope(rt);
+
+    if(!lisp::eval_stats::enabled) {
+        BOOST_CHECK(eval_string("(eval-stats)") == lisp::nil());
+        return;
+    }
+
+    eval_string("(defun es-wrap (x) (list (es-first) x))");
+
+    const lisp::eval_stats::counts_t before = lisp::eval_stats::totals();
+
+    // defun is called with the unevaluated form, es-first finds x
+    // in the caller's environment.
+    eval_string("(defun es-first () (car x))"
+                "(es-wrap '(1 2))");
+
+    const lisp::eval_stats::counts_t after = lisp::eval_stats::totals();
+
+    for(std::size_t i = 0; i < lisp::eval_stats::event_count; ++i) {
+        // The symbol es-wrap exists already.
+        if(i != lisp::eval_stats::symbol_creations)
+            BOOST_CHECK_MESSAGE(after.counts[i] > before.counts[i],
+                                lisp::eval_stats::name(lisp::eval_stats::event(i)));
+    }
+
+    BOOST_CHECK_EQUAL(eval_string("(car (eval-stats))")->str(), ":evals");
+
+    // Counts of other threads are added up.
+    eval_string("(await (future (es-wrap '(1 2))))");
+    BOOST_CHECK(lisp::eval_stats::totals().counts[lisp::eval_stats::evals] >
+                after.counts[lisp::eval_stats::evals]);
+
+    std::vector<std::pair<std::string, std::size_t> > calls;
+
+    lisp::eval_stats::set_trace([&calls](const std::string& name, std::size_t depth,
+                                         std::chrono::nanoseconds) {
+            calls.push_back(std::make_pair(name, depth));
+        });
+
+    eval_string("(es-wrap '(1 2))");
+
+    lisp::eval_stats::set_trace(lisp::eval_stats::trace_t());
+
+    // Calls are reported when they return, innermost first.
+    BOOST_REQUIRE_EQUAL(calls.size(), 4u);
+    BOOST_CHECK(calls[0] == std::make_pair(std::string("car"), std::size_t(3)));
+    BOOST_CHECK(calls[1] == std::make_pair(std::string("es-first"), std::size_t(2)));
+    BOOST_CHECK(calls[2] == std::make_pair(std::string("list"), std::size_t(2)));
+    BOOST_CHECK(calls[3] == std::make_pair(std::string("es-wrap"), std::size_t(1)));
+}
+
+BOOST_AUTO_TEST_CASE(test_time)
+{
+    lisp::runtime rt;
+    lisp::runtime::scope scope(rt);
+
+    eval_string("(defun tm-fib (n) (if (< n 2) n (+ (tm-fib (- n 1)) (tm-fib (- n 2)))))");
+
+    eval_string("(setq tm-report (time (tm-fib 10)))");
+
+    BOOST_CHECK_EQUAL(eval_string("(nth 0 tm-report)")->str(), ":value");
+    BOOST_CHECK_EQUAL(eval_string("(nth 1 tm-report)")->str(), "55");
+    BOOST_CHECK_EQUAL(eval_string("(nth 3 tm-report)")->str(), "1");
+    BOOST_CHECK_EQUAL(eval_string("(nth 8 tm-report)")->str(), ":bytes");
+    BOOST_CHECK(eval_string("(< 0 (nth 7 tm-report))") == lisp::t());
+    // 177 calls of tm-fib and the arithmetic they do.
+    BOOST_CHECK(eval_string("(< 177 (nth 11 tm-report))") == lisp::t());
+    // The calls of tm-fib nest 10 deep, plus a builtin at the bottom.
+    BOOST_CHECK_EQUAL(eval_string("(nth 13 tm-report)")->str(), "11");
+
+    eval_string("(setq tm-once (time (tm-fib 5)))"
+                "(setq tm-repeated (benchmark (+ 1 2) (tm-fib 5)))");
+
+    BOOST_CHECK_EQUAL(eval_string("(nth 3 tm-repeated)")->str(), "3");
+    BOOST_CHECK(eval_string("(= (* 3 (nth 11 tm-once)) (nth 11 tm-repeated))") == lisp::t());
+
+    // The same without analysis.
+    BOOST_CHECK_EQUAL(eval_string(lisp::global_env(), "(nth 1 (time (tm-fib 10)))", false)->str(),
+                      "55");
+    BOOST_CHECK_EQUAL(eval_string(lisp::global_env(), "(nth 3 (benchmark 2 (tm-fib 5)))",
+                                  false)->str(), "2");
+
+    BOOST_CHECK_THROW(eval_string("(benchmark 0 1)"), lisp::lisp_error);
+    BOOST_CHECK_THROW(eval_string("(time)"), lisp::lisp_error);
+
+    // The call counter doesn't keep the calls recorded.
+    BOOST_CHECK_EQUAL(lisp::profiler::recording.load(), 0);
+}
+
 BOOST_AUTO_TEST_CASE(number_test)
 {
     using lisp::number;
@@ -0,0 +1,302 @@
+#ifndef LISP_NATIVE_FUNCTION_HPP
+#define LISP_NATIVE_FUNCTION_HPP
+
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "lisp.hpp"
+#include "types.hpp"
+#include "cxx_function.hpp"
+#include "utils.hpp"
+
+namespace lisp {
+    /**
+       @brief Signals wrong-type-argument with the data
+       (PREDICATE OBJ).
+    */
+    inline void signal_wrong_type(const char* predicate, const object_ptr_t& obj)
+    {
+        signal("wrong-type-argument",
+               object_ptr_t(new cons_cell(object_ptr_t(new symbol_ref(predicate)),
+                                          object_ptr_t(new cons_cell(obj)))));
+    }
+
+    /**
+       @brief Converts between lisp objects and a C++ type that is
+       used as parameter or return type of a native function.
+
+       from_lisp() signals wrong-type-argument if the object doesn't
+       fit.
+    */
+    template <typename T>
+    struct native_type;
+
+    template <>
+    struct native_type<long long>
+    {
+        static long long from_lisp(const object_ptr_t& obj)
+            {
+                const number* num = exact_cast<number>(obj);
+
+                if(!num || !num->isIntegerType())
+                    signal_wrong_type("integerp", obj);
+
+                return num->as_long();
+            }
+
+        static object_ptr_t to_lisp(long long value)
+            {
+                return object_ptr_t(new number(value));
+            }
+    };
+
+    template <>
+    struct native_type<int>
+    {
+        /**
+           @brief Signals args-out-of-range with the data (OBJ) if
+           the integer doesn't fit an int.
+        */
+        static int from_lisp(const object_ptr_t& obj)
+            {
+                const long long value = native_type<long long>::from_lisp(obj);
+
+                if(value < std::numeric_limits<int>::min() ||
+                   value > std::numeric_limits<int>::max())
+                    signal("args-out-of-range", object_ptr_t(new cons_cell(obj)));
+
+                return static_cast<int>(value);
+            }
+
+        static object_ptr_t to_lisp(int value)
+            {
+                return object_ptr_t(new number(static_cast<long long>(value)));
+            }
+    };
+
+    template <>
+    struct native_type<double>
+    {
+        static double from_lisp(const object_ptr_t& obj)
+            {
+                const number* num = exact_cast<number>(obj);
+
+                if(!num)
+                    signal_wrong_type("numberp", obj);
+
+                return num->as_double();
+            }
+
+        static object_ptr_t to_lisp(double value)
+            {
+                return object_ptr_t(new number(value));
+            }
+    };
+
+    template <>
+    struct native_type<number>
+    {
+        static const number& from_lisp(const object_ptr_t& obj)
+            {
+                const number* num = exact_cast<number>(obj);
+
+                if(!num)
+                    signal_wrong_type("numberp", obj);
+
+                return *num;
+            }
+
+        static object_ptr_t to_lisp(const number& value)
+            {
+                return object_ptr_t(new number(value));
+            }
+    };
+
+    template <>
+    struct native_type<bool>
+    {
+        static bool from_lisp(const object_ptr_t& obj)
+            {
+                return obj != nil();
+            }
+
+        static object_ptr_t to_lisp(bool value)
+            {
+                return value ? t() : nil();
+            }
+    };
+
+    template <>
+    struct native_type<std::string>
+    {
+        static std::string from_lisp(const object_ptr_t& obj)
+            {
+                const string* str = exact_cast<string>(obj);
+
+                if(!str)
+                    signal_wrong_type("stringp", obj);
+
+                return *str;
+            }
+
+        static object_ptr_t to_lisp(const std::string& value)
+            {
+                return object_ptr_t(new string(value));
+            }
+    };
+
+    template <>
+    struct native_type<object_ptr_t>
+    {
+        static const object_ptr_t& from_lisp(const object_ptr_t& obj)
+            {
+                return obj;
+            }
+
+        static object_ptr_t to_lisp(const object_ptr_t& value)
+            {
+                return value;
+            }
+    };
+
+    template <std::size_t... I>
+    struct index_list
+    {
+    };
+
+    template <std::size_t N, std::size_t... I>
+    struct make_index_list : make_index_list<N - 1, N - 1, I...>
+    {
+    };
+
+    template <std::size_t... I>
+    struct make_index_list<0, I...>
+    {
+        typedef index_list<I...> type;
+    };
+
+    /**
+       @brief Calls @a f and converts its result, void functions
+       return nil.
+    */
+    template <typename R>
+    struct native_call
+    {
+        template <typename F, typename... Args>
+        static object_ptr_t invoke(F& f, Args&&... args)
+            {
+                return native_type<typename std::decay<R>::type>::to_lisp(
+                    f(std::forward<Args>(args)...));
+            }
+    };
+
+    template <>
+    struct native_call<void>
+    {
+        template <typename F, typename... Args>
+        static object_ptr_t invoke(F& f, Args&&... args)
+            {
+                f(std::forward<Args>(args)...);
+                return nil();
+            }
+    };
+
+    /**
+       @brief A builtin wrapping a C++ callable with the signature
+       R(Args...).
+
+       The arguments are unmarshalled by native_type, which is
+       resolved at compile time. Use environment::defun() to create
+       one.
+    */
+    template <typename F, typename R, typename... Args>
+    class native_function : public cxx_function
+    {
+    public:
+        native_function(const std::string& name, F f)
+            : m_name(name),
+              m_function(f)
+            {
+            }
+
+        object_ptr_t apply(environment* env, const argv_t& args)
+            {
+                profiler::frame profiled(this);
+
+                return call(env, args);
+            }
+
+    protected:
+        object_ptr_t operator()(environment* env, const argv_t& args)
+            {
+                return call(env, args);
+            }
+
+    private:
+        object_ptr_t call(environment* env, const argv_t& args)
+            {
+                if(args.size() != sizeof...(Args))
+                    signal(env->get_symbol("wrong-number-of-arguments"), m_name);
+
+                return unmarshal(args, typename make_index_list<sizeof...(Args)>::type());
+            }
+
+        template <std::size_t... I>
+        object_ptr_t unmarshal(const argv_t& args, index_list<I...>)
+            {
+                return native_call<R>::invoke(
+                    m_function,
+                    native_type<typename std::decay<Args>::type>::from_lisp(args[I])...);
+            }
+
+        std::string m_name;
+        F m_function;
+    };
+
+    template <typename F, typename C, typename R, typename... Args>
+    object_ptr_t make_native_function(const std::string& name, F f,
+                                      R (C::*)(Args...) const)
+    {
+        return object_ptr_t(new native_function<F, R, Args...>(name, f));
+    }
+
+    template <typename F, typename C, typename R, typename... Args>
+    object_ptr_t make_native_function(const std::string& name, F f,
+                                      R (C::*)(Args...))
+    {
+        return object_ptr_t(new native_function<F, R, Args...>(name, f));
+    }
+
+    /**
+       @brief Wraps a lambda or function object with a single,
+       non-template operator().
+    */
+    template <typename F>
+    object_ptr_t make_native_function(const std::string& name, F f)
+    {
+        return make_native_function(name, f, &F::operator());
+    }
+
+    /**
+       @brief Wraps a plain function.
+    */
+    template <typename R, typename... Args>
+    object_ptr_t make_native_function(const std::string& name, R (*f)(Args...))
+    {
+        return object_ptr_t(new native_function<R (*)(Args...), R, Args...>(name, f));
+    }
+
+    template <typename F>
+    symbol_ptr_t environment::defun(const std::string& name, F f)
+    {
+        symbol_ptr_t sym = get_writable_symbol(name);
+
+        sym->set_function(make_native_function(name, f));
+
+        return sym;
+    }
+}
+
+#endif  // LISP_NATIVE_FUNCTION_HPP
@@ -29,10 +29,93 @@
 #include <stdlib.h>
 #include <functional>
 #include <algorithm>
+#include <limits>
 
 #include <boost/lexical_cast.hpp>
 
 namespace lisp {
+    namespace {
+        /// Whether @a l fits the int numerator of a fraction.
+        bool fits_int(long long l)
+        {
+            return l >= std::numeric_limits<int>::min() &&
+                l <= std::numeric_limits<int>::max();
+        }
+
+        /**
+           @brief Applies the operator named @a OpName to two longs.
+
+           Returns false if the result isn't a long: on overflow and,
+           for a division, if the divisor is zero or doesn't divide
+           @a a. Never traps, not even for LLONG_MIN / -1.
+        */
+        template <char OpName>
+        bool fixnum_op(long long a, long long b, long long& result)
+        {
+            const long long min = std::numeric_limits<long long>::min();
+            const long long max = std::numeric_limits<long long>::max();
+
+            switch(OpName)
+            {
+            case '+':
+                if((b > 0 && a > max - b) || (b < 0 && a < min - b))
+                    return false;
+
+                result = a + b;
+                return true;
+
+            case '-':
+                if((b < 0 && a > max + b) || (b > 0 && a < min + b))
+                    return false;
+
+                result = a - b;
+                return true;
+
+            case '*':
+                if(a > 0 ?
+                   (b > 0 ? a > max / b : b < min / a) :
+                   (b > 0 ? a < min / b : a != 0 && b < max / a))
+                    return false;
+
+                result = a * b;
+                return true;
+
+            case '/':
+                if(b == 0 || (a == min && b == -1) || a % b != 0)
+                    return false;
+
+                result = a / b;
+                return true;
+            }
+
+            assert(0);
+            return false;
+        }
+
+        /**
+           @brief Brings @a l to the positive denominator of the
+           fraction @a z / @a n, so that comparing @a scaled with
+           @a scaled_z compares @a l with the fraction.
+
+           Returns false if @a l times the denominator may not fit a
+           long long, the fraction is then closer to zero than @a l
+           and comparing doubles is exact enough.
+        */
+        bool scale_to_fraction(long long l, int z, int n,
+                               long long& scaled, long long& scaled_z)
+        {
+            if(!fits_int(l))
+                return false;
+
+            const long long sign = n < 0 ? -1 : 1;
+
+            scaled = l * n * sign;
+            scaled_z = static_cast<long long>(z) * sign;
+
+            return true;
+        }
+    }
+
     std::string number::get_type_string(attrtype_t at)
     {
         switch(at)
@@ -315,6 +398,145 @@ namespace lisp {
 /// Forced instantiation of binary_arith_op for number::operator/()
     template number number::binary_arith_op<std::divides, '/'>(const number &b) const;
 
+    struct number::accumulator
+    {
+        explicit accumulator(long long l)
+            : type(ATTRTYPE_LONG)
+        {
+            val._long = l;
+        }
+
+        explicit accumulator(const number& n)
+            : type(n.atype),
+              val(n.val)
+        {
+        }
+
+        void promote(attrtype_t t)
+        {
+            if(type == t || type == ATTRTYPE_DOUBLE)
+                return;
+
+            if(t == ATTRTYPE_FRACTION) {
+                // apply() promotes longs beyond an int to doubles.
+                assert(fits_int(val._long));
+
+                fraction f = {static_cast<int>(val._long), 1};
+                val._fraction = f;
+            }
+            else if(type == ATTRTYPE_LONG)
+                val._double = static_cast<double>(val._long);
+            else
+                val._double = static_cast<double>(val._fraction.z)/
+                    static_cast<double>(val._fraction.n);
+
+            type = t;
+        }
+
+        template <template <typename Type> class Operator, char OpName>
+        void apply(const number& b)
+        {
+            if(type == ATTRTYPE_LONG && b.atype == ATTRTYPE_LONG) {
+                if(OpName == '/' && b.val._long == 0)
+                    throw arith_error("division by zero");
+
+                long long result;
+
+                if(fixnum_op<OpName>(val._long, b.val._long, result)) {
+                    val._long = result;
+                    return;
+                }
+            }
+
+            // Longs that don't fit a fraction continue as doubles.
+            // Results that overflow a long have such an operand.
+            if(type == ATTRTYPE_DOUBLE || b.atype == ATTRTYPE_DOUBLE ||
+               (type == ATTRTYPE_LONG && !fits_int(val._long)) ||
+               (b.atype == ATTRTYPE_LONG && !fits_int(b.val._long))) {
+                promote(ATTRTYPE_DOUBLE);
+
+                Operator<double> op;
+                val._double = op(val._double, b.as_double());
+                return;
+            }
+
+            promote(ATTRTYPE_FRACTION);
+
+            fraction other = b.val._fraction;
+
+            if(b.atype == ATTRTYPE_LONG) {
+                other.z = static_cast<int>(b.val._long);
+                other.n = 1;
+            }
+
+            Operator<fraction> op;
+            val._fraction = op(val._fraction, other);
+        }
+
+        object_ptr_t result() const
+        {
+            switch(type)
+            {
+            case ATTRTYPE_LONG:
+                return object_ptr_t(new number(val._long));
+
+            case ATTRTYPE_DOUBLE:
+                return object_ptr_t(new number(val._double));
+
+            case ATTRTYPE_FRACTION:
+                return object_ptr_t(new number(val._fraction));
+            }
+
+            assert(0);
+            return object_ptr_t();
+        }
+
+        attrtype_t type;
+        value_t val;
+    };
+
+    template <template <typename Type> class Operator, char OpName>
+    object_ptr_t number::fold(const argv_t& args)
+    {
+        const number* first = static_cast<const number*>(args[0].get());
+        size_t i = 1;
+
+        if(first->atype == ATTRTYPE_LONG) {
+            // All-long loop, leaves at the first operand needing
+            // promotion or overflowing.
+            long long acc = first->val._long;
+
+            for(; i < args.size(); ++i) {
+                const number* b = static_cast<const number*>(args[i].get());
+
+                if(b->atype != ATTRTYPE_LONG || !fixnum_op<OpName>(acc, b->val._long, acc))
+                    break;
+            }
+
+            if(i == args.size())
+                return object_ptr_t(new number(acc));
+
+            accumulator reg(acc);
+
+            for(; i < args.size(); ++i)
+                reg.apply<Operator, OpName>(*static_cast<const number*>(args[i].get()));
+
+            return reg.result();
+        }
+
+        accumulator reg(*first);
+
+        for(; i < args.size(); ++i)
+            reg.apply<Operator, OpName>(*static_cast<const number*>(args[i].get()));
+
+        return reg.result();
+    }
+
+    template object_ptr_t number::fold<std::plus, '+'>(const argv_t& args);
+    template object_ptr_t number::fold<std::minus, '-'>(const argv_t& args);
+    template object_ptr_t number::fold<std::multiplies, '*'>(const argv_t& args);
+    template object_ptr_t number::fold<std::divides, '/'>(const argv_t& args);
+
     template <template <typename Type> class Operator, int OpNum>
     bool number::binary_comp_op(const number &b) const
     {
@@ -338,10 +560,15 @@ namespace lisp {
             }
 	    case ATTRTYPE_FRACTION:
 	    {
-		Operator<const fraction&> op;
-		fraction tmp = {val._long, 1};
+		long long scaled, z;
+
+		if(!scale_to_fraction(val._long, b.val._fraction.z, b.val._fraction.n, scaled, z)) {
+		    Operator<double> op;
+		    return op(static_cast<double>(val._long), b.as_double());
+		}
 
-		return op(tmp, b.val._fraction);
+		Operator<long long> op;
+		return op(scaled, z);
 	    }
             }
             break;
@@ -366,9 +593,10 @@ namespace lisp {
 	    case ATTRTYPE_FRACTION:
 	    {
 		Operator<double> op;
-		double tmp = val._double;
+		number a(b);
+		a.convert_type(ATTRTYPE_DOUBLE);
 
-		return op(tmp, b.val._double);
+		return op(val._double, a.val._double);
 	    }
             }
             break;
@@ -380,10 +608,15 @@ namespace lisp {
             {
             case ATTRTYPE_LONG:
             {
-		Operator<const fraction&> op;
-		fraction tmp = {b.val._long, 1};
+		long long scaled, z;
+
+		if(!scale_to_fraction(b.val._long, val._fraction.z, val._fraction.n, scaled, z)) {
+		    Operator<double> op;
+		    return op(as_double(), static_cast<double>(b.val._long));
+		}
 
-		return op(val._fraction, tmp);
+		Operator<long long> op;
+		return op(z, scaled);
             }
             case ATTRTYPE_DOUBLE:
             {
@@ -436,7 +436,22 @@ namespace lisp
         template <template <typename Type> class Operator, char OpName>
         number           binary_arith_op(const number &b) const;
     
+        /// Typed register used by fold().
+        struct accumulator;
+
     public:
+        /** Combines all numbers in args from left to right with the
+         * operator and returns the result as a new object. The arguments
+         * are never modified.
+         *
+         * The intermediate result is kept in a local register which is
+         * promoted from long to fraction to double as the operands
+         * require. Runs of long operands take a specialized loop. Every
+         * element of args has to be a number.
+         */
+        template <template <typename Type> class Operator, char OpName>
+        static object_ptr_t fold(const argv_t& args);
+
         /// Instantiation of binary_arith_op for "+" plus.
         inline number    operator+(const number &b) const
             {
@@ -2,14 +2,43 @@
 #include "object.hpp"
 
 #include <sstream>
+#include <cassert>
 
 
 namespace lisp {
+    namespace {
+        thread_local allocation_counts allocations = { 0, 0 };
+    }
+
+    void* object::operator new(std::size_t size)
+    {
+        ++allocations.objects;
+        allocations.bytes += size;
+
+        return ::operator new(size);
+    }
+
+    void object::operator delete(void* mem)
+    {
+        ::operator delete(mem);
+    }
+
+    allocation_counts thread_allocations()
+    {
+        return allocations;
+    }
+
     object_ptr_t object::operator()(environment* env, const cons_cell_ptr_t args)
     {
         return object_ptr_t();
     }
 
+    object_ptr_t object::apply(environment*, const argv_t&)
+    {
+        assert(false);
+        return object_ptr_t();
+    }
+
     std::string object::str() const
     {
         std::stringstream ss;
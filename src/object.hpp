@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
 
 #include <boost/shared_ptr.hpp>
 
@@ -17,6 +18,131 @@ namespace lisp {
     class cons_cell;
     typedef boost::shared_ptr<cons_cell> cons_cell_ptr_t;
 
+    class node;
+    typedef boost::shared_ptr<node> node_ptr_t;
+
+
+    /**
+       @brief A view on evaluated arguments which are stored
+       elsewhere, usually in an arg_buffer on the caller's stack.
+    */
+    class argv_t
+    {
+    public:
+        typedef const object_ptr_t* const_iterator;
+
+        argv_t()
+            : m_begin(0),
+              m_size(0)
+            {
+            }
+
+        argv_t(const object_ptr_t* begin, std::size_t size)
+            : m_begin(begin),
+              m_size(size)
+            {
+            }
+
+        argv_t(const std::vector<object_ptr_t>& args)
+            : m_begin(args.empty() ? 0 : &args[0]),
+              m_size(args.size())
+            {
+            }
+
+        std::size_t size() const
+            {
+                return m_size;
+            }
+
+        bool empty() const
+            {
+                return m_size == 0;
+            }
+
+        const object_ptr_t& operator[](std::size_t i) const
+            {
+                return m_begin[i];
+            }
+
+        const_iterator begin() const
+            {
+                return m_begin;
+            }
+
+        const_iterator end() const
+            {
+                return m_begin + m_size;
+            }
+
+    private:
+        const object_ptr_t* m_begin;
+        std::size_t m_size;
+    };
+
+    /**
+       @brief Collects evaluated arguments without allocating memory
+       as long as there are at most `inline_size' of them.
+    */
+    class arg_buffer
+    {
+    public:
+        enum { inline_size = 8 };
+
+        arg_buffer()
+            : m_size(0)
+            {
+            }
+
+        void push_back(const object_ptr_t& obj)
+            {
+                if(m_size < inline_size)
+                    m_inline[m_size] = obj;
+                else {
+                    if(m_size == inline_size)
+                        // Keep the arguments contiguous.
+                        m_overflow.assign(m_inline, m_inline + inline_size);
+
+                    m_overflow.push_back(obj);
+                }
+
+                ++m_size;
+            }
+
+        /**
+           @brief Releases the held arguments but keeps the memory.
+        */
+        void clear()
+            {
+                for(std::size_t i = 0; i < m_size && i < inline_size; ++i)
+                    m_inline[i].reset();
+
+                m_overflow.clear();
+                m_size = 0;
+            }
+
+        std::size_t size() const
+            {
+                return m_size;
+            }
+
+        operator argv_t() const
+            {
+                if(m_size > inline_size)
+                    return argv_t(&m_overflow[0], m_size);
+
+                return argv_t(m_inline, m_size);
+            }
+
+    private:
+        // Disable copying
+        arg_buffer(const arg_buffer&);
+        arg_buffer& operator=(const arg_buffer&);
+
+        object_ptr_t m_inline[inline_size];
+        std::vector<object_ptr_t> m_overflow;
+        std::size_t m_size;
+    };
+
 
     /**
        @brief Base class for all objects.
@@ -24,8 +150,6 @@ namespace lisp {
     class object
     {
     public:
-        typedef std::vector<object_ptr_t> arglist_t;
-
         object()
             : m_class_id(typeid(*this).name())
             {
@@ -55,6 +179,26 @@ namespace lisp {
                 return false;
             }
 
+        /**
+           @brief Is overridden by callable objects that take their
+           arguments already evaluated (lisp functions and builtins)
+           and should only return true in that case.
+
+           Forms like `if' evaluate their arguments themselves and
+           therefore return false.
+        */
+        virtual bool is_applicable() const
+            {
+                return false;
+            }
+
+        /**
+           @brief Calls the object with already evaluated arguments.
+
+           Must only be called if is_applicable() returns true.
+        */
+        virtual object_ptr_t apply(environment* env, const argv_t& args);
+
         /**
            @brief Returns a string that represents the object.
         */
@@ -72,6 +216,13 @@ namespace lisp {
                 return m_class_id;
             }
 
+        /**
+           @brief Allocates an object and counts it for
+           thread_allocations().
+        */
+        static void* operator new(std::size_t size);
+        static void operator delete(void* mem);
+
         friend class environment;
 
     protected:
@@ -98,6 +249,18 @@ namespace lisp {
     private:
         std::string m_class_id;
     };
+
+    struct allocation_counts
+    {
+        std::uint64_t objects;
+        std::uint64_t bytes;
+    };
+
+    /**
+       @brief Returns the number and size of the lisp objects the
+       calling thread allocated so far, see (time EXPR).
+    */
+    allocation_counts thread_allocations();
 }
 
 #endif  // LISP_OBJECT_HPP
@@ -0,0 +1,68 @@
+#include "parallel.hpp"
+
+#include <atomic>
+#include <exception>
+#include <vector>
+
+#include "lisp.hpp"
+#include "runtime.hpp"
+#include "thread_pool.hpp"
+
+
+namespace lisp {
+    namespace {
+        // Chunks per thread, so that threads that finish early can
+        // steal the remaining work.
+        const std::size_t chunks_per_thread = 4;
+    }
+
+    void parallel_chunks(std::size_t count,
+                         const std::function<void(environment* env, std::size_t begin,
+                                                  std::size_t end)>& body)
+    {
+        if(count == 0)
+            return;
+
+        runtime& rt = runtime::current();
+
+        if(rt.pool_size() == 1) {
+            environment env(rt.global_env());
+
+            body(&env, 0, count);
+            return;
+        }
+
+        thread_pool& pool = rt.pool();
+        const std::size_t chunk_count = std::min(count, pool.size() * chunks_per_thread);
+
+        std::vector<std::exception_ptr> errors(chunk_count);
+        std::atomic<std::size_t> remaining(chunk_count);
+        std::atomic<bool> failed(false);
+
+        for(std::size_t i = 0; i < chunk_count; ++i) {
+            pool.submit([&rt, &body, &errors, &remaining, &failed, count, chunk_count, i]() {
+                    if(!failed) {
+                        try {
+                            runtime::scope scope(rt);
+                            environment env(rt.global_env());
+
+                            body(&env, count * i / chunk_count, count * (i + 1) / chunk_count);
+                        }
+                        catch(...) {
+                            errors[i] = std::current_exception();
+                            failed = true;
+                        }
+                    }
+
+                    --remaining;
+                });
+        }
+
+        pool.help_until([&remaining]() { return remaining == 0; });
+
+        for(std::size_t i = 0; i < chunk_count; ++i) {
+            if(errors[i])
+                std::rethrow_exception(errors[i]);
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef LISP_PARALLEL_HPP
+#define LISP_PARALLEL_HPP
+
+#include <functional>
+
+#include "object.hpp"
+
+
+namespace lisp {
+    /**
+       @brief Runs @a body for the chunks [begin, end) of the
+       indices 0 ... @a count - 1 on the thread pool of the current
+       runtime and waits until all of them are done.
+
+       Every chunk is evaluated in an environment of its own whose
+       parent is the global environment, so bindings of the caller's
+       dynamic environment aren't visible in @a body.
+
+       Once a chunk fails the chunks that didn't start yet are
+       skipped. The error of the first failed chunk is rethrown
+       after all chunks are done.
+    */
+    void parallel_chunks(std::size_t count,
+                         const std::function<void(environment* env, std::size_t begin,
+                                                  std::size_t end)>& body);
+}
+
+#endif  // LISP_PARALLEL_HPP
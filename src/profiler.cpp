@@ -0,0 +1,349 @@
+#include "profiler.hpp"
+
+#include <signal.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "lisp.hpp"
+#include "runtime.hpp"
+
+
+namespace lisp {
+    namespace profiler {
+        std::atomic<int> recording(0);
+
+        namespace {
+            // Slots of the sample buffer, 8 MiB.
+            const std::size_t buffer_size = 1 << 20;
+
+            /**
+               @brief The samples of a run. Every sample takes the
+               number of its calls followed by the calls, claimed by
+               the signal handler with a single fetch_add.
+            */
+            struct sample_buffer
+            {
+                sample_buffer()
+                    : slots(new std::uintptr_t[buffer_size]()),
+                      used(0),
+                      ticks(0),
+                      samples(0),
+                      dropped(0),
+                      cpu_time(0)
+                    {
+                    }
+
+                boost::scoped_array<std::uintptr_t> slots;
+                std::atomic<std::size_t> used;
+                // Signals received, with or without lisp calls.
+                std::atomic<std::size_t> ticks;
+                std::atomic<std::size_t> samples;
+                std::atomic<std::size_t> dropped;
+                // Process CPU time of the run in nanoseconds.
+                double cpu_time;
+            };
+
+            thread_local call_stack own_stack;
+            thread_local call_stack* current = 0;
+
+            std::atomic<sample_buffer*> active(0);
+            std::atomic<int> handlers_running(0);
+
+            // Guard start(), stop() and report().
+            std::mutex control_mutex;
+            boost::scoped_ptr<sample_buffer> last_run;
+            bool running = false;
+            bool handler_installed = false;
+
+            call_stack& stack_of_thread()
+            {
+                return current ? *current : own_stack;
+            }
+
+            /**
+               @brief Copies the shadow stack of the interrupted
+               thread. Only touches preallocated memory and lock-free
+               atomics.
+            */
+            void on_sample(int)
+            {
+                const int saved_errno = errno;
+
+                // Counted before active is read, see stop().
+                handlers_running.fetch_add(1);
+
+                if(sample_buffer* buffer = active.load()) {
+                    buffer->ticks.fetch_add(1, std::memory_order_relaxed);
+
+                    const call_stack& stack = stack_of_thread();
+                    const std::size_t depth =
+                        std::min<std::size_t>(stack.depth.load(std::memory_order_acquire),
+                                              call_stack::capacity);
+
+                    if(depth > 0) {
+                        const std::size_t at =
+                            buffer->used.fetch_add(depth + 1, std::memory_order_relaxed);
+
+                        if(at + depth + 1 <= buffer_size) {
+                            for(std::size_t i = 0; i < depth; ++i)
+                                buffer->slots[at + 1 + i] =
+                                    reinterpret_cast<std::uintptr_t>(stack.calls[i]);
+
+                            buffer->slots[at] = depth;
+                            buffer->samples.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        else
+                            buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+
+                handlers_running.fetch_sub(1);
+
+                errno = saved_errno;
+            }
+
+            void set_timer(long interval)
+            {
+                itimerval timer;
+
+                timer.it_interval.tv_sec = interval / 1000000;
+                timer.it_interval.tv_usec = interval % 1000000;
+                timer.it_value = timer.it_interval;
+
+                setitimer(ITIMER_PROF, &timer, 0);
+            }
+
+            double cpu_clock()
+            {
+                timespec now;
+
+                clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+
+                return now.tv_sec * 1e9 + now.tv_nsec;
+            }
+
+            void stop_locked()
+            {
+                if(!running)
+                    return;
+
+                set_timer(0);
+                last_run->cpu_time = cpu_clock() - last_run->cpu_time;
+                --recording;
+                active.store(0);
+
+                // A handler that read the buffer before is still
+                // counted.
+                while(handlers_running.load() != 0)
+                    std::this_thread::yield();
+
+                running = false;
+            }
+
+            std::string format_ms(double ns)
+            {
+                std::ostringstream os;
+
+                os << std::fixed << std::setprecision(1) << ns / 1e6;
+
+                return os.str();
+            }
+        }
+
+        call_stack& current_stack()
+        {
+            return stack_of_thread();
+        }
+
+        stack_scope::stack_scope(call_stack& stack)
+            : m_previous(current)
+        {
+            current = &stack;
+        }
+
+        stack_scope::~stack_scope()
+        {
+            current = m_previous;
+        }
+
+        call_counter::call_counter()
+            : m_stack(current_stack()),
+              m_depth(m_stack.depth.load(std::memory_order_relaxed)),
+              m_pushed(m_stack.pushed),
+              m_peak(m_stack.peak)
+        {
+            m_stack.peak = m_depth;
+            ++recording;
+        }
+
+        call_counter::~call_counter()
+        {
+            --recording;
+            m_stack.peak = std::max(m_stack.peak, m_peak);
+        }
+
+        std::uint64_t call_counter::calls() const
+        {
+            return m_stack.pushed - m_pushed;
+        }
+
+        std::size_t call_counter::peak_depth() const
+        {
+            return m_stack.peak - m_depth;
+        }
+
+        void start(long interval)
+        {
+            std::lock_guard<std::mutex> lock(control_mutex);
+
+            stop_locked();
+
+            // The handler stays installed, a signal that is still
+            // pending after stop() must not kill the process.
+            if(!handler_installed) {
+                struct sigaction action;
+
+                action.sa_handler = on_sample;
+                action.sa_flags = SA_RESTART;
+                sigemptyset(&action.sa_mask);
+                sigaction(SIGPROF, &action, 0);
+
+                handler_installed = true;
+            }
+
+            last_run.reset(new sample_buffer);
+            running = true;
+
+            last_run->cpu_time = cpu_clock();
+            active.store(last_run.get());
+            ++recording;
+            set_timer(std::max(interval, 1L));
+        }
+
+        void stop()
+        {
+            std::lock_guard<std::mutex> lock(control_mutex);
+
+            stop_locked();
+        }
+
+        bool is_running()
+        {
+            std::lock_guard<std::mutex> lock(control_mutex);
+
+            return running;
+        }
+
+        report_t report()
+        {
+            std::lock_guard<std::mutex> lock(control_mutex);
+
+            stop_locked();
+
+            report_t result;
+
+            if(!last_run)
+                return result;
+
+            // Objects that aren't found are never dereferenced, they
+            // may be gone.
+            std::unordered_map<std::uintptr_t, std::string> names;
+
+            runtime::current().global_env()->for_each_own_symbol([&names](const symbol& sym) {
+                    if(const object_ptr_t f = sym.raw_function())
+                        names.insert(std::make_pair(reinterpret_cast<std::uintptr_t>(f.get()),
+                                                    sym.name()));
+                });
+
+            std::map<std::string, std::size_t> stacks;
+            std::map<std::string, std::pair<std::size_t, std::size_t> > functions;
+            const std::uintptr_t* slots = last_run->slots.get();
+            const std::size_t used = std::min(last_run->used.load(), buffer_size);
+
+            // A sample that didn't fit leaves its count at zero.
+            for(std::size_t at = 0; at < used && slots[at] != 0; at += slots[at] + 1) {
+                const std::size_t depth = slots[at];
+                std::string stack;
+                std::set<std::string> seen;
+
+                for(std::size_t i = 0; i < depth; ++i) {
+                    std::unordered_map<std::uintptr_t, std::string>::const_iterator name =
+                        names.find(slots[at + 1 + i]);
+                    const std::string& call = name == names.end() ? "<lambda>" : name->second;
+
+                    if(i > 0)
+                        stack += ';';
+                    stack += call;
+
+                    // Recursive calls count once towards the total.
+                    if(seen.insert(call).second)
+                        ++functions[call].second;
+
+                    if(i == depth - 1)
+                        ++functions[call].first;
+                }
+
+                ++stacks[stack];
+            }
+
+            std::ostringstream folded;
+
+            for(std::map<std::string, std::size_t>::const_iterator i = stacks.begin();
+                i != stacks.end(); ++i)
+                folded << i->first << ' ' << i->second << '\n';
+
+            result.folded = folded.str();
+
+            typedef std::pair<std::string, std::pair<std::size_t, std::size_t> > row_t;
+            std::vector<row_t> rows(functions.begin(), functions.end());
+
+            std::stable_sort(rows.begin(), rows.end(), [](const row_t& a, const row_t& b) {
+                    return a.second.first != b.second.first ?
+                        a.second.first > b.second.first :
+                        a.second.second > b.second.second;
+                });
+
+            std::ostringstream table;
+
+            // The kernel may deliver the signals less often than
+            // asked for, the CPU time is spread over the signals
+            // that were received.
+            const std::size_t ticks = last_run->ticks.load();
+            const double per_sample = ticks ? last_run->cpu_time / ticks : 0.0;
+
+            table << last_run->samples.load() << " samples in "
+                  << format_ms(last_run->cpu_time) << " ms of CPU time";
+
+            if(const std::size_t dropped = last_run->dropped.load())
+                table << ", " << dropped << " dropped";
+
+            table << '\n'
+                  << std::setw(10) << "self ms" << std::setw(10) << "total ms"
+                  << "  function\n";
+
+            for(std::size_t i = 0; i < rows.size(); ++i)
+                table << std::setw(10) << format_ms(rows[i].second.first * per_sample)
+                      << std::setw(10) << format_ms(rows[i].second.second * per_sample)
+                      << "  " << rows[i].first << '\n';
+
+            result.table = table.str();
+
+            return result;
+        }
+    }
+}
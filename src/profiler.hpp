@@ -0,0 +1,198 @@
+#ifndef LISP_PROFILER_HPP
+#define LISP_PROFILER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include "object.hpp"
+
+
+namespace lisp {
+    /**
+       @brief A sampling profiler for lisp code, see (profile-start)
+       and (profile-report).
+
+       Function calls push the called function on a shadow call
+       stack of the calling thread or actor. While profiling a timer
+       signal (SIGPROF) interrupts the running threads in intervals
+       of CPU time and copies their shadow stacks into a buffer that
+       was allocated when profiling started. The samples are turned
+       into a table and folded stacks by report().
+
+       While the profiler is off a call only tests a flag.
+    */
+    namespace profiler {
+        /**
+           @brief The functions being called by a thread or an actor,
+           outermost first.
+
+           Calls nested deeper than capacity are counted but not
+           recorded, their time is attributed to the deepest recorded
+           call. Must be zero-initialized.
+        */
+        struct call_stack
+        {
+            enum { capacity = 256 };
+
+            const object* calls[capacity];
+            std::atomic<std::size_t> depth;
+
+            // The calls pushed so far and the deepest depth reached,
+            // see call_counter.
+            std::uint64_t pushed;
+            std::size_t peak;
+        };
+
+        /**
+           @brief The number of profiling runs and call_counters
+           that need the calls recorded.
+        */
+        extern std::atomic<int> recording;
+
+        /**
+           @brief Returns the shadow stack of the running thread or
+           actor.
+        */
+        call_stack& current_stack();
+
+        /**
+           @brief Records a call on the shadow stack of the running
+           thread or actor while profiling is on.
+        */
+        class frame : private boost::noncopyable
+        {
+        public:
+            explicit frame(const object* callee)
+                : m_stack(recording.load(std::memory_order_relaxed) != 0 ? &current_stack() : 0)
+                {
+                    if(m_stack)
+                        push(callee);
+                }
+
+            ~frame()
+                {
+                    if(m_stack)
+                        m_stack->depth.store(m_index, std::memory_order_release);
+                }
+
+            /**
+               @brief Replaces the call by a tail call to @a callee.
+            */
+            void replace(const object* callee)
+                {
+                    if(m_stack && m_index < call_stack::capacity)
+                        m_stack->calls[m_index] = callee;
+                }
+
+        private:
+            void push(const object* callee)
+                {
+                    m_index = m_stack->depth.load(std::memory_order_relaxed);
+
+                    if(m_index < call_stack::capacity)
+                        m_stack->calls[m_index] = callee;
+
+                    // The signal handler reads the stack up to depth.
+                    m_stack->depth.store(m_index + 1, std::memory_order_release);
+
+                    ++m_stack->pushed;
+
+                    if(m_index + 1 > m_stack->peak)
+                        m_stack->peak = m_index + 1;
+                }
+
+            call_stack* m_stack;
+            std::size_t m_index;
+        };
+
+        /**
+           @brief Makes @a stack the shadow stack of the calling
+           thread while the scope exists. Used by the scheduler to
+           give each actor a stack of its own.
+        */
+        class stack_scope : private boost::noncopyable
+        {
+        public:
+            explicit stack_scope(call_stack& stack);
+            ~stack_scope();
+
+        private:
+            call_stack* m_previous;
+        };
+
+        /**
+           @brief Records the calls of the running thread or actor
+           while it exists, see (time EXPR).
+        */
+        class call_counter : private boost::noncopyable
+        {
+        public:
+            call_counter();
+            ~call_counter();
+
+            /**
+               @brief The calls made since the counter was created.
+            */
+            std::uint64_t calls() const;
+
+            /**
+               @brief The deepest nesting of calls since the counter
+               was created, relative to the depth it was created at.
+            */
+            std::size_t peak_depth() const;
+
+        private:
+            call_stack& m_stack;
+            const std::size_t m_depth;
+            const std::uint64_t m_pushed;
+            const std::size_t m_peak;
+        };
+
+        /**
+           @brief Starts sampling every @a interval microseconds of
+           CPU time, discarding the samples of an earlier run. The
+           kernel may round the interval up to its timer tick.
+        */
+        void start(long interval = 1000);
+
+        /**
+           @brief Stops sampling, the samples are kept for report().
+        */
+        void stop();
+
+        bool is_running();
+
+        /**
+           @brief The result of a profiling run.
+        */
+        struct report_t
+        {
+            /**
+               @brief One line per distinct call stack: the function
+               names from outermost to innermost separated by `;',
+               followed by the number of samples.
+            */
+            std::string folded;
+
+            /**
+               @brief The self and total time of every sampled
+               function, most expensive first.
+            */
+            std::string table;
+        };
+
+        /**
+           @brief Stops sampling and summarizes the samples.
+
+           Functions are named after the symbols of the global
+           environment of the current runtime whose function cell
+           holds them, unnamed ones are shown as `<lambda>'.
+        */
+        report_t report();
+    }
+}
+
+#endif  // LISP_PROFILER_HPP
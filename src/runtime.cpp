@@ -0,0 +1,281 @@
+#include "runtime.hpp"
+
+#include "lisp.hpp"
+#include "function.hpp"
+#include "forms.hpp"
+#include "thread_pool.hpp"
+#include "scheduler.hpp"
+
+
+namespace lisp {
+    namespace {
+        // The runtime bound to the thread by runtime::scope.
+        thread_local runtime* current_runtime = 0;
+
+        runtime& default_runtime()
+        {
+            static runtime rt;
+
+            return rt;
+        }
+    }
+
+    runtime::scope::scope(runtime& rt)
+        : m_previous(current_runtime)
+    {
+        current_runtime = &rt;
+    }
+
+    runtime::scope::~scope()
+    {
+        current_runtime = m_previous;
+    }
+
+    runtime& runtime::current()
+    {
+        return current_runtime ? *current_runtime : default_runtime();
+    }
+
+    runtime::runtime()
+        : m_nil(new nil_object),
+          m_t(new t_object),
+          m_definition_version(0),
+          m_local_functions(false),
+          m_hash_epoch(1),
+          m_pool_size(std::max(1u, std::thread::hardware_concurrency()))
+    {
+        // The builtins and the symbols refer to nil() of this
+        // runtime.
+        scope current(*this);
+
+        m_global_env.reset(new environment());
+
+        // Register default forms.
+        m_global_env->get_symbol("lambda")->set_function(
+            object_ptr_t(new lambda_form()));
+        m_global_env->get_symbol("if")->set_function(
+            object_ptr_t(new if_form()));
+        m_global_env->get_symbol("or")->set_function(
+            object_ptr_t(new or_form()));
+        m_global_env->get_symbol("and")->set_function(
+            object_ptr_t(new and_form()));
+        m_global_env->get_symbol("print")->set_function(
+            object_ptr_t(new print_function()));
+        m_global_env->get_symbol("fset")->set_function(
+            object_ptr_t(new fset_form()));
+        m_global_env->get_symbol("setf")->set_function(
+            object_ptr_t(new setf_form()));
+        m_global_env->get_symbol("setq")->set_function(
+            object_ptr_t(new setq_form()));
+        m_global_env->get_symbol("defun")->set_function(
+            object_ptr_t(new defun_form()));
+        m_global_env->get_symbol("condition-case")->set_function(
+            object_ptr_t(new condition_case_form()));
+        m_global_env->get_symbol("unwind-protect")->set_function(
+            object_ptr_t(new unwind_protect_form()));
+        m_global_env->get_symbol("signal")->set_function(
+            object_ptr_t(new signal_function()));
+        m_global_env->get_symbol("eq")->set_function(
+            object_ptr_t(new predicate_function<eq>("eq")));
+        m_global_env->get_symbol("eql")->set_function(
+            object_ptr_t(new predicate_function<eql>("eql")));
+        m_global_env->get_symbol("equal")->set_function(
+            object_ptr_t(new predicate_function<equal>("equal")));
+        m_global_env->get_symbol("sxhash")->set_function(
+            object_ptr_t(new sxhash_function()));
+        m_global_env->get_symbol("+")->set_function(
+            object_ptr_t(new arith_op_form<std::plus, '+'>()));
+        m_global_env->get_symbol("-")->set_function(
+            object_ptr_t(new arith_op_form<std::minus, '-'>()));
+        m_global_env->get_symbol("*")->set_function(
+            object_ptr_t(new arith_op_form<std::multiplies, '*'>()));
+        m_global_env->get_symbol("/")->set_function(
+            object_ptr_t(new arith_op_form<std::divides, '/'>()));
+        m_global_env->get_symbol("=")->set_function(
+            object_ptr_t(new comparison_form<std::equal_to>("=")));
+        m_global_env->get_symbol("<")->set_function(
+            object_ptr_t(new comparison_form<std::less>("<")));
+        m_global_env->get_symbol(">")->set_function(
+            object_ptr_t(new comparison_form<std::greater>(">")));
+        m_global_env->get_symbol("<=")->set_function(
+            object_ptr_t(new comparison_form<std::less_equal>("<=")));
+        m_global_env->get_symbol(">=")->set_function(
+            object_ptr_t(new comparison_form<std::greater_equal>(">=")));
+        m_global_env->get_symbol("/=")->set_function(
+            object_ptr_t(new distinct_form()));
+        m_global_env->get_symbol("make-hash-table")->set_function(
+            object_ptr_t(new make_hash_table_function()));
+        m_global_env->get_symbol("gethash")->set_function(
+            object_ptr_t(new gethash_function()));
+        m_global_env->get_symbol("puthash")->set_function(
+            object_ptr_t(new puthash_function()));
+        m_global_env->get_symbol("remhash")->set_function(
+            object_ptr_t(new remhash_function()));
+        m_global_env->get_symbol("maphash")->set_function(
+            object_ptr_t(new maphash_function()));
+        m_global_env->get_symbol("hash-table-count")->set_function(
+            object_ptr_t(new hash_table_count_function()));
+        m_global_env->get_symbol("make-vector")->set_function(
+            object_ptr_t(new make_vector_function()));
+        m_global_env->get_symbol("vector")->set_function(
+            object_ptr_t(new vector_function()));
+        m_global_env->get_symbol("aref")->set_function(
+            object_ptr_t(new aref_function()));
+        m_global_env->get_symbol("aset")->set_function(
+            object_ptr_t(new aset_function()));
+        m_global_env->get_symbol("vector-length")->set_function(
+            object_ptr_t(new vector_length_function()));
+        m_global_env->get_symbol("vconcat")->set_function(
+            object_ptr_t(new vconcat_function()));
+        m_global_env->get_symbol("apply")->set_function(
+            object_ptr_t(new apply_function_form()));
+        m_global_env->get_symbol("f64-array")->set_function(
+            object_ptr_t(new make_typed_array_function<double>()));
+        m_global_env->get_symbol("i64-array")->set_function(
+            object_ptr_t(new make_typed_array_function<long long>()));
+        m_global_env->get_symbol("array+")->set_function(
+            object_ptr_t(new array_elementwise_function<add_kernel>("array+")));
+        m_global_env->get_symbol("array-")->set_function(
+            object_ptr_t(new array_elementwise_function<sub_kernel>("array-")));
+        m_global_env->get_symbol("array*")->set_function(
+            object_ptr_t(new array_elementwise_function<mul_kernel>("array*")));
+        m_global_env->get_symbol("array/")->set_function(
+            object_ptr_t(new array_elementwise_function<div_kernel>("array/")));
+        m_global_env->get_symbol("array<")->set_function(
+            object_ptr_t(new array_mask_function<less_kernel>("array<")));
+        m_global_env->get_symbol("array>")->set_function(
+            object_ptr_t(new array_mask_function<greater_kernel>("array>")));
+        m_global_env->get_symbol("array=")->set_function(
+            object_ptr_t(new array_mask_function<equal_kernel>("array=")));
+        m_global_env->get_symbol("array-sum")->set_function(
+            object_ptr_t(new array_reduce_function<sum_kernel>("array-sum", true)));
+        m_global_env->get_symbol("array-min")->set_function(
+            object_ptr_t(new array_reduce_function<min_kernel>("array-min", false)));
+        m_global_env->get_symbol("array-max")->set_function(
+            object_ptr_t(new array_reduce_function<max_kernel>("array-max", false)));
+        m_global_env->get_symbol("array-dot")->set_function(
+            object_ptr_t(new array_dot_function()));
+        m_global_env->get_symbol("array-scale")->set_function(
+            object_ptr_t(new array_scale_function()));
+        m_global_env->get_symbol("array-to-list")->set_function(
+            object_ptr_t(new array_to_list_function()));
+        m_global_env->get_symbol("array-length")->set_function(
+            object_ptr_t(new array_length_function()));
+        m_global_env->get_symbol("car")->set_function(
+            object_ptr_t(new car_function()));
+        m_global_env->get_symbol("cdr")->set_function(
+            object_ptr_t(new cdr_function()));
+        m_global_env->get_symbol("cons")->set_function(
+            object_ptr_t(new cons_function()));
+        m_global_env->get_symbol("list")->set_function(
+            object_ptr_t(new list_function()));
+        m_global_env->get_symbol("length")->set_function(
+            object_ptr_t(new length_function()));
+        m_global_env->get_symbol("nth")->set_function(
+            object_ptr_t(new nth_function()));
+        m_global_env->get_symbol("append")->set_function(
+            object_ptr_t(new append_function()));
+        m_global_env->get_symbol("reverse")->set_function(
+            object_ptr_t(new reverse_function()));
+        m_global_env->get_symbol("mapcar")->set_function(
+            object_ptr_t(new mapcar_function()));
+        m_global_env->get_symbol("reduce")->set_function(
+            object_ptr_t(new reduce_function()));
+        m_global_env->get_symbol("member")->set_function(
+            object_ptr_t(new member_function()));
+        m_global_env->get_symbol("assoc")->set_function(
+            object_ptr_t(new assoc_function()));
+        m_global_env->get_symbol("setcar")->set_function(
+            object_ptr_t(new setcar_function()));
+        m_global_env->get_symbol("setcdr")->set_function(
+            object_ptr_t(new setcdr_function()));
+        m_global_env->get_symbol("nconc")->set_function(
+            object_ptr_t(new nconc_function()));
+        m_global_env->get_symbol("nreverse")->set_function(
+            object_ptr_t(new nreverse_function()));
+        m_global_env->get_symbol("pmapcar")->set_function(
+            object_ptr_t(new pmapcar_function()));
+        m_global_env->get_symbol("preduce")->set_function(
+            object_ptr_t(new preduce_function()));
+        m_global_env->get_symbol("set-pool-size")->set_function(
+            object_ptr_t(new set_pool_size_function()));
+        m_global_env->get_symbol("future")->set_function(
+            object_ptr_t(new future_form()));
+        m_global_env->get_symbol("await")->set_function(
+            object_ptr_t(new await_function()));
+        m_global_env->get_symbol("spawn")->set_function(
+            object_ptr_t(new spawn_form()));
+        m_global_env->get_symbol("send")->set_function(
+            object_ptr_t(new send_function()));
+        m_global_env->get_symbol("receive")->set_function(
+            object_ptr_t(new receive_function()));
+        m_global_env->get_symbol("self")->set_function(
+            object_ptr_t(new self_function()));
+        m_global_env->get_symbol("make-atom")->set_function(
+            object_ptr_t(new make_atom_function()));
+        m_global_env->get_symbol("deref")->set_function(
+            object_ptr_t(new deref_function()));
+        m_global_env->get_symbol("reset!")->set_function(
+            object_ptr_t(new reset_function()));
+        m_global_env->get_symbol("swap!")->set_function(
+            object_ptr_t(new swap_function()));
+        m_global_env->get_symbol("compare-and-set!")->set_function(
+            object_ptr_t(new compare_and_set_function()));
+        m_global_env->get_symbol("atom-retries")->set_function(
+            object_ptr_t(new atom_retries_function()));
+        m_global_env->get_symbol("profile-start")->set_function(
+            object_ptr_t(new profile_start_function()));
+        m_global_env->get_symbol("profile-report")->set_function(
+            object_ptr_t(new profile_report_function()));
+        m_global_env->get_symbol("eval-stats")->set_function(
+            object_ptr_t(new eval_stats_function()));
+        m_global_env->get_symbol("time")->set_function(
+            object_ptr_t(new time_form()));
+        m_global_env->get_symbol("benchmark")->set_function(
+            object_ptr_t(new benchmark_form()));
+    }
+
+    runtime::~runtime()
+    {
+        scope current(*this);
+
+        // Actors may wait for the pool, not vice versa.
+        m_scheduler.reset();
+        m_pool.reset();
+        m_global_env.reset();
+        m_retired.clear();
+    }
+
+    thread_pool& runtime::pool()
+    {
+        std::lock_guard<std::mutex> lock(m_pool_mutex);
+
+        if(!m_pool)
+            m_pool.reset(new thread_pool(m_pool_size));
+
+        return *m_pool;
+    }
+
+    bool runtime::set_pool_size(std::size_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_pool_mutex);
+
+        if(m_pool && !m_pool->idle())
+            return false;
+
+        m_pool.reset();
+        m_pool_size = std::max<std::size_t>(size, 1);
+
+        return true;
+    }
+
+    scheduler& runtime::scheduler()
+    {
+        std::lock_guard<std::mutex> lock(m_scheduler_mutex);
+
+        if(!m_scheduler)
+            m_scheduler.reset(new lisp::scheduler(*this, pool_size()));
+
+        return *m_scheduler;
+    }
+}
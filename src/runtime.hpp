@@ -0,0 +1,184 @@
+#ifndef LISP_RUNTIME_HPP
+#define LISP_RUNTIME_HPP
+
+#include <atomic>
+#include <mutex>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "object.hpp"
+#include "epoch.hpp"
+
+
+namespace lisp {
+    class thread_pool;
+    class scheduler;
+
+    /**
+       @brief An independent interpreter instance.
+
+       Owns the nil and t objects, the global environment with the
+       builtins and the counters that invalidate cached lookups and
+       hashes. Runtimes share nothing, so different threads can
+       evaluate in their own runtimes in parallel.
+
+       nil(), t(), global_env() and friends refer to the current
+       runtime of the calling thread (see current()). Objects must
+       not be passed between runtimes.
+
+       Threads may share the global environment of a runtime by
+       binding it with a scope each: looking up, interning and
+       assigning global symbols is thread-safe (see
+       concurrent_symbol_table) and the counters are atomic.
+       Objects reachable from the symbols are not synchronized,
+       except for the caches that reading them fills: the inline
+       caches of analyzed function bodies and the hashes of lists
+       and strings are atomic. Threads may share objects as long as
+       none of them changes them.
+    */
+    class runtime : private boost::noncopyable
+    {
+    public:
+        /**
+           @brief Makes a runtime the current one of the calling
+           thread while the scope exists.
+        */
+        class scope : private boost::noncopyable
+        {
+        public:
+            explicit scope(runtime& rt);
+            ~scope();
+
+        private:
+            runtime* m_previous;
+        };
+
+        runtime();
+        ~runtime();
+
+        /**
+           @brief Returns the runtime the calling thread is bound to
+           by a scope or the default runtime if there's none.
+
+           The default runtime is created on first use and shared by
+           all threads that don't have their own.
+        */
+        static runtime& current();
+
+        const object_ptr_t& nil() const
+            {
+                return m_nil;
+            }
+
+        const object_ptr_t& t() const
+            {
+                return m_t;
+            }
+
+        environment* global_env() const
+            {
+                return m_global_env.get();
+            }
+
+        /**
+           @see lisp::definition_version().
+        */
+        unsigned long definition_version() const
+            {
+                return m_definition_version.load(std::memory_order_acquire);
+            }
+
+        void definitions_changed()
+            {
+                m_definition_version.fetch_add(1, std::memory_order_acq_rel);
+            }
+
+        /**
+           @brief Whether a function was ever bound to a symbol of a
+           local environment, e.g. by defun on the name of a
+           parameter. Function lookups can't be cached by function
+           scope (see environment::function_scope()) anymore then.
+        */
+        bool has_local_functions() const
+            {
+                return m_local_functions.load(std::memory_order_acquire);
+            }
+
+        void local_function_defined()
+            {
+                m_local_functions.store(true, std::memory_order_release);
+            }
+
+        /**
+           @see lisp::hash_epoch().
+        */
+        std::size_t hash_epoch() const
+            {
+                return m_hash_epoch.load(std::memory_order_relaxed);
+            }
+
+        void invalidate_hashes()
+            {
+                m_hash_epoch.fetch_add(1, std::memory_order_relaxed);
+            }
+
+        /**
+           @brief Destroys the function cells and cache entries that
+           other threads may still read once they can't anymore.
+        */
+        epoch::retired_list& retired()
+            {
+                return m_retired;
+            }
+
+        /**
+           @brief The thread pool of the parallel builtins, started on
+           first use.
+        */
+        thread_pool& pool();
+
+        std::size_t pool_size() const
+            {
+                return m_pool_size;
+            }
+
+        /**
+           @brief Changes the number of threads working for pool(),
+           counting the thread that waits for the results. Defaults
+           to the number of cores.
+
+           Returns false and keeps the pool if it is busy (see
+           thread_pool::idle()), e.g. if called by one of its tasks.
+        */
+        bool set_pool_size(std::size_t size);
+
+        /**
+           @brief The scheduler of the actors, started on first use
+           with pool_size() threads.
+        */
+        lisp::scheduler& scheduler();
+
+    private:
+        object_ptr_t m_nil;
+        object_ptr_t m_t;
+        boost::scoped_ptr<environment> m_global_env;
+
+        std::atomic<unsigned long> m_definition_version;
+        std::atomic<bool> m_local_functions;
+
+        // Starts at 1, so that new cells (epoch 0) are never hashed.
+        std::atomic<std::size_t> m_hash_epoch;
+
+        epoch::retired_list m_retired;
+
+        boost::scoped_ptr<thread_pool> m_pool;
+        std::size_t m_pool_size;
+        std::mutex m_pool_mutex;
+
+        boost::scoped_ptr<lisp::scheduler> m_scheduler;
+        std::mutex m_scheduler_mutex;
+    };
+}
+
+#endif  // LISP_RUNTIME_HPP
@@ -0,0 +1,144 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+
+#include "actor.hpp"
+#include "runtime.hpp"
+
+
+namespace lisp {
+    scheduler::scheduler(runtime& rt, std::size_t threads)
+        : m_runtime(rt),
+          m_next_worker(0)
+    {
+        for(std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i)
+            m_workers.push_back(new worker);
+
+        for(std::size_t i = 0; i < m_workers.size(); ++i)
+            m_workers[i].thread = std::thread(&scheduler::work, this, std::ref(m_workers[i]));
+    }
+
+    scheduler::~scheduler()
+    {
+        for(std::size_t i = 0; i < m_workers.size(); ++i) {
+            {
+                std::lock_guard<std::mutex> lock(m_workers[i].mutex);
+                m_workers[i].stop = true;
+            }
+
+            m_workers[i].wakeup.notify_one();
+        }
+
+        for(std::size_t i = 0; i < m_workers.size(); ++i)
+            m_workers[i].thread.join();
+    }
+
+    void scheduler::start(const boost::shared_ptr<actor>& a)
+    {
+        const std::size_t index = m_next_worker++ % m_workers.size();
+        worker& w = m_workers[index];
+
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+
+            a->m_worker = index;
+            w.actors.push_back(a);
+            w.ready.push_back(a.get());
+        }
+
+        w.wakeup.notify_one();
+    }
+
+    void scheduler::prepare_park(actor& a)
+    {
+        std::lock_guard<std::mutex> lock(m_workers[a.m_worker].mutex);
+
+        a.m_notified = false;
+    }
+
+    void scheduler::wake(actor& a)
+    {
+        worker& w = m_workers[a.m_worker];
+
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+
+            if(!a.m_parked) {
+                // Still on its way back to the thread.
+                a.m_notified = true;
+                return;
+            }
+
+            a.m_parked = false;
+            w.ready.push_back(&a);
+        }
+
+        w.wakeup.notify_one();
+    }
+
+    void scheduler::work(worker& w)
+    {
+        runtime::scope scope(m_runtime);
+
+        for(;;) {
+            actor* a;
+
+            {
+                std::unique_lock<std::mutex> lock(w.mutex);
+
+                w.wakeup.wait(lock, [&w]() { return w.stop || !w.ready.empty(); });
+
+                if(w.stop)
+                    break;
+
+                a = w.ready.front();
+                w.ready.pop_front();
+            }
+
+            {
+                waiter::scope current(*a);
+                profiler::stack_scope calls(a->m_calls);
+
+                a->m_fiber = std::move(a->m_fiber).resume();
+            }
+
+            boost::shared_ptr<actor> finished;
+            std::lock_guard<std::mutex> lock(w.mutex);
+
+            if(!a->m_fiber) {
+                for(std::size_t i = 0; i < w.actors.size(); ++i) {
+                    if(w.actors[i].get() == a) {
+                        // Released after the lock.
+                        finished.swap(w.actors[i]);
+                        w.actors[i] = w.actors.back();
+                        w.actors.pop_back();
+                        break;
+                    }
+                }
+            }
+            else if(a->m_notified) {
+                a->m_notified = false;
+                w.ready.push_back(a);
+            }
+            else
+                a->m_parked = true;
+        }
+
+        // Unwinds the fibers of the actors that didn't finish.
+        std::vector<boost::shared_ptr<actor> > remaining;
+
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+
+            remaining.swap(w.actors);
+            w.ready.clear();
+        }
+
+        for(std::size_t i = 0; i < remaining.size(); ++i) {
+            waiter::scope current(*remaining[i]);
+            profiler::stack_scope calls(remaining[i]->m_calls);
+
+            remaining[i]->m_fiber = boost::context::fiber();
+        }
+    }
+}
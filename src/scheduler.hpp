@@ -0,0 +1,89 @@
+#ifndef LISP_SCHEDULER_HPP
+#define LISP_SCHEDULER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/shared_ptr.hpp>
+
+
+namespace lisp {
+    class runtime;
+    class actor;
+
+    /**
+       @brief Runs the actors of a runtime on a fixed number of
+       threads.
+
+       Every actor stays on the thread it was assigned to when it
+       was started, the actors of a thread take turns: an actor
+       runs until it finishes or blocks on a channel (see
+       waiter::block()), then the thread resumes the next ready
+       one.
+    */
+    class scheduler : private boost::noncopyable
+    {
+    public:
+        scheduler(runtime& rt, std::size_t threads);
+
+        /**
+           @brief Stops the threads. Actors that didn't finish are
+           unwound on their threads.
+        */
+        ~scheduler();
+
+        std::size_t size() const
+            {
+                return m_workers.size();
+            }
+
+        /**
+           @brief Assigns @a a to a thread round-robin and makes it
+           ready.
+        */
+        void start(const boost::shared_ptr<actor>& a);
+
+        /**
+           @brief Called by an actor before it blocks, see wake().
+        */
+        void prepare_park(actor& a);
+
+        /**
+           @brief Makes a blocked actor ready again. If the actor
+           didn't return to its thread yet it is rescheduled right
+           away when it does.
+        */
+        void wake(actor& a);
+
+    private:
+        struct worker
+        {
+            worker()
+                : stop(false)
+                {
+                }
+
+            std::mutex mutex;
+            std::condition_variable wakeup;
+            std::deque<actor*> ready;
+            // The actors assigned to this thread that didn't finish.
+            std::vector<boost::shared_ptr<actor> > actors;
+            bool stop;
+            std::thread thread;
+        };
+
+        void work(worker& w);
+
+        runtime& m_runtime;
+        boost::ptr_vector<worker> m_workers;
+        std::atomic<std::size_t> m_next_worker;
+    };
+}
+
+#endif  // LISP_SCHEDULER_HPP
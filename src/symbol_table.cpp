@@ -0,0 +1,117 @@
+#include "symbol_table.hpp"
+
+#include <functional>
+
+
+namespace lisp {
+    namespace {
+        const std::size_t initial_bucket_count = 64;
+    }
+
+    concurrent_symbol_table::buckets::buckets(std::size_t count)
+        : count(count),
+          heads(new std::atomic<const node*>[count])
+    {
+        for(std::size_t i = 0; i < count; ++i)
+            heads[i].store(0, std::memory_order_relaxed);
+    }
+
+    concurrent_symbol_table::buckets::~buckets()
+    {
+        for(std::size_t i = 0; i < count; ++i) {
+            const node* n = heads[i].load(std::memory_order_relaxed);
+
+            while(n) {
+                const node* next = n->next;
+
+                delete n;
+                n = next;
+            }
+        }
+
+        delete[] heads;
+    }
+
+    concurrent_symbol_table::concurrent_symbol_table()
+        : m_buckets(new buckets(initial_bucket_count)),
+          m_size(0)
+    {
+    }
+
+    concurrent_symbol_table::~concurrent_symbol_table()
+    {
+        delete m_buckets.load(std::memory_order_relaxed);
+
+        for(std::size_t i = 0; i < m_retired.size(); ++i)
+            delete m_retired[i];
+    }
+
+    symbol* concurrent_symbol_table::find(const std::string& name) const
+    {
+        const node* n = find_in(m_buckets.load(std::memory_order_acquire), name,
+                                std::hash<std::string>()(name));
+
+        return n ? n->sym : 0;
+    }
+
+    symbol* concurrent_symbol_table::insert(const std::string& name, symbol* sym)
+    {
+        const std::size_t hash = std::hash<std::string>()(name);
+
+        std::lock_guard<std::mutex> lock(m_insert_mutex);
+
+        buckets* current = m_buckets.load(std::memory_order_relaxed);
+
+        if(const node* n = find_in(current, name, hash))
+            return n->sym;
+
+        const std::size_t size = m_size.load(std::memory_order_relaxed) + 1;
+
+        if(size * 4 > current->count * 3) {
+            // The nodes can't be moved, readers may be walking
+            // them, so the new array gets copies.
+            buckets* grown = new buckets(current->count * 2);
+
+            for(std::size_t i = 0; i < current->count; ++i)
+                for(const node* n = current->heads[i].load(std::memory_order_relaxed);
+                    n; n = n->next)
+                    link(grown, n->name, n->hash, n->sym);
+
+            m_retired.push_back(current);
+            m_buckets.store(grown, std::memory_order_release);
+            current = grown;
+        }
+
+        link(current, name, hash, sym);
+        m_size.store(size, std::memory_order_relaxed);
+
+        return sym;
+    }
+
+    const concurrent_symbol_table::node*
+    concurrent_symbol_table::find_in(const buckets* table, const std::string& name,
+                                     std::size_t hash)
+    {
+        for(const node* n = table->heads[hash % table->count].load(std::memory_order_acquire);
+            n; n = n->next) {
+            if(n->hash == hash && n->name == name)
+                return n;
+        }
+
+        return 0;
+    }
+
+    void concurrent_symbol_table::link(buckets* table, const std::string& name,
+                                       std::size_t hash, symbol* sym)
+    {
+        std::atomic<const node*>& head = table->heads[hash % table->count];
+        node* n = new node;
+
+        n->name = name;
+        n->hash = hash;
+        n->sym = sym;
+        n->next = head.load(std::memory_order_relaxed);
+
+        head.store(n, std::memory_order_release);
+    }
+}
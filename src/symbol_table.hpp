@@ -0,0 +1,101 @@
+#ifndef LISP_SYMBOL_TABLE_HPP
+#define LISP_SYMBOL_TABLE_HPP
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+
+namespace lisp {
+    class symbol;
+
+    /**
+       @brief Symbol table of a global environment, which threads
+       may read concurrently while it's extended.
+
+       Lookups never lock: the buckets are lists of nodes which are
+       immutable once they're published with a release store.
+       Inserting is serialized by a mutex. Growing the table
+       publishes a new bucket array. The old arrays and their nodes
+       are kept until the table is destroyed, because readers may
+       still walk them. Together they are smaller than the current
+       array.
+
+       Entries are never removed. The table doesn't own the symbols.
+    */
+    class concurrent_symbol_table : private boost::noncopyable
+    {
+    public:
+        concurrent_symbol_table();
+        ~concurrent_symbol_table();
+
+        /**
+           @brief Returns the named symbol or a null pointer.
+        */
+        symbol* find(const std::string& name) const;
+
+        /**
+           @brief Adds @a sym under @a name unless the name is taken
+           already.
+
+           @return The symbol in the table, which is not @a sym if
+           another thread inserted the name first.
+        */
+        symbol* insert(const std::string& name, symbol* sym);
+
+        std::size_t size() const
+            {
+                return m_size.load(std::memory_order_relaxed);
+            }
+
+        /**
+           @brief Calls @a f with every symbol. Must not run
+           concurrently with insert().
+        */
+        template <typename F>
+        void for_each(F f) const
+            {
+                const buckets* current = m_buckets.load(std::memory_order_acquire);
+
+                for(std::size_t i = 0; i < current->count; ++i)
+                    for(const node* n = current->heads[i].load(std::memory_order_acquire);
+                        n; n = n->next)
+                        f(n->sym);
+            }
+
+    private:
+        struct node
+        {
+            std::string name;
+            std::size_t hash;
+            symbol* sym;
+            const node* next;
+        };
+
+        struct buckets
+        {
+            explicit buckets(std::size_t count);
+            ~buckets();
+
+            std::size_t count;
+            std::atomic<const node*>* heads;
+        };
+
+        static const node* find_in(const buckets* table, const std::string& name,
+                                   std::size_t hash);
+
+        static void link(buckets* table, const std::string& name, std::size_t hash,
+                         symbol* sym);
+
+        std::atomic<buckets*> m_buckets;
+        std::atomic<std::size_t> m_size;
+
+        std::mutex m_insert_mutex;
+        std::vector<buckets*> m_retired;
+    };
+}
+
+#endif  // LISP_SYMBOL_TABLE_HPP
@@ -0,0 +1,168 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+
+namespace lisp {
+    namespace {
+        // The pool and queue index of a worker thread.
+        thread_local const thread_pool* current_pool = 0;
+        thread_local std::size_t current_queue = 0;
+
+        /**
+           @brief Counts the calling thread in @a helpers while the
+           scope exists.
+        */
+        class helper_scope
+        {
+        public:
+            explicit helper_scope(std::atomic<std::size_t>& helpers)
+                : m_helpers(helpers)
+                {
+                    ++m_helpers;
+                }
+
+            ~helper_scope()
+                {
+                    --m_helpers;
+                }
+
+        private:
+            std::atomic<std::size_t>& m_helpers;
+        };
+    }
+
+    thread_pool::thread_pool(std::size_t size)
+        : m_pending(0),
+          m_helpers(0),
+          m_next_queue(0),
+          m_stop(false)
+    {
+        for(std::size_t i = 0; i < std::max<std::size_t>(size, 1); ++i)
+            m_queues.push_back(new task_queue);
+
+        for(std::size_t i = 1; i < m_queues.size(); ++i)
+            m_threads.push_back(std::thread(&thread_pool::work, this, i));
+    }
+
+    thread_pool::~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            m_stop = true;
+        }
+
+        m_wakeup.notify_all();
+
+        for(std::size_t i = 0; i < m_threads.size(); ++i)
+            m_threads[i].join();
+
+        // Without threads the tasks are left to this one.
+        task_t task;
+
+        while(take(0, task))
+            execute(task);
+    }
+
+    void thread_pool::submit(task_t task)
+    {
+        std::size_t index = current_pool == this ?
+            current_queue : m_next_queue++ % m_queues.size();
+
+        // Counted first, so that taking it can't go below zero.
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            ++m_pending;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_queues[index].mutex);
+            m_queues[index].tasks.push_back(std::move(task));
+        }
+
+        m_wakeup.notify_all();
+    }
+
+    void thread_pool::help_until(const std::function<bool()>& done)
+    {
+        std::size_t own = current_pool == this ? current_queue : 0;
+        helper_scope helper(m_helpers);
+
+        while(!done()) {
+            task_t task;
+
+            if(take(own, task)) {
+                execute(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleep_mutex);
+            m_wakeup.wait(lock, [this, &done]() { return m_pending > 0 || done(); });
+        }
+    }
+
+    bool thread_pool::idle() const
+    {
+        return current_pool != this && m_helpers == 0 && m_pending == 0;
+    }
+
+    bool thread_pool::take(std::size_t own, task_t& task)
+    {
+        for(std::size_t i = 0; i < m_queues.size(); ++i) {
+            task_queue& queue = m_queues[(own + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if(queue.tasks.empty())
+                continue;
+
+            if(i == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+
+            --m_pending;
+
+            return true;
+        }
+
+        return false;
+    }
+
+    void thread_pool::execute(task_t& task)
+    {
+        task();
+        task = task_t();
+
+        // Waiting threads check their condition.
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        }
+
+        m_wakeup.notify_all();
+    }
+
+    void thread_pool::work(std::size_t index)
+    {
+        current_pool = this;
+        current_queue = index;
+
+        for(;;) {
+            task_t task;
+
+            if(take(index, task)) {
+                execute(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleep_mutex);
+            m_wakeup.wait(lock, [this]() { return m_pending > 0 || m_stop; });
+
+            if(m_stop && m_pending == 0)
+                return;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef LISP_THREAD_POOL_HPP
+#define LISP_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+
+namespace lisp {
+    /**
+       @brief Work-stealing thread pool.
+
+       Every participant has a deque of tasks. A worker takes the
+       newest task of its own deque and steals the oldest one of
+       another deque when its own is empty. Tasks submitted by a
+       worker go to its own deque, tasks from other threads are
+       distributed round-robin.
+
+       A thread waiting for tasks to finish helps running them (see
+       help_until()), so tasks may submit and wait for further
+       tasks without deadlocking the pool.
+    */
+    class thread_pool : private boost::noncopyable
+    {
+    public:
+        typedef std::function<void()> task_t;
+
+        /**
+           @param size The number of threads working on the tasks
+           including the thread that waits for them: size - 1
+           threads are started.
+        */
+        explicit thread_pool(std::size_t size);
+
+        /**
+           @brief Runs the remaining tasks and joins the threads.
+        */
+        ~thread_pool();
+
+        std::size_t size() const
+            {
+                return m_queues.size();
+            }
+
+        /**
+           @brief Queues @a task. Tasks must not throw.
+        */
+        void submit(task_t task);
+
+        /**
+           @brief Runs queued tasks on the calling thread until
+           @a done returns true.
+
+           @a done is checked whenever a task finishes, it must only
+           become true through tasks of this pool.
+        */
+        void help_until(const std::function<bool()>& done);
+
+        /**
+           @brief Whether the calling thread may destroy the pool: it
+           isn't a thread of the pool, no thread waits in
+           help_until() and no task is queued. Tasks that still run
+           are finished by the destructor.
+        */
+        bool idle() const;
+
+    private:
+        struct task_queue
+        {
+            std::mutex mutex;
+            std::deque<task_t> tasks;
+        };
+
+        /**
+           @brief Takes the newest task of queue @a own or the oldest
+           task of another queue.
+        */
+        bool take(std::size_t own, task_t& task);
+
+        void execute(task_t& task);
+
+        void work(std::size_t index);
+
+        boost::ptr_vector<task_queue> m_queues;
+        std::vector<std::thread> m_threads;
+
+        std::atomic<std::size_t> m_pending;
+        // Threads in help_until().
+        std::atomic<std::size_t> m_helpers;
+        std::atomic<std::size_t> m_next_queue;
+
+        std::mutex m_sleep_mutex;
+        std::condition_variable m_wakeup;
+        bool m_stop;
+    };
+}
+
+#endif  // LISP_THREAD_POOL_HPP
@@ -0,0 +1,89 @@
+#include "timing.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "lisp.hpp"
+#include "utils.hpp"
+#include "profiler.hpp"
+#include "eval_stats.hpp"
+
+
+namespace lisp {
+    namespace {
+        void add_property(list_builder& plist, const char* keyword, const object_ptr_t& value)
+        {
+            plist.push_back(object_ptr_t(new symbol_ref(keyword)));
+            plist.push_back(value);
+        }
+
+        void add_property(list_builder& plist, const char* keyword, unsigned long long value)
+        {
+            add_property(plist, keyword, object_ptr_t(new number(static_cast<long long>(value))));
+        }
+    }
+
+    object_ptr_t measure_evaluation(const std::string& name, long long iterations,
+                                    const std::function<object_ptr_t()>& body)
+    {
+        object_ptr_t value = nil();
+        std::chrono::nanoseconds elapsed;
+        allocation_counts allocated = thread_allocations();
+        eval_stats::counts_t events = eval_stats::thread_totals();
+        std::uint64_t calls;
+        std::size_t peak_depth;
+
+        {
+            profiler::call_counter counter;
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            for(long long i = 0; i < iterations; ++i)
+                value = body();
+
+            elapsed = std::chrono::steady_clock::now() - start;
+            calls = counter.calls();
+            peak_depth = counter.peak_depth();
+        }
+
+        const allocation_counts allocated_after = thread_allocations();
+        const std::uint64_t evals =
+            eval_stats::thread_totals().counts[eval_stats::evals] - events.counts[eval_stats::evals];
+
+        allocated.objects = allocated_after.objects - allocated.objects;
+        allocated.bytes = allocated_after.bytes - allocated.bytes;
+
+        const double seconds = std::chrono::duration<double>(elapsed).count();
+        std::ostringstream report;
+
+        report << name << ": " << std::fixed << std::setprecision(3) << seconds * 1e3 << " ms";
+
+        if(iterations != 1)
+            report << " for " << iterations << " iterations ("
+                   << seconds * 1e3 / iterations << " ms each)";
+
+        report << ", " << allocated.objects << " allocations (" << allocated.bytes << " bytes), "
+               << calls << " calls, peak depth " << peak_depth;
+
+        if(eval_stats::enabled)
+            report << ", " << evals << " evals";
+
+        std::cerr << report.str() << std::endl;
+
+        list_builder plist;
+
+        add_property(plist, ":value", value);
+        add_property(plist, ":iterations", static_cast<unsigned long long>(iterations));
+        add_property(plist, ":seconds", object_ptr_t(new number(seconds)));
+        add_property(plist, ":allocations", allocated.objects);
+        add_property(plist, ":bytes", allocated.bytes);
+        add_property(plist, ":calls", calls);
+        add_property(plist, ":peak-depth", peak_depth);
+
+        if(eval_stats::enabled)
+            add_property(plist, ":evals", evals);
+
+        return plist.list();
+    }
+}
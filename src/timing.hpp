@@ -0,0 +1,36 @@
+#ifndef LISP_TIMING_HPP
+#define LISP_TIMING_HPP
+
+#include <functional>
+#include <string>
+
+#include "object.hpp"
+
+
+namespace lisp {
+    /**
+       @brief Evaluates @a body @a iterations times and reports what
+       it took, see (time EXPR) and (benchmark N EXPR).
+
+       Measures the time of a monotonic clock, the lisp objects
+       allocated (see thread_allocations()), the calls of lisp
+       functions and builtins and their deepest nesting (see
+       profiler::call_counter) and, if built with LISP_EVAL_STATS,
+       the calls of environment::eval(), which analyzed code mostly
+       bypasses. Except for the time only
+       the calling thread is measured, work done by futures or
+       other actors isn't included.
+
+       Prints the report to std::cerr and returns it as a plist:
+       (:value VALUE :iterations N :seconds S :allocations N
+       :bytes N :calls N :peak-depth N [:evals N]), VALUE being
+       the value of the last evaluation.
+
+       @param name Prefixes the printed report.
+       @param iterations Must be positive.
+    */
+    object_ptr_t measure_evaluation(const std::string& name, long long iterations,
+                                    const std::function<object_ptr_t()>& body);
+}
+
+#endif  // LISP_TIMING_HPP
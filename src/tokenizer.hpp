@@ -38,7 +38,9 @@ namespace lisp {
         SYMBOL,
         NUMBER,
         DOT,
-        QUOTE
+        QUOTE,
+        // The opening `#(' of a vector literal.
+        VECTOR_START
     };
 
     /**
@@ -88,6 +90,17 @@ namespace lisp {
                         m_cache += *m_iterator;
                         ++m_iterator;
                         return (m_current_token = QUOTE);
+                    case '#': {
+                        T next = m_iterator;
+
+                        if(++next != m_end && *next == '(') {
+                            m_cache = "#(";
+                            m_iterator = ++next;
+                            return (m_current_token = VECTOR_START);
+                        }
+
+                        return parse_symbol_or_number();
+                    }
                     case '\n':
                         ++m_line;
                     case ' ':
@@ -121,7 +134,7 @@ namespace lisp {
 
         void parse_string()
             {
-                bool escaped;
+                bool escaped = false;
 
                 assert(*m_iterator == '"');
                 ++m_iterator;
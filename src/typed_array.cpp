@@ -0,0 +1,602 @@
+#include "typed_array.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+#include "arith_error.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LISP_HAVE_AVX2_KERNELS 1
+#include <immintrin.h>
+#endif
+
+
+namespace lisp {
+    namespace simd {
+        namespace {
+            namespace scalar {
+                template <typename T>
+                void add(const T* a, const T* b, T* out, std::size_t n)
+                {
+                    for(std::size_t i = 0; i < n; ++i)
+                        out[i] = a[i] + b[i];
+                }
+
+                template <typename T>
+                void sub(const T* a, const T* b, T* out, std::size_t n)
+                {
+                    for(std::size_t i = 0; i < n; ++i)
+                        out[i] = a[i] - b[i];
+                }
+
+                template <typename T>
+                void mul(const T* a, const T* b, T* out, std::size_t n)
+                {
+                    for(std::size_t i = 0; i < n; ++i)
+                        out[i] = a[i] * b[i];
+                }
+
+                template <typename T>
+                void div(const T* a, const T* b, T* out, std::size_t n)
+                {
+                    for(std::size_t i = 0; i < n; ++i)
+                        out[i] = a[i] / b[i];
+                }
+
+                template <typename T>
+                void scale(const T* a, T k, T* out, std::size_t n)
+                {
+                    for(std::size_t i = 0; i < n; ++i)
+                        out[i] = a[i] * k;
+                }
+
+                template <typename T>
+                T sum(const T* a, std::size_t n)
+                {
+                    T result = 0;
+
+                    for(std::size_t i = 0; i < n; ++i)
+                        result += a[i];
+
+                    return result;
+                }
+
+                template <typename T>
+                T dot(const T* a, const T* b, std::size_t n)
+                {
+                    T result = 0;
+
+                    for(std::size_t i = 0; i < n; ++i)
+                        result += a[i] * b[i];
+
+                    return result;
+                }
+
+                template <typename T>
+                T min(const T* a, std::size_t n)
+                {
+                    return *std::min_element(a, a + n);
+                }
+
+                template <typename T>
+                T max(const T* a, std::size_t n)
+                {
+                    return *std::max_element(a, a + n);
+                }
+
+                template <typename T>
+                void less(const T* a, const T* b, long long* mask, std::size_t n)
+                {
+                    for(std::size_t i = 0; i < n; ++i)
+                        mask[i] = a[i] < b[i];
+                }
+
+                template <typename T>
+                void greater(const T* a, const T* b, long long* mask, std::size_t n)
+                {
+                    for(std::size_t i = 0; i < n; ++i)
+                        mask[i] = a[i] > b[i];
+                }
+
+                template <typename T>
+                void equal(const T* a, const T* b, long long* mask, std::size_t n)
+                {
+                    for(std::size_t i = 0; i < n; ++i)
+                        mask[i] = a[i] == b[i];
+                }
+            }
+
+#ifdef LISP_HAVE_AVX2_KERNELS
+            /*
+              Every kernel handles four elements per instruction and
+              passes the remainder to the scalar version.
+            */
+            namespace avx2 {
+                __attribute__((target("avx2")))
+                inline __m256d load(const double* p)
+                {
+                    return _mm256_loadu_pd(p);
+                }
+
+                __attribute__((target("avx2")))
+                inline __m256i load(const long long* p)
+                {
+                    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                }
+
+                __attribute__((target("avx2")))
+                inline void store(double* p, __m256d v)
+                {
+                    _mm256_storeu_pd(p, v);
+                }
+
+                __attribute__((target("avx2")))
+                inline void store(long long* p, __m256i v)
+                {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+                }
+
+                __attribute__((target("avx2")))
+                double horizontal_sum(__m256d v)
+                {
+                    double lanes[4];
+
+                    _mm256_storeu_pd(lanes, v);
+                    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+                }
+
+                __attribute__((target("avx2")))
+                long long horizontal_sum(__m256i v)
+                {
+                    long long lanes[4];
+
+                    store(lanes, v);
+                    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+                }
+
+                __attribute__((target("avx2")))
+                void add(const double* a, const double* b, double* out, std::size_t n)
+                {
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        store(out + i, _mm256_add_pd(load(a + i), load(b + i)));
+
+                    scalar::add(a + i, b + i, out + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                void add(const long long* a, const long long* b, long long* out, std::size_t n)
+                {
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        store(out + i, _mm256_add_epi64(load(a + i), load(b + i)));
+
+                    scalar::add(a + i, b + i, out + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                void sub(const double* a, const double* b, double* out, std::size_t n)
+                {
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        store(out + i, _mm256_sub_pd(load(a + i), load(b + i)));
+
+                    scalar::sub(a + i, b + i, out + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                void sub(const long long* a, const long long* b, long long* out, std::size_t n)
+                {
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        store(out + i, _mm256_sub_epi64(load(a + i), load(b + i)));
+
+                    scalar::sub(a + i, b + i, out + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                void mul(const double* a, const double* b, double* out, std::size_t n)
+                {
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        store(out + i, _mm256_mul_pd(load(a + i), load(b + i)));
+
+                    scalar::mul(a + i, b + i, out + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                void div(const double* a, const double* b, double* out, std::size_t n)
+                {
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        store(out + i, _mm256_div_pd(load(a + i), load(b + i)));
+
+                    scalar::div(a + i, b + i, out + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                void scale(const double* a, double k, double* out, std::size_t n)
+                {
+                    __m256d factor = _mm256_set1_pd(k);
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        store(out + i, _mm256_mul_pd(load(a + i), factor));
+
+                    scalar::scale(a + i, k, out + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                double sum(const double* a, std::size_t n)
+                {
+                    __m256d acc = _mm256_setzero_pd();
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        acc = _mm256_add_pd(acc, load(a + i));
+
+                    return horizontal_sum(acc) + scalar::sum(a + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                long long sum(const long long* a, std::size_t n)
+                {
+                    __m256i acc = _mm256_setzero_si256();
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        acc = _mm256_add_epi64(acc, load(a + i));
+
+                    return horizontal_sum(acc) + scalar::sum(a + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                double dot(const double* a, const double* b, std::size_t n)
+                {
+                    __m256d acc = _mm256_setzero_pd();
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        acc = _mm256_add_pd(acc, _mm256_mul_pd(load(a + i), load(b + i)));
+
+                    return horizontal_sum(acc) + scalar::dot(a + i, b + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                double min(const double* a, std::size_t n)
+                {
+                    if(n < 4)
+                        return scalar::min(a, n);
+
+                    __m256d acc = load(a);
+                    std::size_t i = 4;
+
+                    for(; i + 4 <= n; i += 4)
+                        acc = _mm256_min_pd(acc, load(a + i));
+
+                    double lanes[4];
+                    store(lanes, acc);
+
+                    double result = scalar::min(lanes, 4);
+
+                    return i < n ? std::min(result, scalar::min(a + i, n - i)) : result;
+                }
+
+                __attribute__((target("avx2")))
+                double max(const double* a, std::size_t n)
+                {
+                    if(n < 4)
+                        return scalar::max(a, n);
+
+                    __m256d acc = load(a);
+                    std::size_t i = 4;
+
+                    for(; i + 4 <= n; i += 4)
+                        acc = _mm256_max_pd(acc, load(a + i));
+
+                    double lanes[4];
+                    store(lanes, acc);
+
+                    double result = scalar::max(lanes, 4);
+
+                    return i < n ? std::max(result, scalar::max(a + i, n - i)) : result;
+                }
+
+                __attribute__((target("avx2")))
+                long long min(const long long* a, std::size_t n)
+                {
+                    if(n < 4)
+                        return scalar::min(a, n);
+
+                    __m256i acc = load(a);
+                    std::size_t i = 4;
+
+                    for(; i + 4 <= n; i += 4) {
+                        __m256i next = load(a + i);
+
+                        acc = _mm256_blendv_epi8(acc, next, _mm256_cmpgt_epi64(acc, next));
+                    }
+
+                    long long lanes[4];
+                    store(lanes, acc);
+
+                    long long result = scalar::min(lanes, 4);
+
+                    return i < n ? std::min(result, scalar::min(a + i, n - i)) : result;
+                }
+
+                __attribute__((target("avx2")))
+                long long max(const long long* a, std::size_t n)
+                {
+                    if(n < 4)
+                        return scalar::max(a, n);
+
+                    __m256i acc = load(a);
+                    std::size_t i = 4;
+
+                    for(; i + 4 <= n; i += 4) {
+                        __m256i next = load(a + i);
+
+                        acc = _mm256_blendv_epi8(acc, next, _mm256_cmpgt_epi64(next, acc));
+                    }
+
+                    long long lanes[4];
+                    store(lanes, acc);
+
+                    long long result = scalar::max(lanes, 4);
+
+                    return i < n ? std::max(result, scalar::max(a + i, n - i)) : result;
+                }
+
+                /*
+                  Comparisons set all bits of a lane, the mask keeps
+                  the lowest one.
+                */
+                template <int Predicate>
+                __attribute__((target("avx2")))
+                void compare(const double* a, const double* b, long long* mask, std::size_t n)
+                {
+                    __m256i one = _mm256_set1_epi64x(1);
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        store(mask + i,
+                              _mm256_and_si256(
+                                  _mm256_castpd_si256(
+                                      _mm256_cmp_pd(load(a + i), load(b + i), Predicate)),
+                                  one));
+
+                    switch(Predicate) {
+                    case _CMP_LT_OQ:
+                        scalar::less(a + i, b + i, mask + i, n - i);
+                        break;
+                    case _CMP_GT_OQ:
+                        scalar::greater(a + i, b + i, mask + i, n - i);
+                        break;
+                    default:
+                        scalar::equal(a + i, b + i, mask + i, n - i);
+                    }
+                }
+
+                __attribute__((target("avx2")))
+                void greater(const long long* a, const long long* b, long long* mask,
+                             std::size_t n)
+                {
+                    __m256i one = _mm256_set1_epi64x(1);
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        store(mask + i,
+                              _mm256_and_si256(_mm256_cmpgt_epi64(load(a + i), load(b + i)),
+                                               one));
+
+                    scalar::greater(a + i, b + i, mask + i, n - i);
+                }
+
+                __attribute__((target("avx2")))
+                void equal(const long long* a, const long long* b, long long* mask,
+                           std::size_t n)
+                {
+                    __m256i one = _mm256_set1_epi64x(1);
+                    std::size_t i = 0;
+
+                    for(; i + 4 <= n; i += 4)
+                        store(mask + i,
+                              _mm256_and_si256(_mm256_cmpeq_epi64(load(a + i), load(b + i)),
+                                               one));
+
+                    scalar::equal(a + i, b + i, mask + i, n - i);
+                }
+            }
+
+            bool detect_avx2()
+            {
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2");
+            }
+
+            const bool _available = detect_avx2();
+#else
+            const bool _available = false;
+#endif
+
+            // Read by the kernels of every thread.
+            std::atomic<bool> _enabled(_available);
+        }  // Anonymous namespace
+
+        bool available()
+        {
+            return _available;
+        }
+
+        void enable(bool on)
+        {
+            _enabled.store(on && _available, std::memory_order_relaxed);
+        }
+
+        bool enabled()
+        {
+            return _enabled.load(std::memory_order_relaxed);
+        }
+
+#ifdef LISP_HAVE_AVX2_KERNELS
+#define LISP_SIMD_DISPATCH(call)                \
+        if(enabled())                           \
+            return avx2::call;                  \
+        return scalar::call
+#else
+#define LISP_SIMD_DISPATCH(call)                \
+        return scalar::call
+#endif
+
+        void add(const double* a, const double* b, double* out, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(add(a, b, out, n));
+        }
+
+        void add(const long long* a, const long long* b, long long* out, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(add(a, b, out, n));
+        }
+
+        void sub(const double* a, const double* b, double* out, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(sub(a, b, out, n));
+        }
+
+        void sub(const long long* a, const long long* b, long long* out, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(sub(a, b, out, n));
+        }
+
+        void mul(const double* a, const double* b, double* out, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(mul(a, b, out, n));
+        }
+
+        void mul(const long long* a, const long long* b, long long* out, std::size_t n)
+        {
+            scalar::mul(a, b, out, n);
+        }
+
+        void div(const double* a, const double* b, double* out, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(div(a, b, out, n));
+        }
+
+        void div(const long long* a, const long long* b, long long* out, std::size_t n)
+        {
+            // Both trap in hardware.
+            for(std::size_t i = 0; i < n; ++i) {
+                if(b[i] == 0)
+                    throw arith_error("division by zero");
+
+                if(b[i] == -1 && a[i] == std::numeric_limits<long long>::min())
+                    throw arith_error("integer overflow");
+            }
+
+            scalar::div(a, b, out, n);
+        }
+
+        void scale(const double* a, double k, double* out, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(scale(a, k, out, n));
+        }
+
+        void scale(const long long* a, long long k, long long* out, std::size_t n)
+        {
+            scalar::scale(a, k, out, n);
+        }
+
+        double sum(const double* a, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(sum(a, n));
+        }
+
+        long long sum(const long long* a, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(sum(a, n));
+        }
+
+        double dot(const double* a, const double* b, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(dot(a, b, n));
+        }
+
+        long long dot(const long long* a, const long long* b, std::size_t n)
+        {
+            return scalar::dot(a, b, n);
+        }
+
+        double min(const double* a, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(min(a, n));
+        }
+
+        long long min(const long long* a, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(min(a, n));
+        }
+
+        double max(const double* a, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(max(a, n));
+        }
+
+        long long max(const long long* a, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(max(a, n));
+        }
+
+        void less(const double* a, const double* b, long long* mask, std::size_t n)
+        {
+#ifdef LISP_HAVE_AVX2_KERNELS
+            if(enabled())
+                return avx2::compare<_CMP_LT_OQ>(a, b, mask, n);
+#endif
+            scalar::less(a, b, mask, n);
+        }
+
+        void less(const long long* a, const long long* b, long long* mask, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(greater(b, a, mask, n));
+        }
+
+        void greater(const double* a, const double* b, long long* mask, std::size_t n)
+        {
+#ifdef LISP_HAVE_AVX2_KERNELS
+            if(enabled())
+                return avx2::compare<_CMP_GT_OQ>(a, b, mask, n);
+#endif
+            scalar::greater(a, b, mask, n);
+        }
+
+        void greater(const long long* a, const long long* b, long long* mask, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(greater(a, b, mask, n));
+        }
+
+        void equal(const double* a, const double* b, long long* mask, std::size_t n)
+        {
+#ifdef LISP_HAVE_AVX2_KERNELS
+            if(enabled())
+                return avx2::compare<_CMP_EQ_OQ>(a, b, mask, n);
+#endif
+            scalar::equal(a, b, mask, n);
+        }
+
+        void equal(const long long* a, const long long* b, long long* mask, std::size_t n)
+        {
+            LISP_SIMD_DISPATCH(equal(a, b, mask, n));
+        }
+
+#undef LISP_SIMD_DISPATCH
+    }
+}
@@ -0,0 +1,182 @@
+#ifndef LISP_TYPED_ARRAY_HPP
+#define LISP_TYPED_ARRAY_HPP
+
+#include <vector>
+#include <sstream>
+
+#include "object.hpp"
+
+namespace lisp {
+    /**
+       @brief Names the element type of a typed_array when printed.
+    */
+    template <typename T>
+    struct typed_array_traits;
+
+    template <>
+    struct typed_array_traits<double>
+    {
+        static const char* name()
+            {
+                return "f64";
+            }
+    };
+
+    template <>
+    struct typed_array_traits<long long>
+    {
+        static const char* name()
+            {
+                return "i64";
+            }
+    };
+
+    /**
+       @brief Array of unboxed numbers, processed by the kernels in
+       namespace simd.
+
+       Printed as #f64(ELEMENTS...) or #i64(ELEMENTS...).
+    */
+    template <typename T>
+    class typed_array : public object
+    {
+    public:
+        typedef T value_type;
+        typedef std::vector<T> elements_t;
+
+        explicit typed_array(std::size_t size = 0)
+            : m_elements(size)
+            {
+            }
+
+        typed_array(const elements_t& elements)
+            : m_elements(elements)
+            {
+            }
+
+        std::size_t size() const
+            {
+                return m_elements.size();
+            }
+
+        const T* data() const
+            {
+                return m_elements.empty() ? 0 : &m_elements[0];
+            }
+
+        T* data()
+            {
+                return m_elements.empty() ? 0 : &m_elements[0];
+            }
+
+        T operator[](std::size_t index) const
+            {
+                return m_elements[index];
+            }
+
+        std::string str() const
+            {
+                std::stringstream os;
+
+                os << "#" << typed_array_traits<T>::name() << "(";
+
+                for(std::size_t i = 0; i < m_elements.size(); ++i) {
+                    if(i > 0)
+                        os << " ";
+
+                    os << m_elements[i];
+                }
+
+                os << ")";
+
+                return os.str();
+            }
+
+    private:
+        elements_t m_elements;
+    };
+
+    typedef typed_array<double> f64_array;
+    typedef typed_array<long long> i64_array;
+
+    /**
+       @brief Loops over unboxed arrays.
+
+       Each kernel has an AVX2 implementation, which is used if the
+       CPU supports it, and a scalar one. Kernels without an AVX2
+       instruction for the element type (64 bit integer
+       multiplication and division) are always scalar. Sums and dot
+       products of doubles are accumulated in several lanes, so
+       their rounding can differ from a left-to-right loop.
+    */
+    namespace simd {
+        /**
+           @brief Checks whether the CPU supports AVX2.
+        */
+        bool available();
+
+        /**
+           @brief Switches between the AVX2 and the scalar kernels,
+           e.g. for comparing them. Has no effect if AVX2 isn't
+           available.
+        */
+        void enable(bool on);
+
+        bool enabled();
+
+        void add(const double* a, const double* b, double* out, std::size_t n);
+        void add(const long long* a, const long long* b, long long* out, std::size_t n);
+
+        void sub(const double* a, const double* b, double* out, std::size_t n);
+        void sub(const long long* a, const long long* b, long long* out, std::size_t n);
+
+        void mul(const double* a, const double* b, double* out, std::size_t n);
+        void mul(const long long* a, const long long* b, long long* out, std::size_t n);
+
+        void div(const double* a, const double* b, double* out, std::size_t n);
+
+        /**
+           @brief Truncating division.
+
+           @throws arith_error if an element of @a b is zero or the
+           quotient overflows (LLONG_MIN / -1).
+        */
+        void div(const long long* a, const long long* b, long long* out, std::size_t n);
+
+        /**
+           @brief Multiplies every element of @a a with @a k.
+        */
+        void scale(const double* a, double k, double* out, std::size_t n);
+        void scale(const long long* a, long long k, long long* out, std::size_t n);
+
+        double sum(const double* a, std::size_t n);
+        long long sum(const long long* a, std::size_t n);
+
+        double dot(const double* a, const double* b, std::size_t n);
+        long long dot(const long long* a, const long long* b, std::size_t n);
+
+        /**
+           @brief Minimum of the elements, @a n must not be 0.
+        */
+        double min(const double* a, std::size_t n);
+        long long min(const long long* a, std::size_t n);
+
+        double max(const double* a, std::size_t n);
+        long long max(const long long* a, std::size_t n);
+
+        /**
+           @brief Stores 1 in @a mask where the element of @a a is
+           less than the one of @a b and 0 elsewhere.
+        */
+        void less(const double* a, const double* b, long long* mask, std::size_t n);
+        void less(const long long* a, const long long* b, long long* mask, std::size_t n);
+
+        void greater(const double* a, const double* b, long long* mask, std::size_t n);
+        void greater(const long long* a, const long long* b, long long* mask, std::size_t n);
+
+        void equal(const double* a, const double* b, long long* mask, std::size_t n);
+        void equal(const long long* a, const long long* b, long long* mask, std::size_t n);
+    }
+}
+
+#endif  // LISP_TYPED_ARRAY_HPP
@@ -1,6 +1,10 @@
 #ifndef LISP_TYPES_HPP
 #define LISP_TYPES_HPP
 
+#include <atomic>
+
+#include <boost/functional/hash.hpp>
+
 #include "object.hpp"
 #include "number.hpp"
 
@@ -9,8 +13,30 @@ namespace lisp {
     {
     public:
         string(const std::string& std_str)
-            : m_str(std_str)
+            : m_str(std_str),
+              m_hash(0),
+              m_hashed(false)
+            {
+            }
+
+        const std::string& value() const
             {
+                return m_str;
+            }
+
+        /**
+           @brief Returns the hash of the content, computed on first
+           use. Threads sharing the string may race to compute it,
+           they store the same value.
+        */
+        std::size_t hash() const
+            {
+                if(!m_hashed.load(std::memory_order_acquire)) {
+                    m_hash.store(boost::hash<std::string>()(m_str), std::memory_order_relaxed);
+                    m_hashed.store(true, std::memory_order_release);
+                }
+
+                return m_hash.load(std::memory_order_relaxed);
             }
 
         operator std::string() const
@@ -30,6 +56,8 @@ namespace lisp {
 
     private:
         std::string m_str;
+        mutable std::atomic<std::size_t> m_hash;
+        mutable std::atomic<bool> m_hashed;
     };
 }
 
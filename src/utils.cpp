@@ -1,5 +1,6 @@
 
 #include "utils.hpp"
+#include "eval_stats.hpp"
 
 
 namespace lisp {
@@ -23,20 +24,44 @@ namespace lisp {
         }
     }
 
-    cons_cell_ptr_t list_next(cons_cell_ptr_t list, const std::string& msg)
+    cons_cell_ptr_t list_next(const cons_cell_ptr_t& list, const error_context& context)
     {
-        object_ptr_t cdr = list->cdr();
+        eval_stats::count(eval_stats::list_next_steps);
+
+        const object_ptr_t& cdr = list->cdr();
 
         if(cdr->is_cons_cell())
         {
-            cons_cell_ptr_t cell = boost::dynamic_pointer_cast<cons_cell>(cdr);
-            return cell;
+            return boost::static_pointer_cast<cons_cell>(cdr);
         }
         else if(cdr == nil())
             return cons_cell_ptr_t();
         else
-            signal(global_env()->get_symbol("invalid-type-argument"), msg);
+            signal(global_env()->get_symbol("invalid-type-argument"), context.str());
 
         assert(false);
     }
+
+    object_ptr_t resolve_function(environment* env, const object_ptr_t& func)
+    {
+        object_ptr_t callee = func;
+
+        if(const symbol_ref* ref = exact_cast<symbol_ref>(func)) {
+            callee = env->get_function(ref->name());
+
+            if(!callee)
+                signal(env->get_symbol("void-function"), ref->name());
+        }
+
+        if(!callee->is_applicable())
+            signal(env->get_symbol("invalid-function"), callee->str());
+
+        return callee;
+    }
+
+    object_ptr_t apply_function(environment* env, const object_ptr_t& func,
+                                const argv_t& args)
+    {
+        return resolve_function(env, func)->apply(env, args);
+    }
 }
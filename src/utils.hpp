@@ -1,6 +1,8 @@
 #ifndef LISP_UTILS_HPP
 #define LISP_UTILS_HPP
 
+#include <typeinfo>
+
 #include <boost/function.hpp>
 
 #include "lisp.hpp"
@@ -9,10 +11,143 @@
 namespace lisp {
     typedef boost::function<void (object_ptr_t, int)> callback_t;
 
+    /**
+       @brief Returns @a obj as T if its dynamic type is exactly T,
+       otherwise a null pointer.
+
+       Compares the type_info of the object, which doesn't need a
+       virtual call.
+    */
+    template <typename T>
+    const T* exact_cast(const object_ptr_t& obj)
+    {
+        return typeid(*obj) == typeid(T) ? static_cast<const T*>(obj.get()) : 0;
+    }
+
+    /**
+       @brief Describes the context of an error for its message.
+
+       Only holds pointers, so it can be passed around on every
+       call. The message is built by str() once the error is
+       actually signaled.
+    */
+    class error_context
+    {
+    public:
+        /**
+           @param what A static message, e.g. "if: listp".
+        */
+        error_context(const char* what = "")
+            : m_object(0),
+              m_what(what)
+            {
+            }
+
+        /**
+           @brief The message is the printed @a obj followed by
+           @a what.
+
+           @a obj must live until the context isn't used anymore.
+        */
+        error_context(const object_ptr_t& obj, const char* what)
+            : m_object(obj.get()),
+              m_what(what)
+            {
+            }
+
+        std::string str() const
+            {
+                if(m_object)
+                    return m_object->str() + m_what;
+
+                return m_what;
+            }
+
+    private:
+        const object* m_object;
+        const char* m_what;
+    };
+
     void dolist(const cons_cell_ptr_t list, callback_t cb);
 
-    cons_cell_ptr_t list_next(cons_cell_ptr_t list,
-                              const std::string& msg = std::string());
+    /**
+       @brief Returns the next cell of @a list or a null pointer if
+       the end of the list is reached.
+
+       Signals `invalid-type-argument' with the message of @a context
+       if the list is dotted.
+    */
+    cons_cell_ptr_t list_next(const cons_cell_ptr_t& list,
+                              const error_context& context = error_context());
+
+    /**
+       @brief Returns the function object @a func or the function
+       of the symbol it names.
+
+       Signals `void-function' for unbound symbols and
+       `invalid-function' for objects that don't take evaluated
+       arguments, like special forms.
+    */
+    object_ptr_t resolve_function(environment* env, const object_ptr_t& func);
+
+    /**
+       @brief Calls @a func with already evaluated arguments.
+
+       @a func is a function object or a symbol naming one.
+       Signals `invalid-function' for objects that don't take
+       evaluated arguments, like special forms.
+    */
+    object_ptr_t apply_function(environment* env, const object_ptr_t& func,
+                                const argv_t& args);
+
+    /**
+       @brief Builds a list front to back in one pass by keeping a
+       pointer to its last cell.
+    */
+    class list_builder
+    {
+    public:
+        list_builder()
+            : m_list(nil()),
+              m_tail(0)
+            {
+            }
+
+        void push_back(const object_ptr_t& obj)
+            {
+                object_ptr_t cell(new cons_cell(obj));
+
+                if(m_tail)
+                    m_tail->m_cdr = cell;
+                else
+                    m_list = cell;
+
+                m_tail = static_cast<cons_cell*>(cell.get());
+            }
+
+        /**
+           @brief Uses @a rest as the remainder of the list without
+           copying it. Nothing can be pushed afterwards.
+        */
+        void set_rest(const object_ptr_t& rest)
+            {
+                if(m_tail)
+                    m_tail->m_cdr = rest;
+                else
+                    m_list = rest;
+
+                m_tail = 0;
+            }
+
+        const object_ptr_t& list() const
+            {
+                return m_list;
+            }
+
+    private:
+        object_ptr_t m_list;
+        cons_cell* m_tail;
+    };
 }
 
 #endif  // LISP_UTILS_HPP
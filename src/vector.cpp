@@ -0,0 +1,24 @@
+#include "vector.hpp"
+
+#include <sstream>
+
+
+namespace lisp {
+    std::string vector::str() const
+    {
+        std::stringstream os;
+
+        os << "#(";
+
+        for(std::size_t i = 0; i < m_elements.size(); ++i) {
+            if(i > 0)
+                os << " ";
+
+            os << m_elements[i]->str();
+        }
+
+        os << ")";
+
+        return os.str();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef LISP_VECTOR_HPP
+#define LISP_VECTOR_HPP
+
+#include <vector>
+#include <algorithm>
+
+#include "object.hpp"
+#include "equality.hpp"
+
+namespace lisp {
+    /**
+       @brief Array of objects with constant time access by index.
+
+       Printed and read as #(ELEMENTS...). A vector evaluates to
+       itself.
+    */
+    class vector : public object
+    {
+    public:
+        typedef std::vector<object_ptr_t> elements_t;
+
+        vector(std::size_t size, const object_ptr_t& init)
+            : m_elements(size, init)
+            {
+            }
+
+        vector(const elements_t& elements)
+            : m_elements(elements)
+            {
+            }
+
+        std::size_t size() const
+            {
+                return m_elements.size();
+            }
+
+        const object_ptr_t& operator[](std::size_t index) const
+            {
+                return m_elements[index];
+            }
+
+        /**
+           @brief Replaces an element. Invalidates the cached hashes
+           of all lists, which may contain the vector.
+        */
+        void set(std::size_t index, const object_ptr_t& value)
+            {
+                m_elements[index] = value;
+                invalidate_hashes();
+            }
+
+        /**
+           @brief Reverses the elements in place.
+        */
+        void reverse()
+            {
+                std::reverse(m_elements.begin(), m_elements.end());
+                invalidate_hashes();
+            }
+
+        const elements_t& elements() const
+            {
+                return m_elements;
+            }
+
+        /**
+           @brief The elements as arguments for object::apply().
+        */
+        operator argv_t() const
+            {
+                return argv_t(m_elements);
+            }
+
+        std::string str() const;
+
+    private:
+        elements_t m_elements;
+    };
+
+    typedef boost::shared_ptr<vector> vector_ptr_t;
+}
+
+#endif  // LISP_VECTOR_HPP